@@ -59,7 +59,7 @@ extern void fp_enter(void);
 #define EXPORT_SYMBOL_ALIAS(sym,orig)		\
  EXPORT_CRC_ALIAS(sym)				\
  static const struct kernel_symbol __ksymtab_##sym	\
-  __used __attribute__((section("__ksymtab"))) =	\
+  __used __attribute__((section("___ksymtab+" #sym))) =	\
     { (unsigned long)&orig, #sym };
 
 /*
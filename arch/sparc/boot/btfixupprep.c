@@ -68,6 +68,13 @@ void fatal(void)
 	exit(1);
 }
 
+/* EXPORT_SYMBOL() puts each entry in its own ___ksymtab+<sym> section,
+   which the linker script gathers into __ksymtab. */
+int is_ksymtab(const char *sect)
+{
+	return !strcmp(sect, "__ksymtab") || !strncmp(sect, "___ksymtab+", 11);
+}
+
 btfixup *find(int type, char *name)
 {
 	int i;
@@ -176,7 +183,7 @@ main1:
 		if (strcmp (sect, ".text") &&
 		    strcmp (sect, ".init.text") &&
 		    strcmp (sect, ".fixup") &&
-		    (strcmp (sect, "__ksymtab") || buffer[nbase+3] != 'f')) {
+		    (!is_ksymtab(sect) || buffer[nbase+3] != 'f')) {
 			if (buffer[nbase+3] == 'f')
 				fprintf(stderr,
 				    "Wrong use of '%s' in '%s' section.\n"
@@ -219,7 +226,7 @@ main1:
 				fprintf(stderr, "Cannot use pre-initalized fixups for calls\n%s\n", buffer);
 				exit(1);
 			}
-			if (!strcmp (sect, "__ksymtab")) {
+			if (is_ksymtab(sect)) {
 				if (strncmp (buffer + mode+9, "32        ", 10)) {
 					fprintf(stderr, "BTFIXUP_CALL in EXPORT_SYMBOL results in relocation other than R_SPARC_32\n\%s\n", buffer);
 					exit(1);
@@ -346,6 +353,11 @@ main1:
 				printf ("__init_begin+0x%08lx", r->offset);
 			else if (!strcmp (r->sect, "__ksymtab"))
 				printf ("__start___ksymtab+0x%08lx", r->offset);
+			else if (is_ksymtab(r->sect)) {
+				fprintf(stderr, "BTFIXUP relocation in unmerged export section %s;\n"
+					"vmlinux must be linked with the __ksymtab output section\n", r->sect);
+				exit(1);
+			}
 			else if (!strcmp (r->sect, ".fixup"))
 				printf ("__start___fixup+0x%08lx", r->offset);
 			else
@@ -340,6 +340,8 @@
 #define __NR_inotify_init1	332
 #define __NR_preadv		333
 #define __NR_pwritev		334
+#define __NR_recvmmsg		337
+#define __NR_sendmmsg		345
 
 #ifdef __KERNEL__
 
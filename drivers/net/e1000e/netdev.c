@@ -4927,6 +4927,9 @@ static int __devinit e1000_probe(struct pci_dev *pdev,
 	if (pci_using_dac)
 		netdev->features |= NETIF_F_HIGHDMA;
 
+	/* Take receive buffers from the per-cpu skb recycle cache */
+	netdev->priv_flags |= IFF_SKB_RECYCLE;
+
 	if (e1000e_enable_mng_pass_thru(&adapter->hw))
 		adapter->flags |= FLAG_MNG_PT_ENABLED;
 
@@ -176,6 +176,9 @@ static int aio_setup_ring(struct kioctx *ctx)
 #define AIO_EVENTS_FIRST_PAGE	((PAGE_SIZE - sizeof(struct aio_ring)) / sizeof(struct io_event))
 #define AIO_EVENTS_OFFSET	(AIO_EVENTS_PER_PAGE - AIO_EVENTS_FIRST_PAGE)
 
+/* events reaped and copied to userspace at a time by io_getevents */
+#define AIO_EVENTS_BATCH	16
+
 #define aio_ring_event(info, nr, km) ({					\
 	unsigned pos = (nr) + AIO_EVENTS_OFFSET;			\
 	struct io_event *__event;					\
@@ -262,7 +265,6 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 
 	atomic_set(&ctx->users, 1);
 	spin_lock_init(&ctx->ctx_lock);
-	spin_lock_init(&ctx->ring_info.ring_lock);
 	init_waitqueue_head(&ctx->wait);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
@@ -750,7 +752,7 @@ static ssize_t aio_run_iocb(struct kiocb *iocb)
 	ret = retry(iocb);
 
 	if (ret != -EIOCBRETRY && ret != -EIOCBQUEUED) {
-		BUG_ON(!list_empty(&iocb->ki_wait.task_list));
+		BUG_ON(!list_empty(&iocb->ki_wait.wait.task_list));
 		aio_complete(iocb, ret, 0);
 	}
 out:
@@ -909,7 +911,7 @@ static void try_queue_kicked_iocb(struct kiocb *iocb)
 	 * than retry has happened before we could queue the iocb.  This also
 	 * means that the retry could have completed and freed our iocb, no
 	 * good. */
-	BUG_ON((!list_empty(&iocb->ki_wait.task_list)));
+	BUG_ON((!list_empty(&iocb->ki_wait.wait.task_list)));
 
 	spin_lock_irqsave(&ctx->ctx_lock, flags);
 	/* set this inside the lock so that we can't race with aio_run_iocb()
@@ -942,45 +944,20 @@ void kick_iocb(struct kiocb *iocb)
 }
 EXPORT_SYMBOL(kick_iocb);
 
-/* aio_complete
- *	Called when the io request on the given iocb is complete.
- *	Returns true if this is the last user of the request.  The 
- *	only other user of the request can be the cancellation code.
+/* __aio_complete_locked
+ *	Adds the completion event for iocb to the ring and drops the
+ *	i/o reference.  Called with ctx->ctx_lock held and the ring
+ *	header page mapped at ring.  Waking up ctx->wait is left to
+ *	the caller so that a batch of completions wakes it only once.
  */
-int aio_complete(struct kiocb *iocb, long res, long res2)
+static int __aio_complete_locked(struct kioctx *ctx, struct aio_ring *ring,
+				 struct kiocb *iocb, long res, long res2)
 {
-	struct kioctx	*ctx = iocb->ki_ctx;
-	struct aio_ring_info	*info;
-	struct aio_ring	*ring;
+	struct aio_ring_info	*info = &ctx->ring_info;
 	struct io_event	*event;
-	unsigned long	flags;
 	unsigned long	tail;
-	int		ret;
-
-	/*
-	 * Special case handling for sync iocbs:
-	 *  - events go directly into the iocb for fast handling
-	 *  - the sync task with the iocb in its stack holds the single iocb
-	 *    ref, no other paths have a way to get another ref
-	 *  - the sync task helpfully left a reference to itself in the iocb
-	 */
-	if (is_sync_kiocb(iocb)) {
-		BUG_ON(iocb->ki_users != 1);
-		iocb->ki_user_data = res;
-		iocb->ki_users = 0;
-		wake_up_process(iocb->ki_obj.tsk);
-		return 1;
-	}
-
-	info = &ctx->ring_info;
 
-	/* add a completion event to the ring buffer.
-	 * must be done holding ctx->ctx_lock to prevent
-	 * other code from messing with the tail
-	 * pointer since we might be called from irq
-	 * context.
-	 */
-	spin_lock_irqsave(&ctx->ctx_lock, flags);
+	assert_spin_locked(&ctx->ctx_lock);
 
 	if (iocb->ki_run_list.prev && !list_empty(&iocb->ki_run_list))
 		list_del_init(&iocb->ki_run_list);
@@ -992,8 +969,6 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 	if (kiocbIsCancelled(iocb))
 		goto put_rq;
 
-	ring = kmap_atomic(info->ring_pages[0], KM_IRQ1);
-
 	tail = info->tail;
 	event = aio_ring_event(info, tail, KM_IRQ0);
 	if (++tail >= info->nr)
@@ -1017,7 +992,6 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 	ring->tail = tail;
 
 	put_aio_ring_event(event, KM_IRQ0);
-	kunmap_atomic(ring, KM_IRQ1);
 
 	pr_debug("added to ring %p at [%lu]\n", iocb, tail);
 
@@ -1031,7 +1005,51 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 
 put_rq:
 	/* everything turned out well, dispose of the aiocb. */
-	ret = __aio_put_req(ctx, iocb);
+	return __aio_put_req(ctx, iocb);
+}
+
+/*
+ * Special case handling for sync iocbs:
+ *  - events go directly into the iocb for fast handling
+ *  - the sync task with the iocb in its stack holds the single iocb
+ *    ref, no other paths have a way to get another ref
+ *  - the sync task helpfully left a reference to itself in the iocb
+ */
+static int aio_complete_sync(struct kiocb *iocb, long res)
+{
+	BUG_ON(iocb->ki_users != 1);
+	iocb->ki_user_data = res;
+	iocb->ki_users = 0;
+	wake_up_process(iocb->ki_obj.tsk);
+	return 1;
+}
+
+/* aio_complete
+ *	Called when the io request on the given iocb is complete.
+ *	Returns true if this is the last user of the request.  The 
+ *	only other user of the request can be the cancellation code.
+ */
+int aio_complete(struct kiocb *iocb, long res, long res2)
+{
+	struct kioctx	*ctx = iocb->ki_ctx;
+	struct aio_ring	*ring;
+	unsigned long	flags;
+	int		ret;
+
+	if (is_sync_kiocb(iocb))
+		return aio_complete_sync(iocb, res);
+
+	/* add a completion event to the ring buffer.
+	 * must be done holding ctx->ctx_lock to prevent
+	 * other code from messing with the tail
+	 * pointer since we might be called from irq
+	 * context.
+	 */
+	spin_lock_irqsave(&ctx->ctx_lock, flags);
+
+	ring = kmap_atomic(ctx->ring_info.ring_pages[0], KM_IRQ1);
+	ret = __aio_complete_locked(ctx, ring, iocb, res, res2);
+	kunmap_atomic(ring, KM_IRQ1);
 
 	/*
 	 * We have to order our ring_info tail store above and test
@@ -1048,44 +1066,101 @@ put_rq:
 	return ret;
 }
 
-/* aio_read_evt
- *	Pull an event off of the ioctx's event ring.  Returns the number of 
- *	events fetched (0 or 1 ;-)
- *	FIXME: make this use cmpxchg.
- *	TODO: make the ringbuffer user mmap()able (requires FIXME).
+/* aio_complete_batch
+ *	Completes nr iocbs at once, for drivers that reap several
+ *	requests from one interrupt.  res2 may be NULL.  Consecutive
+ *	iocbs of the same ioctx are completed under a single ctx_lock
+ *	hold and ring mapping, with one wakeup of the waiters.  As with
+ *	aio_complete(), the caller must not touch the iocbs afterwards.
+ */
+void aio_complete_batch(struct kiocb **iocbs, long *res, long *res2, int nr)
+{
+	int i = 0;
+
+	while (i < nr) {
+		struct kioctx	*ctx = iocbs[i]->ki_ctx;
+		struct aio_ring	*ring;
+		unsigned long	flags;
+
+		if (is_sync_kiocb(iocbs[i])) {
+			aio_complete_sync(iocbs[i], res[i]);
+			i++;
+			continue;
+		}
+
+		spin_lock_irqsave(&ctx->ctx_lock, flags);
+		ring = kmap_atomic(ctx->ring_info.ring_pages[0], KM_IRQ1);
+		do {
+			__aio_complete_locked(ctx, ring, iocbs[i], res[i],
+					      res2 ? res2[i] : 0);
+			i++;
+		} while (i < nr && iocbs[i]->ki_ctx == ctx &&
+			 !is_sync_kiocb(iocbs[i]));
+		kunmap_atomic(ring, KM_IRQ1);
+
+		/* see aio_complete() */
+		smp_mb();
+
+		if (waitqueue_active(&ctx->wait))
+			wake_up(&ctx->wait);
+
+		spin_unlock_irqrestore(&ctx->ctx_lock, flags);
+	}
+}
+
+/* aio_read_evts
+ *	Pull up to nr events off of the ioctx's event ring into ents.
+ *	Returns the number of events fetched.
+ *
+ *	The ring is mapped into the owner's address space and userspace
+ *	may consume events itself (AIO_RING_COMPAT_USER_REAP), so the
+ *	head is claimed with cmpxchg rather than under a lock: events
+ *	are copied out first and only count as reaped if head did not
+ *	move meanwhile.  Copies are done a page-contiguous run at a time.
  */
-static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
+static int aio_read_evts(struct kioctx *ioctx, struct io_event *ents, int nr)
 {
 	struct aio_ring_info *info = &ioctx->ring_info;
 	struct aio_ring *ring;
-	unsigned long head;
-	int ret = 0;
+	unsigned old_head, head, tail;
+	int ret;
 
 	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
-	dprintk("in aio_read_evt h%lu t%lu m%lu\n",
+	dprintk("in aio_read_evts h%lu t%lu m%lu\n",
 		 (unsigned long)ring->head, (unsigned long)ring->tail,
 		 (unsigned long)ring->nr);
 
-	if (ring->head == ring->tail)
-		goto out;
-
-	spin_lock(&info->ring_lock);
-
-	head = ring->head % info->nr;
-	if (head != ring->tail) {
-		struct io_event *evp = aio_ring_event(info, head, KM_USER1);
-		*ent = *evp;
-		head = (head + 1) % info->nr;
-		smp_mb(); /* finish reading the event before updatng the head */
-		ring->head = head;
-		ret = 1;
-		put_aio_ring_event(evp, KM_USER1);
-	}
-	spin_unlock(&info->ring_lock);
+	do {
+		ret = 0;
+		old_head = ring->head;
+		tail = ring->tail;
+		smp_rmb(); /* read the tail before the events it covers */
+
+		head = old_head % info->nr;
+		tail %= info->nr;
+		while (head != tail && ret < nr) {
+			struct io_event *evp;
+			unsigned avail;
+
+			avail = (head < tail ? tail : info->nr) - head;
+			avail = min_t(unsigned, avail, nr - ret);
+			avail = min_t(unsigned, avail, AIO_EVENTS_PER_PAGE -
+				((head + AIO_EVENTS_OFFSET) % AIO_EVENTS_PER_PAGE));
+
+			evp = aio_ring_event(info, head, KM_USER1);
+			memcpy(ents + ret, evp, avail * sizeof(*evp));
+			put_aio_ring_event(evp, KM_USER1);
+
+			ret += avail;
+			head = (head + avail) % info->nr;
+		}
+		if (!ret)
+			break;
+		smp_mb(); /* finish reading the events before updating the head */
+	} while (cmpxchg(&ring->head, old_head, head) != old_head);
 
-out:
 	kunmap_atomic(ring, KM_USER0);
-	dprintk("leaving aio_read_evt: %d  h%lu t%lu\n", ret,
+	dprintk("leaving aio_read_evts: %d  h%lu t%lu\n", ret,
 		 (unsigned long)ring->head, (unsigned long)ring->tail);
 	return ret;
 }
@@ -1136,35 +1211,31 @@ static int read_events(struct kioctx *ctx,
 	DECLARE_WAITQUEUE(wait, tsk);
 	int			ret;
 	int			i = 0;
-	struct io_event		ent;
+	struct io_event		ents[AIO_EVENTS_BATCH];
 	struct aio_timeout	to;
 	int			retry = 0;
 
-	/* needed to zero any padding within an entry (there shouldn't be 
-	 * any, but C is fun!
-	 */
-	memset(&ent, 0, sizeof(ent));
 retry:
 	ret = 0;
 	while (likely(i < nr)) {
-		ret = aio_read_evt(ctx, &ent);
+		ret = aio_read_evts(ctx, ents,
+				    min_t(long, nr - i, AIO_EVENTS_BATCH));
 		if (unlikely(ret <= 0))
 			break;
 
-		dprintk("read event: %Lx %Lx %Lx %Lx\n",
-			ent.data, ent.obj, ent.res, ent.res2);
+		dprintk("read %d events: %Lx %Lx %Lx %Lx\n", ret,
+			ents[0].data, ents[0].obj, ents[0].res, ents[0].res2);
 
-		/* Could we split the check in two? */
-		ret = -EFAULT;
-		if (unlikely(copy_to_user(event, &ent, sizeof(ent)))) {
-			dprintk("aio: lost an event due to EFAULT.\n");
+		if (unlikely(copy_to_user(event, ents, ret * sizeof(*ents)))) {
+			dprintk("aio: lost %d events due to EFAULT.\n", ret);
+			ret = -EFAULT;
 			break;
 		}
-		ret = 0;
 
-		/* Good, event copied to userland, update counts. */
-		event ++;
-		i ++;
+		/* Good, events copied to userland, update counts. */
+		event += ret;
+		i += ret;
+		ret = 0;
 	}
 
 	if (min_nr <= i)
@@ -1195,7 +1266,8 @@ retry:
 		add_wait_queue_exclusive(&ctx->wait, &wait);
 		do {
 			set_task_state(tsk, TASK_INTERRUPTIBLE);
-			ret = aio_read_evt(ctx, &ent);
+			ret = aio_read_evts(ctx, ents,
+					min_t(long, nr - i, AIO_EVENTS_BATCH));
 			if (ret)
 				break;
 			if (min_nr <= i)
@@ -1216,7 +1288,6 @@ retry:
 				ret = -EINTR;
 				break;
 			}
-			/*ret = aio_read_evt(ctx, &ent);*/
 		} while (1) ;
 
 		set_task_state(tsk, TASK_RUNNING);
@@ -1225,15 +1296,15 @@ retry:
 		if (unlikely(ret <= 0))
 			break;
 
-		ret = -EFAULT;
-		if (unlikely(copy_to_user(event, &ent, sizeof(ent)))) {
-			dprintk("aio: lost an event due to EFAULT.\n");
+		if (unlikely(copy_to_user(event, ents, ret * sizeof(*ents)))) {
+			dprintk("aio: lost %d events due to EFAULT.\n", ret);
+			ret = -EFAULT;
 			break;
 		}
 
-		/* Good, event copied to userland, update counts. */
-		event ++;
-		i ++;
+		/* Good, events copied to userland, update counts. */
+		event += ret;
+		i += ret;
 	}
 
 	if (timeout)
@@ -1571,11 +1642,26 @@ static ssize_t aio_setup_iocb(struct kiocb *kiocb)
  * the ioctx lock inside the wait queue lock. This is safe
  * because this callback isn't used for wait queues which
  * are nested inside ioctx lock (i.e. ctx->wait)
+ *
+ * When the kiocb waits on a page bit (lock_page_async), the
+ * page wait queues are hashed and shared, so wakeups for
+ * other pages or bits are filtered out as in wake_bit_function.
  */
 static int aio_wake_function(wait_queue_t *wait, unsigned mode,
 			     int sync, void *key)
 {
-	struct kiocb *iocb = container_of(wait, struct kiocb, ki_wait);
+	struct wait_bit_queue *wait_bit
+		= container_of(wait, struct wait_bit_queue, wait);
+	struct kiocb *iocb = container_of(wait_bit, struct kiocb, ki_wait);
+
+	if (wait_bit->key.flags) {
+		struct wait_bit_key *bit_key = key;
+
+		if (!bit_key || wait_bit->key.flags != bit_key->flags ||
+				wait_bit->key.bit_nr != bit_key->bit_nr ||
+				test_bit(bit_key->bit_nr, bit_key->flags))
+			return 0;
+	}
 
 	list_del_init(&wait->task_list);
 	kick_iocb(iocb);
@@ -1643,8 +1729,9 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	req->ki_buf = (char __user *)(unsigned long)iocb->aio_buf;
 	req->ki_left = req->ki_nbytes = iocb->aio_nbytes;
 	req->ki_opcode = iocb->aio_lio_opcode;
-	init_waitqueue_func_entry(&req->ki_wait, aio_wake_function);
-	INIT_LIST_HEAD(&req->ki_wait.task_list);
+	init_waitqueue_func_entry(&req->ki_wait.wait, aio_wake_function);
+	INIT_LIST_HEAD(&req->ki_wait.wait.task_list);
+	req->ki_wait.key.flags = NULL;
 
 	ret = aio_setup_iocb(req);
 
@@ -1839,5 +1926,6 @@ SYSCALL_DEFINE5(io_getevents, aio_context_t, ctx_id,
 __initcall(aio_setup);
 
 EXPORT_SYMBOL(aio_complete);
+EXPORT_SYMBOL(aio_complete_batch);
 EXPORT_SYMBOL(aio_put_req);
 EXPORT_SYMBOL(wait_on_sync_kiocb);
@@ -20,6 +20,9 @@
 #include <linux/list.h>
 #include <linux/spinlock.h>
 #include <linux/freezer.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/topology.h>
 #include "async-thread.h"
 
 #define WORK_QUEUED_BIT 0
@@ -58,8 +61,22 @@ struct btrfs_worker_thread {
 
 	/* are we currently idle */
 	int idle;
+
+	/* NUMA node we're bound to, or -1 */
+	int node;
+
+	/* stats, protected by lock above */
+	u64 nr_run;
+	u64 nr_stolen;
+	u64 wait_total;
+	u64 wait_max;
 };
 
+static inline u64 btrfs_work_clock(void)
+{
+	return ktime_to_ns(ktime_get());
+}
+
 /*
  * helper function to move a thread onto the idle list after it
  * has finished some requests.
@@ -103,7 +120,7 @@ static noinline int run_ordered_completions(struct btrfs_workers *workers,
 
 	set_bit(WORK_DONE_BIT, &work->flags);
 
-	spin_lock_irqsave(&workers->lock, flags);
+	spin_lock_irqsave(&workers->order_lock, flags);
 
 	while (1) {
 		if (!list_empty(&workers->prio_order_list)) {
@@ -126,20 +143,75 @@ static noinline int run_ordered_completions(struct btrfs_workers *workers,
 		if (test_and_set_bit(WORK_ORDER_DONE_BIT, &work->flags))
 			break;
 
-		spin_unlock_irqrestore(&workers->lock, flags);
+		spin_unlock_irqrestore(&workers->order_lock, flags);
 
 		work->ordered_func(work);
 
 		/* now take the lock again and call the freeing code */
-		spin_lock_irqsave(&workers->lock, flags);
+		spin_lock_irqsave(&workers->order_lock, flags);
 		list_del(&work->order_list);
 		work->ordered_free(work);
 	}
 
-	spin_unlock_irqrestore(&workers->lock, flags);
+	spin_unlock_irqrestore(&workers->order_lock, flags);
 	return 0;
 }
 
+/*
+ * called by a worker that has run out of things to do.  Look for a busy
+ * sibling with more than one item queued and take the newest one.  The
+ * oldest is left alone, its owner is probably just about to run it.
+ *
+ * Returns 1 if something was moved onto our pending list.
+ */
+static int steal_work(struct btrfs_worker_thread *worker)
+{
+	struct btrfs_workers *workers = worker->workers;
+	struct btrfs_worker_thread *victim;
+	struct btrfs_work *work = NULL;
+	unsigned long flags;
+
+	if (!workers->steal)
+		return 0;
+
+	spin_lock_irqsave(&workers->lock, flags);
+	list_for_each_entry(victim, &workers->worker_list, worker_list) {
+		if (victim == worker ||
+		    atomic_read(&victim->num_pending) < 2)
+			continue;
+		if (workers->numa_local && victim->node != worker->node)
+			continue;
+
+		/*
+		 * the victim takes its own lock before the pool lock,
+		 * so we can only trylock here
+		 */
+		if (!spin_trylock(&victim->lock))
+			continue;
+		if (!list_empty(&victim->pending) &&
+		    victim->pending.next != victim->pending.prev) {
+			work = list_entry(victim->pending.prev,
+					  struct btrfs_work, list);
+			list_del(&work->list);
+			atomic_dec(&victim->num_pending);
+		}
+		spin_unlock(&victim->lock);
+		if (work)
+			break;
+	}
+	spin_unlock_irqrestore(&workers->lock, flags);
+
+	if (!work)
+		return 0;
+
+	spin_lock_irqsave(&worker->lock, flags);
+	list_add_tail(&work->list, &worker->pending);
+	atomic_inc(&worker->num_pending);
+	worker->nr_stolen++;
+	spin_unlock_irqrestore(&worker->lock, flags);
+	return 1;
+}
+
 /*
  * main loop for servicing work items
  */
@@ -148,6 +220,8 @@ static int worker_loop(void *arg)
 	struct btrfs_worker_thread *worker = arg;
 	struct list_head *cur;
 	struct btrfs_work *work;
+	u64 wait;
+
 	do {
 		spin_lock_irq(&worker->lock);
 again_locked:
@@ -163,6 +237,12 @@ again_locked:
 			list_del(&work->list);
 			clear_bit(WORK_QUEUED_BIT, &work->flags);
 
+			wait = btrfs_work_clock() - work->queue_start;
+			worker->nr_run++;
+			worker->wait_total += wait;
+			if (wait > worker->wait_max)
+				worker->wait_max = wait;
+
 			work->worker = worker;
 			spin_unlock_irq(&worker->lock);
 
@@ -212,6 +292,10 @@ again_locked:
 				if (kthread_should_stop())
 					break;
 
+				/* maybe one of our siblings is swamped */
+				if (steal_work(worker))
+					continue;
+
 				/* still no more work?, sleep for real */
 				spin_lock_irq(&worker->lock);
 				set_current_state(TASK_INTERRUPTIBLE);
@@ -243,15 +327,29 @@ int btrfs_stop_workers(struct btrfs_workers *workers)
 	struct list_head *cur;
 	struct btrfs_worker_thread *worker;
 
+	/*
+	 * the other workers may still be walking the lists looking for
+	 * work to steal, so unlink each one under the pool lock
+	 */
+	spin_lock_irq(&workers->lock);
 	list_splice_init(&workers->idle_list, &workers->worker_list);
 	while (!list_empty(&workers->worker_list)) {
 		cur = workers->worker_list.next;
 		worker = list_entry(cur, struct btrfs_worker_thread,
 				    worker_list);
+		spin_unlock_irq(&workers->lock);
+
 		kthread_stop(worker->task);
+
+		spin_lock_irq(&workers->lock);
 		list_del(&worker->worker_list);
+		workers->num_workers--;
 		kfree(worker);
 	}
+	spin_unlock_irq(&workers->lock);
+
+	kfree(workers->cpu_worker);
+	workers->cpu_worker = NULL;
 	return 0;
 }
 
@@ -266,10 +364,46 @@ void btrfs_init_workers(struct btrfs_workers *workers, char *name, int max)
 	INIT_LIST_HEAD(&workers->order_list);
 	INIT_LIST_HEAD(&workers->prio_order_list);
 	spin_lock_init(&workers->lock);
+	spin_lock_init(&workers->order_lock);
 	workers->max_workers = max;
 	workers->idle_thresh = 32;
 	workers->name = name;
 	workers->ordered = 0;
+	workers->steal = 1;
+	workers->numa_local = 0;
+	workers->last_node = -1;
+	workers->cpu_worker = kcalloc(nr_cpu_ids, sizeof(*workers->cpu_worker),
+				      GFP_NOFS);
+}
+
+/*
+ * pick the node for a new NUMA local worker, round robin over the
+ * nodes that have cpus.  Returns -1 if there is nothing to pick from.
+ */
+static int next_worker_node(struct btrfs_workers *workers)
+{
+	int node;
+	int i;
+
+	if (!workers->numa_local || num_online_nodes() < 2)
+		return -1;
+
+	spin_lock_irq(&workers->lock);
+	node = workers->last_node;
+	for (i = 0; i < MAX_NUMNODES; i++) {
+		if (node < 0)
+			node = first_online_node;
+		else
+			node = next_online_node(node);
+		if (node >= MAX_NUMNODES)
+			node = first_online_node;
+		if (nr_cpus_node(node))
+			break;
+	}
+	workers->last_node = node;
+	spin_unlock_irq(&workers->lock);
+
+	return nr_cpus_node(node) ? node : -1;
 }
 
 /*
@@ -294,15 +428,20 @@ int btrfs_start_workers(struct btrfs_workers *workers, int num_workers)
 		INIT_LIST_HEAD(&worker->worker_list);
 		spin_lock_init(&worker->lock);
 		atomic_set(&worker->num_pending, 0);
-		worker->task = kthread_run(worker_loop, worker,
-					   "btrfs-%s-%d", workers->name,
-					   workers->num_workers + i);
 		worker->workers = workers;
+		worker->node = next_worker_node(workers);
+		worker->task = kthread_create(worker_loop, worker,
+					      "btrfs-%s-%d", workers->name,
+					      workers->num_workers + i);
 		if (IS_ERR(worker->task)) {
-			kfree(worker);
 			ret = PTR_ERR(worker->task);
+			kfree(worker);
 			goto fail;
 		}
+		if (worker->node >= 0)
+			set_cpus_allowed_ptr(worker->task,
+					     cpumask_of_node(worker->node));
+		wake_up_process(worker->task);
 
 		spin_lock_irq(&workers->lock);
 		list_add_tail(&worker->worker_list, &workers->idle_list);
@@ -334,6 +473,15 @@ static struct btrfs_worker_thread *next_worker(struct btrfs_workers *workers)
 	 * working
 	 */
 	if (!list_empty(&workers->idle_list)) {
+		if (workers->numa_local) {
+			int node = numa_node_id();
+
+			list_for_each_entry(worker, &workers->idle_list,
+					    worker_list) {
+				if (worker->node == node)
+					return worker;
+			}
+		}
 		next = workers->idle_list.next;
 		worker = list_entry(next, struct btrfs_worker_thread,
 				    worker_list);
@@ -367,6 +515,18 @@ static struct btrfs_worker_thread *find_worker(struct btrfs_workers *workers)
 {
 	struct btrfs_worker_thread *worker;
 	unsigned long flags;
+	int cpu = raw_smp_processor_id();
+
+	/*
+	 * keep feeding the worker this cpu used last as long as it is
+	 * idle.  The idle flag is only a hint here, the worker's own lock
+	 * protects the queue itself.
+	 */
+	if (workers->cpu_worker) {
+		worker = workers->cpu_worker[cpu];
+		if (worker && worker->idle)
+			return worker;
+	}
 
 again:
 	spin_lock_irqsave(&workers->lock, flags);
@@ -396,6 +556,8 @@ again:
 			goto again;
 		}
 	}
+	if (workers->cpu_worker)
+		workers->cpu_worker[cpu] = worker;
 	return worker;
 }
 
@@ -414,6 +576,7 @@ int btrfs_requeue_work(struct btrfs_work *work)
 		goto out;
 
 	spin_lock_irqsave(&worker->lock, flags);
+	work->queue_start = btrfs_work_clock();
 	if (test_bit(WORK_HIGH_PRIO_BIT, &work->flags))
 		list_add_tail(&work->list, &worker->prio_pending);
 	else
@@ -463,19 +626,20 @@ int btrfs_queue_worker(struct btrfs_workers *workers, struct btrfs_work *work)
 
 	worker = find_worker(workers);
 	if (workers->ordered) {
-		spin_lock_irqsave(&workers->lock, flags);
+		spin_lock_irqsave(&workers->order_lock, flags);
 		if (test_bit(WORK_HIGH_PRIO_BIT, &work->flags)) {
 			list_add_tail(&work->order_list,
 				      &workers->prio_order_list);
 		} else {
 			list_add_tail(&work->order_list, &workers->order_list);
 		}
-		spin_unlock_irqrestore(&workers->lock, flags);
+		spin_unlock_irqrestore(&workers->order_lock, flags);
 	} else {
 		INIT_LIST_HEAD(&work->order_list);
 	}
 
 	spin_lock_irqsave(&worker->lock, flags);
+	work->queue_start = btrfs_work_clock();
 
 	if (test_bit(WORK_HIGH_PRIO_BIT, &work->flags))
 		list_add_tail(&work->list, &worker->prio_pending);
@@ -499,3 +663,32 @@ int btrfs_queue_worker(struct btrfs_workers *workers, struct btrfs_work *work)
 out:
 	return 0;
 }
+
+/*
+ * add up the per thread counters for a pool.  The numbers are read
+ * without the per thread locks, they are only for reporting.
+ */
+void btrfs_workers_stats(struct btrfs_workers *workers,
+			 struct btrfs_workers_stats *stats)
+{
+	struct btrfs_worker_thread *worker;
+	struct list_head *lists[] = { &workers->worker_list,
+				      &workers->idle_list };
+	unsigned long flags;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	spin_lock_irqsave(&workers->lock, flags);
+	stats->num_workers = workers->num_workers;
+	for (i = 0; i < ARRAY_SIZE(lists); i++) {
+		list_for_each_entry(worker, lists[i], worker_list) {
+			stats->nr_run += worker->nr_run;
+			stats->nr_stolen += worker->nr_stolen;
+			stats->wait_total += worker->wait_total;
+			if (worker->wait_max > stats->wait_max)
+				stats->wait_max = worker->wait_max;
+		}
+	}
+	spin_unlock_irqrestore(&workers->lock, flags);
+}
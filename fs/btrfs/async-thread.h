@@ -34,6 +34,11 @@ struct btrfs_worker_thread;
  * the basic model of these worker threads is to embed a btrfs_work
  * structure in your own data struct, and use container_of in a
  * work function to get back to your data struct.
+ *
+ * Each cpu remembers the worker it queued to last and keeps using it
+ * while that worker is idle, so most submissions never touch the pool
+ * lock.  Workers that run out of things to do steal queued work from
+ * busy siblings before going to sleep.
  */
 struct btrfs_work {
 	/*
@@ -58,6 +63,9 @@ struct btrfs_work {
 	struct btrfs_worker_thread *worker;
 	struct list_head list;
 	struct list_head order_list;
+
+	/* when the work was queued, in ns.  Used for the latency stats */
+	u64 queue_start;
 };
 
 struct btrfs_workers {
@@ -73,6 +81,23 @@ struct btrfs_workers {
 	/* force completions in the order they were queued */
 	int ordered;
 
+	/*
+	 * idle workers take queued work from busy ones.  Turn this off
+	 * for pools where the order things run in on a given worker
+	 * matters.
+	 */
+	int steal;
+
+	/*
+	 * spread the workers over the NUMA nodes, bind each one to the cpus
+	 * of its node and prefer a worker on the submitter's node.  This is
+	 * for work that touches the pages it was handed, like checksumming.
+	 */
+	int numa_local;
+
+	/* the node the last NUMA local worker was started on */
+	int last_node;
+
 	/* list with all the work threads.  The workers on the idle thread
 	 * may be actively servicing jobs, but they haven't yet hit the
 	 * idle thresh limit above.
@@ -90,14 +115,34 @@ struct btrfs_workers {
 	/* lock for finding the next worker thread to queue on */
 	spinlock_t lock;
 
+	/* protects order_list and prio_order_list */
+	spinlock_t order_lock;
+
+	/*
+	 * the worker each cpu queued to last, indexed by cpu.  May be
+	 * NULL if the allocation failed, this is only a hint.
+	 */
+	struct btrfs_worker_thread **cpu_worker;
+
 	/* extra name for this worker, used for current->name */
 	char *name;
 };
 
+/* totals over all the threads in a pool, see btrfs_workers_stats */
+struct btrfs_workers_stats {
+	int num_workers;
+	u64 nr_run;
+	u64 nr_stolen;
+	u64 wait_total;	/* ns between queueing and running, summed */
+	u64 wait_max;	/* ns, worst case seen */
+};
+
 int btrfs_queue_worker(struct btrfs_workers *workers, struct btrfs_work *work);
 int btrfs_start_workers(struct btrfs_workers *workers, int num_workers);
 int btrfs_stop_workers(struct btrfs_workers *workers);
 void btrfs_init_workers(struct btrfs_workers *workers, char *name, int max);
 int btrfs_requeue_work(struct btrfs_work *work);
 void btrfs_set_work_high_prio(struct btrfs_work *work);
+void btrfs_workers_stats(struct btrfs_workers *workers,
+			 struct btrfs_workers_stats *stats);
 #endif
@@ -357,7 +357,13 @@ struct btrfs_super_block {
  */
 #define BTRFS_FEATURE_COMPAT_SUPP	0x0
 #define BTRFS_FEATURE_COMPAT_RO_SUPP	0x0
-#define BTRFS_FEATURE_INCOMPAT_SUPP	0x0
+#define BTRFS_FEATURE_INCOMPAT_SUPP	BTRFS_FEATURE_INCOMPAT_COMPRESS_LZO
+
+/*
+ * set once any extent may have been written with LZO; this is the bit
+ * mainline uses, bits 0-2 belong to features this tree does not have
+ */
+#define BTRFS_FEATURE_INCOMPAT_COMPRESS_LZO	(1ULL << 3)
 
 /*
  * A leaf is full of items. offset and size tell us where to find
@@ -464,9 +470,12 @@ struct btrfs_timespec {
 enum btrfs_compression_type {
 	BTRFS_COMPRESS_NONE = 0,
 	BTRFS_COMPRESS_ZLIB = 1,
-	BTRFS_COMPRESS_LAST = 2,
+	BTRFS_COMPRESS_LZO = 2,
+	BTRFS_COMPRESS_LAST = 3,
 };
 
+#define BTRFS_COMPRESS_TYPES	(BTRFS_COMPRESS_LAST - 1)
+
 struct btrfs_inode_item {
 	/* nfs style generation number */
 	__le64 generation;
@@ -736,6 +745,7 @@ struct btrfs_fs_info {
 	u64 last_trans_log_full_commit;
 	u64 open_ioctl_trans;
 	unsigned long mount_opt;
+	int compress_type;
 	u64 max_extent;
 	u64 max_inline;
 	u64 alloc_start;
@@ -838,6 +848,7 @@ struct btrfs_fs_info {
 
 	struct kobject super_kobj;
 	struct completion kobj_unregister;
+	struct dentry *debugfs_dir;
 	int do_barriers;
 	int closing;
 	int log_root_recovering;
@@ -2191,6 +2202,8 @@ int btrfs_sysfs_add_super(struct btrfs_fs_info *fs);
 int btrfs_sysfs_add_root(struct btrfs_root *root);
 void btrfs_sysfs_del_root(struct btrfs_root *root);
 void btrfs_sysfs_del_super(struct btrfs_fs_info *root);
+void btrfs_debugfs_add_super(struct btrfs_fs_info *fs);
+void btrfs_debugfs_del_super(struct btrfs_fs_info *fs);
 
 /* xattr.c */
 ssize_t btrfs_listxattr(struct dentry *dentry, char *buffer, size_t size);
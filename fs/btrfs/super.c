@@ -67,8 +67,8 @@ static void btrfs_put_super(struct super_block *sb)
 enum {
 	Opt_degraded, Opt_subvol, Opt_device, Opt_nodatasum, Opt_nodatacow,
 	Opt_max_extent, Opt_max_inline, Opt_alloc_start, Opt_nobarrier,
-	Opt_ssd, Opt_thread_pool, Opt_noacl,  Opt_compress, Opt_notreelog,
-	Opt_flushoncommit, Opt_err,
+	Opt_ssd, Opt_thread_pool, Opt_noacl,  Opt_compress, Opt_compress_type,
+	Opt_notreelog, Opt_flushoncommit, Opt_err,
 };
 
 static match_table_t tokens = {
@@ -83,6 +83,7 @@ static match_table_t tokens = {
 	{Opt_alloc_start, "alloc_start=%s"},
 	{Opt_thread_pool, "thread_pool=%d"},
 	{Opt_compress, "compress"},
+	{Opt_compress_type, "compress=%s"},
 	{Opt_ssd, "ssd"},
 	{Opt_noacl, "noacl"},
 	{Opt_notreelog, "notreelog"},
@@ -125,6 +126,7 @@ int btrfs_parse_options(struct btrfs_root *root, char *options)
 	substring_t args[MAX_OPT_ARGS];
 	char *p, *num;
 	int intarg;
+	int ret = 0;
 
 	if (!options)
 		return 0;
@@ -166,7 +168,33 @@ int btrfs_parse_options(struct btrfs_root *root, char *options)
 			btrfs_set_opt(info->mount_opt, NODATASUM);
 			break;
 		case Opt_compress:
-			printk(KERN_INFO "btrfs: use compression\n");
+		case Opt_compress_type:
+			num = NULL;
+			if (token == Opt_compress_type) {
+				num = match_strdup(&args[0]);
+				if (!num) {
+					ret = -ENOMEM;
+					goto out;
+				}
+			}
+			if (!num || strcmp(num, "zlib") == 0) {
+				info->compress_type = BTRFS_COMPRESS_ZLIB;
+			} else if (strcmp(num, "lzo") == 0) {
+				info->compress_type = BTRFS_COMPRESS_LZO;
+				btrfs_set_super_incompat_flags(&info->super_copy,
+				    btrfs_super_incompat_flags(&info->super_copy) |
+				    BTRFS_FEATURE_INCOMPAT_COMPRESS_LZO);
+			} else {
+				printk(KERN_ERR "btrfs: unknown compression "
+				       "type %s\n", num);
+				kfree(num);
+				ret = -EINVAL;
+				goto out;
+			}
+			kfree(num);
+			printk(KERN_INFO "btrfs: use %s compression\n",
+			       info->compress_type == BTRFS_COMPRESS_LZO ?
+			       "lzo" : "zlib");
 			btrfs_set_opt(info->mount_opt, COMPRESS);
 			break;
 		case Opt_ssd:
@@ -238,8 +266,9 @@ int btrfs_parse_options(struct btrfs_root *root, char *options)
 			break;
 		}
 	}
+out:
 	kfree(options);
-	return 0;
+	return ret;
 }
 
 /*
@@ -361,6 +390,7 @@ static int btrfs_fill_super(struct super_block *sb,
 	if (err)
 		goto fail_close;
 #endif
+	btrfs_debugfs_add_super(tree_root->fs_info);
 
 	sb->s_root = root_dentry;
 
@@ -418,8 +448,12 @@ static int btrfs_show_options(struct seq_file *seq, struct vfsmount *vfs)
 	if (info->thread_pool_size !=  min_t(unsigned long,
 					     num_online_cpus() + 2, 8))
 		seq_printf(seq, ",thread_pool=%d", info->thread_pool_size);
-	if (btrfs_test_opt(root, COMPRESS))
-		seq_puts(seq, ",compress");
+	if (btrfs_test_opt(root, COMPRESS)) {
+		if (info->compress_type == BTRFS_COMPRESS_LZO)
+			seq_puts(seq, ",compress=lzo");
+		else
+			seq_puts(seq, ",compress");
+	}
 	if (btrfs_test_opt(root, SSD))
 		seq_puts(seq, ",ssd");
 	if (btrfs_test_opt(root, NOTREELOG))
@@ -713,10 +747,14 @@ static int __init init_btrfs_fs(void)
 	if (err)
 		return err;
 
-	err = btrfs_init_cachep();
+	err = btrfs_init_compress();
 	if (err)
 		goto free_sysfs;
 
+	err = btrfs_init_cachep();
+	if (err)
+		goto free_compress;
+
 	err = extent_io_init();
 	if (err)
 		goto free_cachep;
@@ -744,6 +782,8 @@ free_extent_io:
 	extent_io_exit();
 free_cachep:
 	btrfs_destroy_cachep();
+free_compress:
+	btrfs_exit_compress();
 free_sysfs:
 	btrfs_exit_sysfs();
 	return err;
@@ -758,7 +798,7 @@ static void __exit exit_btrfs_fs(void)
 	unregister_filesystem(&btrfs_fs_type);
 	btrfs_exit_sysfs();
 	btrfs_cleanup_fs_uuids();
-	btrfs_zlib_exit();
+	btrfs_exit_compress();
 }
 
 module_init(init_btrfs_fs)
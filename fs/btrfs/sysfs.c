@@ -23,6 +23,8 @@
 #include <linux/buffer_head.h>
 #include <linux/module.h>
 #include <linux/kobject.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "ctree.h"
 #include "disk-io.h"
@@ -59,6 +61,51 @@ static ssize_t super_blocksize_show(struct btrfs_fs_info *fs, char *buf)
 		(unsigned long long)btrfs_super_sectorsize(&fs->super_copy));
 }
 
+static int worker_stats_show(struct seq_file *m, void *v)
+{
+	struct btrfs_fs_info *fs = m->private;
+	struct btrfs_workers *pools[] = {
+		&fs->workers, &fs->delalloc_workers, &fs->submit_workers,
+		&fs->fixup_workers, &fs->endio_workers,
+		&fs->endio_meta_workers, &fs->endio_meta_write_workers,
+		&fs->endio_write_workers,
+	};
+	struct btrfs_workers_stats stats;
+	u64 avg;
+	int i;
+
+	seq_printf(m, "%-18s %7s %12s %10s %10s %10s\n",
+		   "pool", "threads", "run", "stolen", "avg_us", "max_us");
+	for (i = 0; i < ARRAY_SIZE(pools); i++) {
+		btrfs_workers_stats(pools[i], &stats);
+		avg = stats.wait_total;
+		if (stats.nr_run)
+			do_div(avg, stats.nr_run);
+		do_div(avg, NSEC_PER_USEC);
+		do_div(stats.wait_max, NSEC_PER_USEC);
+		seq_printf(m, "%-18s %7d %12llu %10llu %10llu %10llu\n",
+			   pools[i]->name, stats.num_workers,
+			   (unsigned long long)stats.nr_run,
+			   (unsigned long long)stats.nr_stolen,
+			   (unsigned long long)avg,
+			   (unsigned long long)stats.wait_max);
+	}
+	return 0;
+}
+
+static int worker_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, worker_stats_show, inode->i_private);
+}
+
+static const struct file_operations worker_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= worker_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 /* this is for root attrs (subvols/snapshots) */
 struct btrfs_root_attr {
 	struct attribute attr;
@@ -189,27 +236,34 @@ static struct kobj_type btrfs_super_ktype = {
 /* /sys/fs/btrfs/ entry */
 static struct kset *btrfs_kset;
 
+/* <debugfs>/btrfs/ entry */
+static struct dentry *btrfs_debugfs_root;
+
+static void btrfs_super_name(struct btrfs_fs_info *fs, char *name, int len)
+{
+	char c;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		c = fs->sb->s_id[i];
+		if (c == '/' || c == '\\')
+			c = '!';
+		name[i] = c;
+	}
+}
+
 int btrfs_sysfs_add_super(struct btrfs_fs_info *fs)
 {
 	int error;
 	char *name;
-	char c;
 	int len = strlen(fs->sb->s_id) + 1;
-	int i;
 
 	name = kmalloc(len, GFP_NOFS);
 	if (!name) {
 		error = -ENOMEM;
 		goto fail;
 	}
-
-	for (i = 0; i < len; i++) {
-		c = fs->sb->s_id[i];
-		if (c == '/' || c == '\\')
-			c = '!';
-		name[i] = c;
-	}
-	name[len] = '\0';
+	btrfs_super_name(fs, name, len);
 
 	fs->super_kobj.kset = btrfs_kset;
 	error = kobject_init_and_add(&fs->super_kobj, &btrfs_super_ktype,
@@ -254,16 +308,52 @@ void btrfs_sysfs_del_super(struct btrfs_fs_info *fs)
 	wait_for_completion(&fs->kobj_unregister);
 }
 
+/*
+ * <debugfs>/btrfs/<dev>/worker_stats: per-pool async worker counters.
+ * Failure is not fatal, the filesystem works without it.
+ */
+void btrfs_debugfs_add_super(struct btrfs_fs_info *fs)
+{
+	char name[sizeof(fs->sb->s_id)];
+	struct dentry *dir;
+
+	if (!btrfs_debugfs_root)
+		return;
+
+	btrfs_super_name(fs, name, sizeof(name));
+	dir = debugfs_create_dir(name, btrfs_debugfs_root);
+	if (!dir || IS_ERR(dir))
+		return;
+
+	if (!debugfs_create_file("worker_stats", 0444, dir, fs,
+				 &worker_stats_fops)) {
+		debugfs_remove(dir);
+		return;
+	}
+	fs->debugfs_dir = dir;
+}
+
+void btrfs_debugfs_del_super(struct btrfs_fs_info *fs)
+{
+	debugfs_remove_recursive(fs->debugfs_dir);
+	fs->debugfs_dir = NULL;
+}
+
 int btrfs_init_sysfs(void)
 {
 	btrfs_kset = kset_create_and_add("btrfs", NULL, fs_kobj);
 	if (!btrfs_kset)
 		return -ENOMEM;
+
+	btrfs_debugfs_root = debugfs_create_dir("btrfs", NULL);
+	if (IS_ERR(btrfs_debugfs_root))
+		btrfs_debugfs_root = NULL;
 	return 0;
 }
 
 void btrfs_exit_sysfs(void)
 {
+	debugfs_remove(btrfs_debugfs_root);
 	kset_unregister(btrfs_kset);
 }
 
@@ -26,6 +26,7 @@
 #include <linux/fs.h>
 #include <linux/sched.h>
 #include <linux/writeback.h>
+#include <linux/blkdev.h>
 #include <linux/jbd.h>
 #include <linux/ext3_fs.h>
 #include <linux/ext3_jbd.h>
@@ -38,26 +39,34 @@
  * Another task could have dirtied this inode.  Its data can be in any
  * state in the journalling system.
  *
- * What we do is just kick off a commit and wait on it.  This will snapshot the
- * inode to disk.
+ * What we do is wait for the commit of the last transaction which
+ * modified the inode's metadata, kicking it off if necessary.  This
+ * will snapshot the inode to disk.  If that transaction has already
+ * committed, only the file data needs to reach the disk and no commit
+ * is started at all, so fsync of an overwritten file does not flush
+ * the metadata and ordered data of every other file on the filesystem.
  */
 
 int ext3_sync_file(struct file * file, struct dentry *dentry, int datasync)
 {
 	struct inode *inode = dentry->d_inode;
+	struct ext3_inode_info *ei = EXT3_I(inode);
+	journal_t *journal = EXT3_SB(inode->i_sb)->s_journal;
+	tid_t commit_tid;
 	int ret = 0;
 
 	J_ASSERT(ext3_journal_current_handle() == NULL);
 
+	if (inode->i_sb->s_flags & MS_RDONLY)
+		return 0;
+
 	/*
-	 * data=writeback:
+	 * data=writeback,ordered:
 	 *  The caller's filemap_fdatawrite()/wait will sync the data.
-	 *  sync_inode() will sync the metadata
-	 *
-	 * data=ordered:
-	 *  The caller's filemap_fdatawrite() will write the data and
-	 *  sync_inode() will write the inode if it is dirty.  Then the caller's
-	 *  filemap_fdatawait() will wait on the pages.
+	 *  Metadata is in the journal, we wait for the transaction which
+	 *  last changed it to commit here.  fdatasync does not need the
+	 *  timestamps, so it waits only for the last change of the block
+	 *  map or size.
 	 *
 	 * data=journal:
 	 *  filemap_fdatawrite won't do anything (the buffers are clean).
@@ -67,25 +76,29 @@ int ext3_sync_file(struct file * file, struct dentry *dentry, int datasync)
 	 *  (they were dirtied by commit).  But that's OK - the blocks are
 	 *  safe in-journal, which is all fsync() needs to ensure.
 	 */
-	if (ext3_should_journal_data(inode)) {
-		ret = ext3_force_commit(inode->i_sb);
-		goto out;
-	}
+	if (ext3_should_journal_data(inode))
+		return ext3_force_commit(inode->i_sb);
 
-	if (datasync && !(inode->i_state & I_DIRTY_DATASYNC))
+	if (datasync)
+		commit_tid = atomic_read(&ei->i_datasync_tid);
+	else
+		commit_tid = atomic_read(&ei->i_sync_tid);
+
+	if (log_start_commit(journal, commit_tid) ||
+	    !tid_geq(journal->j_commit_sequence, commit_tid)) {
+		/* The commit writes a barrier after the ordered data */
+		ret = log_wait_commit(journal, commit_tid);
 		goto out;
+	}
 
 	/*
-	 * The VFS has written the file data.  If the inode is unaltered
-	 * then we need not start a commit.
+	 * No commit was needed, so nothing else flushes the disk cache.
+	 * The caller has only started writeback of the data, wait for it
+	 * before the flush.
 	 */
-	if (inode->i_state & (I_DIRTY_SYNC|I_DIRTY_DATASYNC)) {
-		struct writeback_control wbc = {
-			.sync_mode = WB_SYNC_ALL,
-			.nr_to_write = 0, /* sys_fsync did this */
-		};
-		ret = sync_inode(inode, &wbc);
-	}
+	ret = filemap_fdatawait(inode->i_mapping);
+	if (!ret && test_opt(inode->i_sb, BARRIER))
+		blkdev_issue_flush(inode->i_sb->s_bdev, NULL);
 out:
 	return ret;
 }
@@ -730,6 +730,9 @@ static int ext3_splice_branch(handle_t *handle, struct inode *inode,
 
 	inode->i_ctime = CURRENT_TIME_SEC;
 	ext3_mark_inode_dirty(handle, inode);
+	/* fdatasync must commit the new block mapping */
+	atomic_set(&EXT3_I(inode)->i_datasync_tid,
+		   handle->h_transaction->t_tid);
 
 	/* had we spliced it onto indirect block? */
 	if (where->bh) {
@@ -2727,6 +2730,35 @@ void ext3_get_inode_flags(struct ext3_inode_info *ei)
 		ei->i_flags |= EXT3_DIRSYNC_FL;
 }
 
+/*
+ * The inode may have been reclaimed and reread while some of its
+ * metadata is still part of the running or committing transaction, so
+ * fsync must wait for that transaction until the inode is modified.
+ */
+static void ext3_init_inode_fsync_tid(struct inode *inode)
+{
+	journal_t *journal = EXT3_JOURNAL(inode);
+	transaction_t *transaction;
+	tid_t tid;
+
+	if (!journal)
+		return;
+
+	spin_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction)
+		transaction = journal->j_running_transaction;
+	else
+		transaction = journal->j_committing_transaction;
+	if (transaction)
+		tid = transaction->t_tid;
+	else
+		tid = journal->j_commit_sequence;
+	spin_unlock(&journal->j_state_lock);
+
+	atomic_set(&EXT3_I(inode)->i_sync_tid, tid);
+	atomic_set(&EXT3_I(inode)->i_datasync_tid, tid);
+}
+
 struct inode *ext3_iget(struct super_block *sb, unsigned long ino)
 {
 	struct ext3_iloc iloc;
@@ -2870,6 +2902,7 @@ struct inode *ext3_iget(struct super_block *sb, unsigned long ino)
 	}
 	brelse (iloc.bh);
 	ext3_set_inode_flags(inode);
+	ext3_init_inode_fsync_tid(inode);
 	unlock_new_inode(inode);
 	return inode;
 
@@ -2892,12 +2925,16 @@ static int ext3_do_update_inode(handle_t *handle,
 	struct ext3_inode *raw_inode = ext3_raw_inode(iloc);
 	struct ext3_inode_info *ei = EXT3_I(inode);
 	struct buffer_head *bh = iloc->bh;
+	tid_t tid = handle->h_transaction->t_tid;
+	int need_datasync = 0;
 	int err = 0, rc, block;
 
 	/* For fields not not tracking in the in-memory inode,
 	 * initialise them to zero for new inodes. */
-	if (ei->i_state & EXT3_STATE_NEW)
+	if (ei->i_state & EXT3_STATE_NEW) {
 		memset(raw_inode, 0, EXT3_SB(inode->i_sb)->s_inode_size);
+		need_datasync = 1;
+	}
 
 	ext3_get_inode_flags(ei);
 	raw_inode->i_mode = cpu_to_le16(inode->i_mode);
@@ -2926,7 +2963,10 @@ static int ext3_do_update_inode(handle_t *handle,
 		raw_inode->i_gid_high = 0;
 	}
 	raw_inode->i_links_count = cpu_to_le16(inode->i_nlink);
-	raw_inode->i_size = cpu_to_le32(ei->i_disksize);
+	if (raw_inode->i_size != cpu_to_le32(ei->i_disksize)) {
+		raw_inode->i_size = cpu_to_le32(ei->i_disksize);
+		need_datasync = 1;
+	}
 	raw_inode->i_atime = cpu_to_le32(inode->i_atime.tv_sec);
 	raw_inode->i_ctime = cpu_to_le32(inode->i_ctime.tv_sec);
 	raw_inode->i_mtime = cpu_to_le32(inode->i_mtime.tv_sec);
@@ -2942,8 +2982,12 @@ static int ext3_do_update_inode(handle_t *handle,
 	if (!S_ISREG(inode->i_mode)) {
 		raw_inode->i_dir_acl = cpu_to_le32(ei->i_dir_acl);
 	} else {
-		raw_inode->i_size_high =
-			cpu_to_le32(ei->i_disksize >> 32);
+		if (raw_inode->i_size_high !=
+		    cpu_to_le32(ei->i_disksize >> 32)) {
+			raw_inode->i_size_high =
+				cpu_to_le32(ei->i_disksize >> 32);
+			need_datasync = 1;
+		}
 		if (ei->i_disksize > 0x7fffffffULL) {
 			struct super_block *sb = inode->i_sb;
 			if (!EXT3_HAS_RO_COMPAT_FEATURE(sb,
@@ -2991,6 +3035,10 @@ static int ext3_do_update_inode(handle_t *handle,
 		err = rc;
 	ei->i_state &= ~EXT3_STATE_NEW;
 
+	atomic_set(&ei->i_sync_tid, tid);
+	if (need_datasync)
+		atomic_set(&ei->i_datasync_tid, tid);
+
 out_brelse:
 	brelse (bh);
 	ext3_std_error(inode->i_sb, err);
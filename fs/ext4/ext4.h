@@ -349,6 +349,7 @@ struct ext4_mount_options {
 	gid_t s_resgid;
 	unsigned long s_commit_interval;
 	u32 s_min_batch_time, s_max_batch_time;
+	unsigned int s_li_wait_mult;
 #ifdef CONFIG_QUOTA
 	int s_jquota_fmt;
 	char *s_qf_names[MAXQUOTAS];
@@ -555,9 +556,11 @@ do {									       \
 #define EXT4_MOUNT_QUOTA		0x80000 /* Some quota option set */
 #define EXT4_MOUNT_USRQUOTA		0x100000 /* "old" user quota */
 #define EXT4_MOUNT_GRPQUOTA		0x200000 /* "old" group quota */
+#define EXT4_MOUNT_PREFETCH_BLOCK_BITMAPS 0x400000 /* Warm buddy cache */
 #define EXT4_MOUNT_JOURNAL_CHECKSUM	0x800000 /* Journal checksums */
 #define EXT4_MOUNT_JOURNAL_ASYNC_COMMIT	0x1000000 /* Journal Async Commit */
 #define EXT4_MOUNT_I_VERSION            0x2000000 /* i_version support */
+#define EXT4_MOUNT_INIT_INODE_TABLE	0x4000000 /* Zero unused itables in bg */
 #define EXT4_MOUNT_DELALLOC		0x8000000 /* Delalloc support */
 #define EXT4_MOUNT_DATA_ERR_ABORT	0x10000000 /* Abort on file data write */
 
@@ -813,6 +816,12 @@ static inline int ext4_valid_inum(struct super_block *sb, unsigned long ino)
 
 #define EXT4_DEF_INODE_READAHEAD_BLKS	32
 
+/*
+ * The lazy inode table init thread sleeps this many times as long as it
+ * took to zero a group before moving on to the next one.
+ */
+#define EXT4_DEF_LI_WAIT_MULT		10
+
 /*
  * Default mount options
  */
@@ -1038,6 +1047,7 @@ extern struct inode * ext4_orphan_get(struct super_block *, unsigned long);
 extern unsigned long ext4_count_free_inodes(struct super_block *);
 extern unsigned long ext4_count_dirs(struct super_block *);
 extern void ext4_check_inodes_bitmap(struct super_block *);
+extern int ext4_init_inode_table(struct super_block *, ext4_group_t);
 
 /* mballoc.c */
 extern long ext4_mb_stats;
@@ -1057,6 +1067,8 @@ extern int ext4_mb_add_groupinfo(struct super_block *sb,
 extern void ext4_mb_update_group_info(struct ext4_group_info *grp,
 		ext4_grpblk_t add);
 extern int ext4_mb_get_buddy_cache_lock(struct super_block *, ext4_group_t);
+extern int ext4_mb_init_group(struct super_block *, ext4_group_t);
+extern void ext4_mb_prefetch(struct super_block *, ext4_group_t, unsigned int);
 extern void ext4_mb_put_buddy_cache_lock(struct super_block *,
 						ext4_group_t, int);
 /* inode.c */
@@ -719,8 +719,14 @@ static int ext4_claim_inode(struct super_block *sb,
 {
 	int free = 0, retval = 0, count;
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp = ext4_get_group_info(sb, group);
 	struct ext4_group_desc *gdp = ext4_get_group_desc(sb, group, NULL);
 
+	/*
+	 * alloc_sem keeps us out of the part of the inode table that
+	 * ext4_init_inode_table() may be zeroing right now.
+	 */
+	down_read(&grp->alloc_sem);
 	spin_lock(sb_bgl_lock(sbi, group));
 	if (ext4_set_bit(ino, inode_bitmap_bh->b_data)) {
 		/* not a free inode */
@@ -731,6 +737,7 @@ static int ext4_claim_inode(struct super_block *sb,
 	if ((group == 0 && ino < EXT4_FIRST_INO(sb)) ||
 			ino > EXT4_INODES_PER_GROUP(sb)) {
 		spin_unlock(sb_bgl_lock(sbi, group));
+		up_read(&grp->alloc_sem);
 		ext4_error(sb, __func__,
 			   "reserved inode or inode > inodes count - "
 			   "block_group = %u, inode=%lu", group,
@@ -780,6 +787,7 @@ static int ext4_claim_inode(struct super_block *sb,
 	gdp->bg_checksum = ext4_group_desc_csum(sbi, group, gdp);
 err_ret:
 	spin_unlock(sb_bgl_lock(sbi, group));
+	up_read(&grp->alloc_sem);
 	return retval;
 }
 
@@ -1213,3 +1221,115 @@ unsigned long ext4_count_dirs(struct super_block * sb)
 	}
 	return count;
 }
+
+#define EXT4_ITABLE_ZERO_BATCH	32
+
+/*
+ * Write zeroes over @num inode table blocks starting at @blk.  The
+ * blocks go through the buffer cache so that anybody reading them
+ * later sees the zeroes without another trip to the disk.
+ */
+static int ext4_zero_itable_blocks(struct super_block *sb,
+				   ext4_fsblk_t blk, int num)
+{
+	struct buffer_head *bhs[EXT4_ITABLE_ZERO_BATCH];
+	struct buffer_head *bh;
+	int i, n, ret = 0;
+
+	while (num > 0 && !ret) {
+		n = min(num, EXT4_ITABLE_ZERO_BATCH);
+		for (i = 0; i < n; i++) {
+			bh = sb_getblk(sb, blk + i);
+			if (!bh) {
+				ret = -ENOMEM;
+				n = i;
+				break;
+			}
+			lock_buffer(bh);
+			memset(bh->b_data, 0, sb->s_blocksize);
+			set_buffer_uptodate(bh);
+			clear_buffer_dirty(bh);
+			get_bh(bh);
+			bh->b_end_io = end_buffer_write_sync;
+			submit_bh(WRITE, bh);
+			bhs[i] = bh;
+		}
+		for (i = 0; i < n; i++) {
+			wait_on_buffer(bhs[i]);
+			if (!buffer_uptodate(bhs[i]))
+				ret = -EIO;
+			brelse(bhs[i]);
+		}
+		blk += n;
+		num -= n;
+	}
+	return ret;
+}
+
+/*
+ * Zero the part of the inode table of @group beyond bg_itable_unused,
+ * which mke2fs may have left uninitialised, and mark the group
+ * EXT4_BG_INODE_ZEROED.  Called by the lazy init thread; returns 0
+ * when the group is done or had nothing to do.
+ */
+int ext4_init_inode_table(struct super_block *sb, ext4_group_t group)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp = ext4_get_group_info(sb, group);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *group_desc_bh;
+	handle_t *handle;
+	int used_blks = 0;
+	int ret = 0;
+
+	gdp = ext4_get_group_desc(sb, group, &group_desc_bh);
+	if (!gdp)
+		return 0;
+
+	/*
+	 * The handle has to be started before taking alloc_sem: inode
+	 * allocation takes alloc_sem with a handle already open.
+	 */
+	handle = ext4_journal_start_sb(sb, 1);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	down_write(&grp->alloc_sem);
+	if (gdp->bg_flags & cpu_to_le16(EXT4_BG_INODE_ZEROED))
+		goto out;
+
+	if (!(gdp->bg_flags & cpu_to_le16(EXT4_BG_INODE_UNINIT)))
+		used_blks = DIV_ROUND_UP((EXT4_INODES_PER_GROUP(sb) -
+					  ext4_itable_unused_count(sb, gdp)),
+					 sbi->s_inodes_per_block);
+	if (used_blks < 0 || used_blks > sbi->s_itb_per_group) {
+		ext4_error(sb, __func__, "Something is wrong with group %u: "
+			   "used itable blocks %d, itable unused count %u",
+			   group, used_blks,
+			   ext4_itable_unused_count(sb, gdp));
+		ret = -EIO;
+		goto out;
+	}
+
+	BUFFER_TRACE(group_desc_bh, "get_write_access");
+	ret = ext4_journal_get_write_access(handle, group_desc_bh);
+	if (ret)
+		goto out;
+
+	ret = ext4_zero_itable_blocks(sb, ext4_inode_table(sb, gdp) + used_blks,
+				      sbi->s_itb_per_group - used_blks);
+	if (ret)
+		goto out;
+
+	spin_lock(sb_bgl_lock(sbi, group));
+	gdp->bg_flags |= cpu_to_le16(EXT4_BG_INODE_ZEROED);
+	gdp->bg_checksum = ext4_group_desc_csum(sbi, group, gdp);
+	spin_unlock(sb_bgl_lock(sbi, group));
+
+	BUFFER_TRACE(group_desc_bh, "call ext4_handle_dirty_metadata");
+	ret = ext4_handle_dirty_metadata(handle, NULL, group_desc_bh);
+out:
+	up_write(&grp->alloc_sem);
+	ext4_journal_stop(handle);
+	return ret;
+}
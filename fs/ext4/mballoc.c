@@ -831,6 +831,8 @@ static int ext4_mb_init_cache(struct page *page, char *incore)
 		set_bitmap_uptodate(bh[i]);
 		bh[i]->b_end_io = end_buffer_read_sync;
 		submit_bh(READ, bh[i]);
+		if (EXT4_SB(sb)->s_mb_stats)
+			atomic_inc(&EXT4_SB(sb)->s_bal_sync_bitmaps);
 		mb_debug("read bitmap for group %u\n", first_group + i);
 	}
 
@@ -1852,7 +1854,7 @@ void ext4_mb_put_buddy_cache_lock(struct super_block *sb,
 
 }
 
-static int ext4_mb_init_group(struct super_block *sb, ext4_group_t group)
+int ext4_mb_init_group(struct super_block *sb, ext4_group_t group)
 {
 
 	int ret;
@@ -1942,6 +1944,57 @@ err:
 	return ret;
 }
 
+/*
+ * Start reading the block bitmaps of @nr groups from @group on without
+ * waiting for them, so that ext4_mb_init_group() finds them in the
+ * buffer cache instead of issuing one synchronous read per group.
+ * Groups which are already initialized, full or BLOCK_UNINIT are
+ * skipped.  A bitmap read here is not marked bitmap_uptodate; the
+ * usual readers do that under the buffer lock once the I/O is done.
+ */
+void ext4_mb_prefetch(struct super_block *sb, ext4_group_t group,
+		      unsigned int nr)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp;
+	struct ext4_group_desc *desc;
+	struct buffer_head *bh;
+
+	if (nr > sbi->s_groups_count)
+		nr = sbi->s_groups_count;
+	for (; nr > 0; nr--, group++) {
+		if (group >= sbi->s_groups_count)
+			group = 0;
+		grp = ext4_get_group_info(sb, group);
+		if (!EXT4_MB_GRP_NEED_INIT(grp) || grp->bb_free == 0)
+			continue;
+		desc = ext4_get_group_desc(sb, group, NULL);
+		if (desc == NULL ||
+		    (desc->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)))
+			continue;
+
+		bh = sb_getblk(sb, ext4_block_bitmap(sb, desc));
+		if (bh == NULL)
+			break;
+		if (bitmap_uptodate(bh) || buffer_uptodate(bh) ||
+		    !trylock_buffer(bh)) {
+			brelse(bh);
+			continue;
+		}
+		if (bitmap_uptodate(bh) || buffer_uptodate(bh)) {
+			unlock_buffer(bh);
+			brelse(bh);
+			continue;
+		}
+		/* end_buffer_read_sync drops the reference we pass on */
+		bh->b_end_io = end_buffer_read_sync;
+		submit_bh(READ_META, bh);
+		if (sbi->s_mb_stats)
+			atomic_inc(&sbi->s_bal_prefetched);
+		mb_debug("prefetch bitmap for group %u\n", group);
+	}
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
@@ -1954,6 +2007,7 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 	struct super_block *sb;
 	struct ext4_buddy e4b;
 	loff_t size, isize;
+	unsigned int prefetch_left = 0;
 
 	sb = ac->ac_sb;
 	sbi = EXT4_SB(sb);
@@ -2023,6 +2077,8 @@ repeat:
 
 			if (group == EXT4_SB(sb)->s_groups_count)
 				group = 0;
+			if (prefetch_left)
+				prefetch_left--;
 
 			/* quick check to skip empty groups */
 			grp = ext4_get_group_info(sb, group);
@@ -2036,8 +2092,16 @@ repeat:
 			if (EXT4_MB_GRP_NEED_INIT(grp)) {
 				/*
 				 * we need full data about the group
-				 * to make a good selection
+				 * to make a good selection.  Get the
+				 * bitmaps of the groups after it in
+				 * flight first, so we don't wait for
+				 * them one by one.
 				 */
+				if (prefetch_left == 0 && sbi->s_mb_prefetch) {
+					ext4_mb_prefetch(sb, group,
+							 sbi->s_mb_prefetch);
+					prefetch_left = sbi->s_mb_prefetch;
+				}
 				err = ext4_mb_init_group(sb, group);
 				if (err)
 					goto out;
@@ -2736,6 +2800,7 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
 	sbi->s_mb_history_filter = EXT4_MB_HISTORY_DEFAULT;
 	sbi->s_mb_group_prealloc = MB_DEFAULT_GROUP_PREALLOC;
+	sbi->s_mb_prefetch = MB_DEFAULT_PREFETCH;
 
 	sbi->s_locality_groups = alloc_percpu(struct ext4_locality_group);
 	if (sbi->s_locality_groups == NULL) {
@@ -2826,6 +2891,11 @@ int ext4_mb_release(struct super_block *sb)
 		       "EXT4-fs: mballoc: %lu generated and it took %Lu\n",
 				sbi->s_mb_buddies_generated++,
 				sbi->s_mb_generation_time);
+		printk(KERN_INFO
+		       "EXT4-fs: mballoc: %u bitmaps read synchronously, "
+				"%u prefetched\n",
+				atomic_read(&sbi->s_bal_sync_bitmaps),
+				atomic_read(&sbi->s_bal_prefetched));
 		printk(KERN_INFO
 		       "EXT4-fs: mballoc: %u preallocated, %u discarded\n",
 				atomic_read(&sbi->s_mb_preallocated),
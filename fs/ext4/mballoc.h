@@ -99,6 +99,12 @@
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * number of groups whose block bitmaps are read ahead of the group
+ * scan; 0 turns the read-ahead off
+ */
+#define MB_DEFAULT_PREFETCH		32
+
 
 struct ext4_free_data {
 	/* this links the free block information from group_info */
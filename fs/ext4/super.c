@@ -39,6 +39,8 @@
 #include <linux/marker.h>
 #include <linux/log2.h>
 #include <linux/crc16.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include <asm/uaccess.h>
 
 #include "ext4.h"
@@ -557,12 +559,186 @@ static void dump_orphan_list(struct super_block *sb, struct ext4_sb_info *sbi)
 	}
 }
 
+/*
+ * Lazy initialisation thread.  It does two jobs in the background:
+ *
+ * With prefetch_block_bitmaps it first reads the block bitmaps of all
+ * groups with free space and builds their buddy cache, so that the
+ * first allocations after mount do not wait for bitmap reads.  The
+ * bitmaps are read ahead s_mb_prefetch groups at a time.
+ *
+ * mke2fs -E lazy_itable_init leaves the inode tables of a fresh
+ * filesystem unwritten; the thread then zeroes them one group at a time
+ * and flags each group it finishes with EXT4_BG_INODE_ZEROED, so that
+ * the work survives a remount.  After each group it sleeps
+ * s_li_wait_mult times as long as the group took, and it backs off while
+ * the device is congested, so foreground I/O keeps most of the disk.
+ */
+static int ext4_lazyinit_itable_pending(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_desc *gdp;
+	ext4_group_t group;
+
+	if (!test_opt(sb, INIT_INODE_TABLE) ||
+	    !EXT4_HAS_RO_COMPAT_FEATURE(sb, EXT4_FEATURE_RO_COMPAT_GDT_CSUM))
+		return 0;
+
+	for (group = 0; group < sbi->s_groups_count; group++) {
+		gdp = ext4_get_group_desc(sb, group, NULL);
+		if (gdp && !(gdp->bg_flags &
+			     cpu_to_le16(EXT4_BG_INODE_ZEROED)))
+			return 1;
+	}
+	return 0;
+}
+
+static int ext4_lazyinit_buddy_cache(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp;
+	ext4_group_t group;
+	int err;
+
+	for (group = 0; group < sbi->s_groups_count; group++) {
+		if (kthread_should_stop())
+			return 0;
+		if (sbi->s_mb_prefetch && group % sbi->s_mb_prefetch == 0)
+			ext4_mb_prefetch(sb, group, sbi->s_mb_prefetch);
+
+		grp = ext4_get_group_info(sb, group);
+		if (EXT4_MB_GRP_NEED_INIT(grp) && grp->bb_free) {
+			err = ext4_mb_init_group(sb, group);
+			if (err) {
+				printk(KERN_WARNING "EXT4-fs (%s): buddy "
+				       "cache warm up stopped at group %u "
+				       "(%d)\n", sb->s_id, group, err);
+				return err;
+			}
+		}
+		cond_resched();
+		try_to_freeze();
+	}
+	return 0;
+}
+
+static int ext4_lazyinit_itables(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct backing_dev_info *bdi;
+	struct ext4_group_desc *gdp;
+	ext4_group_t group = 0;
+	unsigned long start;
+	int err = 0;
+
+	bdi = &bdev_get_queue(sb->s_bdev)->backing_dev_info;
+	while (group < sbi->s_groups_count && !kthread_should_stop()) {
+		gdp = ext4_get_group_desc(sb, group, NULL);
+		if (!gdp || (gdp->bg_flags &
+			     cpu_to_le16(EXT4_BG_INODE_ZEROED))) {
+			group++;
+			continue;
+		}
+
+		while (bdi_write_congested(bdi) && !kthread_should_stop())
+			congestion_wait(WRITE, HZ/10);
+		if (kthread_should_stop())
+			break;
+
+		start = jiffies;
+		err = ext4_init_inode_table(sb, group);
+		if (err)
+			break;
+		group++;
+
+		if (sbi->s_li_wait_mult)
+			schedule_timeout_interruptible((jiffies - start) *
+						       sbi->s_li_wait_mult);
+		else
+			cond_resched();
+		try_to_freeze();
+	}
+
+	if (err)
+		printk(KERN_WARNING "EXT4-fs (%s): inode table "
+		       "initialisation stopped at group %u (%d)\n",
+		       sb->s_id, group, err);
+	else if (group >= sbi->s_groups_count)
+		printk(KERN_INFO "EXT4-fs (%s): inode tables initialised\n",
+		       sb->s_id);
+	return err;
+}
+
+static int ext4_lazyinit_thread(void *data)
+{
+	struct super_block *sb = data;
+	int err = 0;
+
+	set_freezable();
+	if (test_opt(sb, PREFETCH_BLOCK_BITMAPS))
+		err = ext4_lazyinit_buddy_cache(sb);
+	if (!err && ext4_lazyinit_itable_pending(sb))
+		err = ext4_lazyinit_itables(sb);
+
+	/*
+	 * Stay around until ext4_stop_lazyinit() reaps us, so that the
+	 * task_struct it holds cannot go away underneath it.  Keep
+	 * honouring the freezer meanwhile, or suspend would stall on us.
+	 */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		if (!freezing(current))
+			schedule();
+		__set_current_state(TASK_RUNNING);
+		try_to_freeze();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return err;
+}
+
+/*
+ * Start the lazy init thread if the filesystem is writable and there is
+ * work for it.  Failing to start it is not fatal: the inode tables stay
+ * as mke2fs left them and the buddy cache is built on demand.
+ */
+static void ext4_start_lazyinit(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct task_struct *task;
+
+	if (sbi->s_li_task || (sb->s_flags & MS_RDONLY))
+		return;
+	if (!test_opt(sb, PREFETCH_BLOCK_BITMAPS) &&
+	    !ext4_lazyinit_itable_pending(sb))
+		return;
+
+	task = kthread_run(ext4_lazyinit_thread, sb, "ext4lazyinit");
+	if (IS_ERR(task)) {
+		printk(KERN_WARNING "EXT4-fs (%s): couldn't start lazy "
+		       "init thread (%ld)\n", sb->s_id, PTR_ERR(task));
+		return;
+	}
+	sbi->s_li_task = task;
+}
+
+static void ext4_stop_lazyinit(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (sbi->s_li_task) {
+		kthread_stop(sbi->s_li_task);
+		sbi->s_li_task = NULL;
+	}
+}
+
 static void ext4_put_super(struct super_block *sb)
 {
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	struct ext4_super_block *es = sbi->s_es;
 	int i, err;
 
+	ext4_stop_lazyinit(sb);
 	ext4_mb_release(sb);
 	ext4_ext_release(sb);
 	ext4_xattr_put_super(sb);
@@ -869,6 +1045,13 @@ static int ext4_show_options(struct seq_file *seq, struct vfsmount *vfs)
 	if (test_opt(sb, NO_AUTO_DA_ALLOC))
 		seq_puts(seq, ",noauto_da_alloc");
 
+	if (!test_opt(sb, INIT_INODE_TABLE))
+		seq_puts(seq, ",noinit_itable");
+	else if (sbi->s_li_wait_mult != EXT4_DEF_LI_WAIT_MULT)
+		seq_printf(seq, ",init_itable=%u", sbi->s_li_wait_mult);
+	if (test_opt(sb, PREFETCH_BLOCK_BITMAPS))
+		seq_puts(seq, ",prefetch_block_bitmaps");
+
 	ext4_show_quota_options(seq, sb);
 	return 0;
 }
@@ -1029,7 +1212,10 @@ enum {
 	Opt_ignore, Opt_barrier, Opt_nobarrier, Opt_err, Opt_resize,
 	Opt_usrquota, Opt_grpquota, Opt_i_version,
 	Opt_stripe, Opt_delalloc, Opt_nodelalloc,
-	Opt_inode_readahead_blks, Opt_journal_ioprio
+	Opt_inode_readahead_blks, Opt_journal_ioprio,
+	Opt_init_inode_table, Opt_init_inode_table_mult,
+	Opt_noinit_inode_table, Opt_prefetch_block_bitmaps,
+	Opt_noprefetch_block_bitmaps
 };
 
 static const match_table_t tokens = {
@@ -1092,6 +1278,11 @@ static const match_table_t tokens = {
 	{Opt_auto_da_alloc, "auto_da_alloc=%u"},
 	{Opt_auto_da_alloc, "auto_da_alloc"},
 	{Opt_noauto_da_alloc, "noauto_da_alloc"},
+	{Opt_init_inode_table_mult, "init_itable=%u"},
+	{Opt_init_inode_table, "init_itable"},
+	{Opt_noinit_inode_table, "noinit_itable"},
+	{Opt_prefetch_block_bitmaps, "prefetch_block_bitmaps"},
+	{Opt_noprefetch_block_bitmaps, "noprefetch_block_bitmaps"},
 	{Opt_err, NULL},
 };
 
@@ -1507,6 +1698,25 @@ set_qf_format:
 			else
 				set_opt(sbi->s_mount_opt,NO_AUTO_DA_ALLOC);
 			break;
+		case Opt_init_inode_table_mult:
+			if (match_int(&args[0], &option))
+				return 0;
+			if (option < 0)
+				return 0;
+			sbi->s_li_wait_mult = option;
+			/* fall through */
+		case Opt_init_inode_table:
+			set_opt(sbi->s_mount_opt, INIT_INODE_TABLE);
+			break;
+		case Opt_noinit_inode_table:
+			clear_opt(sbi->s_mount_opt, INIT_INODE_TABLE);
+			break;
+		case Opt_prefetch_block_bitmaps:
+			set_opt(sbi->s_mount_opt, PREFETCH_BLOCK_BITMAPS);
+			break;
+		case Opt_noprefetch_block_bitmaps:
+			clear_opt(sbi->s_mount_opt, PREFETCH_BLOCK_BITMAPS);
+			break;
 		default:
 			printk(KERN_ERR
 			       "EXT4-fs: Unrecognized mount option \"%s\" "
@@ -2147,6 +2357,7 @@ EXT4_RW_ATTR_SBI_UI(mb_min_to_scan, s_mb_min_to_scan);
 EXT4_RW_ATTR_SBI_UI(mb_order2_req, s_mb_order2_reqs);
 EXT4_RW_ATTR_SBI_UI(mb_stream_req, s_mb_stream_request);
 EXT4_RW_ATTR_SBI_UI(mb_group_prealloc, s_mb_group_prealloc);
+EXT4_RW_ATTR_SBI_UI(mb_prefetch, s_mb_prefetch);
 
 static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(delayed_allocation_blocks),
@@ -2159,6 +2370,7 @@ static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(mb_order2_req),
 	ATTR_LIST(mb_stream_req),
 	ATTR_LIST(mb_group_prealloc),
+	ATTR_LIST(mb_prefetch),
 	NULL,
 };
 
@@ -2330,6 +2542,8 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	 */
 	set_opt(sbi->s_mount_opt, DELALLOC);
 
+	set_opt(sbi->s_mount_opt, INIT_INODE_TABLE);
+	sbi->s_li_wait_mult = EXT4_DEF_LI_WAIT_MULT;
 
 	if (!parse_options((char *) data, sb, &journal_devnum,
 			   &journal_ioprio, NULL, 0))
@@ -2826,6 +3040,8 @@ no_journal:
 	printk(KERN_INFO "EXT4-fs: mounted filesystem %s with%s\n",
 	       sb->s_id, descr);
 
+	ext4_start_lazyinit(sb);
+
 	lock_kernel();
 	return 0;
 
@@ -3379,6 +3595,7 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 	old_opts.s_commit_interval = sbi->s_commit_interval;
 	old_opts.s_min_batch_time = sbi->s_min_batch_time;
 	old_opts.s_max_batch_time = sbi->s_max_batch_time;
+	old_opts.s_li_wait_mult = sbi->s_li_wait_mult;
 #ifdef CONFIG_QUOTA
 	old_opts.s_jquota_fmt = sbi->s_jquota_fmt;
 	for (i = 0; i < MAXQUOTAS; i++)
@@ -3417,6 +3634,12 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 		}
 
 		if (*flags & MS_RDONLY) {
+			/*
+			 * The lazy init thread writes to the disk, so it
+			 * has to go before the filesystem turns readonly.
+			 */
+			ext4_stop_lazyinit(sb);
+
 			/*
 			 * First of all, the unconditional stuff we have to do
 			 * to disable replay of the journal when we next remount
@@ -3507,6 +3730,10 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 	if (sbi->s_journal == NULL)
 		ext4_commit_super(sb, es, 1);
 
+	/* restart the lazy init thread with the new settings */
+	ext4_stop_lazyinit(sb);
+	ext4_start_lazyinit(sb);
+
 #ifdef CONFIG_QUOTA
 	/* Release old quota file names */
 	for (i = 0; i < MAXQUOTAS; i++)
@@ -3523,6 +3750,7 @@ restore_opts:
 	sbi->s_commit_interval = old_opts.s_commit_interval;
 	sbi->s_min_batch_time = old_opts.s_min_batch_time;
 	sbi->s_max_batch_time = old_opts.s_max_batch_time;
+	sbi->s_li_wait_mult = old_opts.s_li_wait_mult;
 #ifdef CONFIG_QUOTA
 	sbi->s_jquota_fmt = old_opts.s_jquota_fmt;
 	for (i = 0; i < MAXQUOTAS; i++) {
@@ -18,20 +18,156 @@
 #include <linux/file.h>
 #include <linux/slab.h>
 #include <linux/freezer.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
+#include <linux/rcupdate.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_dev *fuse_get_dev(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount or clone and is valid until the file is
+	 * released.
 	 */
 	return file->private_data;
 }
 
+static struct fuse_conn *fuse_get_conn(struct file *file)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+
+	return fud ? fud->fc : NULL;
+}
+
+static void fuse_dev_get(struct fuse_dev *fud)
+{
+	atomic_inc(&fud->count);
+}
+
+static void fuse_dev_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct fuse_dev, rcu));
+}
+
+static void fuse_dev_put(struct fuse_dev *fud)
+{
+	if (atomic_dec_and_test(&fud->count)) {
+		fuse_conn_put(fud->fc);
+		call_rcu(&fud->rcu, fuse_dev_free_rcu);
+	}
+}
+
+/*
+ * Spread the CPUs over the connection's devices round robin.
+ *
+ * Called with fc->dev_mutex
+ */
+static void fuse_dev_remap(struct fuse_conn *fc)
+{
+	struct list_head *pos = &fc->devices;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_dev *fud = NULL;
+
+		if (!list_empty(&fc->devices)) {
+			pos = pos->next;
+			if (pos == &fc->devices)
+				pos = pos->next;
+			fud = list_entry(pos, struct fuse_dev, entry);
+		}
+		rcu_assign_pointer(fc->dev_map[cpu], fud);
+	}
+}
+
+/*
+ * Create a new device for the connection and make it serve requests
+ *
+ * Called with fc->dev_mutex
+ */
+static struct fuse_dev *__fuse_dev_alloc(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud = kzalloc(sizeof(*fud), GFP_KERNEL);
+	if (!fud)
+		return NULL;
+
+	fud->fc = fuse_conn_get(fc);
+	spin_lock_init(&fud->lock);
+	atomic_set(&fud->count, 1);
+	fud->connected = 1;
+	init_waitqueue_head(&fud->waitq);
+	INIT_LIST_HEAD(&fud->pending);
+	INIT_LIST_HEAD(&fud->processing);
+	INIT_LIST_HEAD(&fud->io);
+	INIT_LIST_HEAD(&fud->interrupts);
+
+	list_add_tail_rcu(&fud->entry, &fc->devices);
+	fc->num_devs++;
+	fuse_dev_remap(fc);
+
+	return fud;
+}
+
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud;
+
+	mutex_lock(&fc->dev_mutex);
+	fud = __fuse_dev_alloc(fc);
+	mutex_unlock(&fc->dev_mutex);
+
+	return fud;
+}
+
+/*
+ * Pick the device to queue a new request on: the one serving this
+ * CPU, unless its reader is busy and another device has an idle
+ * reader waiting.
+ *
+ * Called under rcu_read_lock()
+ */
+static struct fuse_dev *fuse_dev_pick(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud;
+	struct fuse_dev *idle;
+
+	fud = rcu_dereference(fc->dev_map[raw_smp_processor_id()]);
+	if (!fud || waitqueue_active(&fud->waitq))
+		return fud;
+
+	list_for_each_entry_rcu(idle, &fc->devices, entry) {
+		if (waitqueue_active(&idle->waitq))
+			return idle;
+	}
+	return fud;
+}
+
+/*
+ * Lock the device the request is queued on.  The request may be moved
+ * to another device if its device is released while it is pending.
+ */
+static struct fuse_dev *lock_req_dev(struct fuse_req *req)
+__acquires(&req->fud->lock)
+{
+	struct fuse_dev *fud;
+
+	rcu_read_lock();
+	for (;;) {
+		fud = rcu_dereference(req->fud);
+		spin_lock(&fud->lock);
+		if (likely(fud == req->fud))
+			break;
+		spin_unlock(&fud->lock);
+	}
+	rcu_read_unlock();
+
+	return fud;
+}
+
 static void fuse_request_init(struct fuse_req *req)
 {
 	memset(req, 0, sizeof(*req));
@@ -204,6 +340,11 @@ void fuse_put_request(struct fuse_conn *fc, struct fuse_req *req)
 		if (req->waiting)
 			atomic_dec(&fc->num_waiting);
 
+		if (req->fud) {
+			fuse_dev_put(req->fud);
+			req->fud = NULL;
+		}
+
 		if (req->stolen_file)
 			put_reserved_req(fc, req);
 		else
@@ -222,63 +363,94 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
-static u64 fuse_get_unique(struct fuse_conn *fc)
+static u64 fuse_get_unique(struct fuse_dev *fud)
 {
-	fc->reqctr++;
+	fud->reqctr++;
 	/* zero is special */
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
+	if (fud->reqctr == 0)
+		fud->reqctr = 1;
 
-	return fc->reqctr;
+	return fud->reqctr;
 }
 
-static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
+/* Called with fud->lock */
+static void __queue_request(struct fuse_dev *fud, struct fuse_req *req)
 {
-	req->in.h.unique = fuse_get_unique(fc);
+	req->in.h.unique = fuse_get_unique(fud);
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &fud->pending);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
-		atomic_inc(&fc->num_waiting);
+		atomic_inc(&fud->fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	wake_up(&fud->waitq);
+	kill_fasync(&fud->fasync, SIGIO, POLL_IN);
 }
 
+/*
+ * Queue the request on one of the connection's devices.  Returns
+ * -ENOTCONN if no device is connected.
+ *
+ * May be called with fc->lock held
+ */
+static int queue_request(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_dev *fud;
+	int err = -ENOTCONN;
+
+	rcu_read_lock();
+	fud = fuse_dev_pick(fc);
+	if (fud) {
+		spin_lock(&fud->lock);
+		if (fud->connected) {
+			fuse_dev_get(fud);
+			if (req->fud)
+				fuse_dev_put(req->fud);
+			rcu_assign_pointer(req->fud, fud);
+			__queue_request(fud, req);
+			err = 0;
+		}
+		spin_unlock(&fud->lock);
+	}
+	rcu_read_unlock();
+
+	return err;
+}
+
+/* Called with fc->lock */
 static void flush_bg_queue(struct fuse_conn *fc)
 {
-	while (fc->active_background < FUSE_MAX_BACKGROUND &&
+	while (fc->connected &&
+	       fc->active_background < FUSE_MAX_BACKGROUND &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		queue_request(fc, req);
+		if (queue_request(fc, req)) {
+			/* Left for end_bg_requests() */
+			list_add(&req->list, &fc->bg_queue);
+			fc->active_background--;
+			break;
+		}
 	}
 }
 
 /*
- * This function is called when a request is finished.  Either a reply
- * has arrived or it was aborted (and not yet sent) or some error
- * occurred during communication with userspace, or the device file
- * was closed.  The requester thread is woken up (if still waiting),
- * the 'end' callback is called if given, else the reference to the
- * request is released
+ * Wake up the requester of a finished request, call the 'end'
+ * callback if given, else release the reference to the request.
  *
- * Called with fc->lock, unlocks it
+ * Called without locks held
  */
-static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(&fc->lock)
+static void __request_end(struct fuse_conn *fc, struct fuse_req *req)
 {
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
-	list_del(&req->list);
-	list_del(&req->intr_entry);
-	req->state = FUSE_REQ_FINISHED;
 	if (req->background) {
+		spin_lock(&fc->lock);
 		if (fc->num_background == FUSE_MAX_BACKGROUND) {
 			fc->blocked = 0;
 			wake_up_all(&fc->blocked_waitq);
@@ -291,50 +463,90 @@ __releases(&fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
 	fuse_put_request(fc, req);
 }
 
-static void wait_answer_interruptible(struct fuse_conn *fc,
-				      struct fuse_req *req)
-__releases(&fc->lock)
-__acquires(&fc->lock)
+/*
+ * This function is called when a request is finished.  Either a reply
+ * has arrived or it was aborted (and not yet sent) or some error
+ * occurred during communication with userspace, or the device file
+ * was closed.  The requester thread is woken up (if still waiting),
+ * the 'end' callback is called if given, else the reference to the
+ * request is released
+ *
+ * Called with req->fud->lock, unlocks it
+ */
+static void request_end(struct fuse_conn *fc, struct fuse_req *req)
+__releases(&req->fud->lock)
+{
+	list_del(&req->list);
+	list_del(&req->intr_entry);
+	req->state = FUSE_REQ_FINISHED;
+	spin_unlock(&req->fud->lock);
+	__request_end(fc, req);
+}
+
+/*
+ * Finish background requests which could not be queued because the
+ * connection went away.
+ */
+static void end_bg_requests(struct fuse_conn *fc)
+{
+	spin_lock(&fc->lock);
+	while (!fc->connected && !list_empty(&fc->bg_queue)) {
+		struct fuse_req *req;
+
+		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
+		list_del_init(&req->list);
+		fc->active_background++;
+		spin_unlock(&fc->lock);
+		req->out.h.error = -ECONNABORTED;
+		req->state = FUSE_REQ_FINISHED;
+		__request_end(fc, req);
+		spin_lock(&fc->lock);
+	}
+	spin_unlock(&fc->lock);
+}
+
+static void wait_answer_interruptible(struct fuse_req *req)
 {
 	if (signal_pending(current))
 		return;
 
-	spin_unlock(&fc->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
 }
 
-static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
+/* Called with fud->lock */
+static void queue_interrupt(struct fuse_dev *fud, struct fuse_req *req)
 {
-	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	list_add_tail(&req->intr_entry, &fud->interrupts);
+	wake_up(&fud->waitq);
+	kill_fasync(&fud->fasync, SIGIO, POLL_IN);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(&fc->lock)
-__acquires(&fc->lock)
 {
+	struct fuse_dev *fud;
+
 	if (!fc->no_interrupt) {
 		/* Any signal may interrupt this */
-		wait_answer_interruptible(fc, req);
+		wait_answer_interruptible(req);
 
+		fud = lock_req_dev(req);
 		if (req->aborted)
 			goto aborted;
 		if (req->state == FUSE_REQ_FINISHED)
-			return;
+			goto out_unlock;
 
 		req->interrupted = 1;
 		if (req->state == FUSE_REQ_SENT)
-			queue_interrupt(fc, req);
+			queue_interrupt(fud, req);
+		spin_unlock(&fud->lock);
 	}
 
 	if (!req->force) {
@@ -342,33 +554,34 @@ __acquires(&fc->lock)
 
 		/* Only fatal signals may interrupt this */
 		block_sigs(&oldset);
-		wait_answer_interruptible(fc, req);
+		wait_answer_interruptible(req);
 		restore_sigs(&oldset);
 
+		fud = lock_req_dev(req);
 		if (req->aborted)
 			goto aborted;
 		if (req->state == FUSE_REQ_FINISHED)
-			return;
+			goto out_unlock;
 
 		/* Request is not yet in userspace, bail out */
 		if (req->state == FUSE_REQ_PENDING) {
 			list_del(&req->list);
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
-			return;
+			goto out_unlock;
 		}
+		spin_unlock(&fud->lock);
 	}
 
 	/*
 	 * Either request is already in userspace, or it was forced.
 	 * Wait it out.
 	 */
-	spin_unlock(&fc->lock);
 	wait_event(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	fud = lock_req_dev(req);
 
 	if (!req->aborted)
-		return;
+		goto out_unlock;
 
  aborted:
 	BUG_ON(req->state != FUSE_REQ_FINISHED);
@@ -378,29 +591,32 @@ __acquires(&fc->lock)
 		   locked state, there mustn't be any filesystem
 		   operation (e.g. page fault), since that could lead
 		   to deadlock */
-		spin_unlock(&fc->lock);
+		spin_unlock(&fud->lock);
 		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
+		return;
 	}
+ out_unlock:
+	spin_unlock(&fud->lock);
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
 	req->isreply = 1;
-	spin_lock(&fc->lock);
 	if (!fc->connected)
 		req->out.h.error = -ENOTCONN;
 	else if (fc->conn_error)
 		req->out.h.error = -ECONNREFUSED;
 	else {
-		queue_request(fc, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
 		__fuse_get_request(req);
 
-		request_wait_answer(fc, req);
+		if (queue_request(fc, req)) {
+			__fuse_put_request(req);
+			req->out.h.error = -ENOTCONN;
+		} else
+			request_wait_answer(fc, req);
 	}
-	spin_unlock(&fc->lock);
 }
 
 static void fuse_request_send_nowait_locked(struct fuse_conn *fc,
@@ -425,8 +641,10 @@ static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
 		req->out.h.error = -ENOTCONN;
-		request_end(fc, req);
+		req->state = FUSE_REQ_FINISHED;
+		__request_end(fc, req);
 	}
 }
 
@@ -459,16 +677,16 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
  * anything that could cause a page-fault.  If the request was already
  * aborted bail out.
  */
-static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
+static int lock_request(struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->fud->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->fud->lock);
 	}
 	return err;
 }
@@ -478,14 +696,14 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
  * requester thread is currently waiting for it to be unlocked, so
  * wake it up.
  */
-static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
+static void unlock_request(struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->fud->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->fud->lock);
 	}
 }
 
@@ -494,7 +712,11 @@ struct fuse_copy_state {
 	int write;
 	struct fuse_req *req;
 	const struct iovec *iov;
+	struct pipe_buffer *pipebufs;
+	struct pipe_buffer *currbuf;
+	struct pipe_inode_info *pipe;
 	unsigned long nr_segs;
+	unsigned long max_segs;
 	unsigned long seglen;
 	unsigned long addr;
 	struct page *pg;
@@ -518,7 +740,18 @@ static void fuse_copy_init(struct fuse_copy_state *cs, struct fuse_conn *fc,
 /* Unmap and put previous page of userspace buffer */
 static void fuse_copy_finish(struct fuse_copy_state *cs)
 {
-	if (cs->mapaddr) {
+	if (cs->currbuf) {
+		struct pipe_buffer *buf = cs->currbuf;
+
+		if (!cs->write) {
+			buf->ops->unmap(cs->pipe, buf, cs->mapaddr);
+		} else {
+			kunmap_atomic(cs->mapaddr, KM_USER0);
+			buf->len = PAGE_SIZE - cs->len;
+		}
+		cs->currbuf = NULL;
+		cs->mapaddr = NULL;
+	} else if (cs->mapaddr) {
 		kunmap_atomic(cs->mapaddr, KM_USER0);
 		if (cs->write) {
 			flush_dcache_page(cs->pg);
@@ -532,36 +765,77 @@ static void fuse_copy_finish(struct fuse_copy_state *cs)
 /*
  * Get another pagefull of userspace buffer, and map it to kernel
  * address space, and lock request
+ *
+ * When splicing, the buffer is the next pipe buffer to read from, or a
+ * newly allocated page to be handed to the pipe.
  */
 static int fuse_copy_fill(struct fuse_copy_state *cs)
 {
 	unsigned long offset;
 	int err;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->req);
 	fuse_copy_finish(cs);
-	if (!cs->seglen) {
-		BUG_ON(!cs->nr_segs);
-		cs->seglen = cs->iov[0].iov_len;
-		cs->addr = (unsigned long) cs->iov[0].iov_base;
-		cs->iov++;
-		cs->nr_segs--;
+	if (cs->pipebufs) {
+		struct pipe_buffer *buf = cs->pipebufs;
+
+		if (!cs->write) {
+			BUG_ON(!cs->nr_segs);
+			err = buf->ops->confirm(cs->pipe, buf);
+			if (err)
+				return err;
+
+			cs->currbuf = buf;
+			cs->mapaddr = buf->ops->map(cs->pipe, buf, 1);
+			cs->len = buf->len;
+			cs->buf = cs->mapaddr + buf->offset;
+			cs->pipebufs++;
+			cs->nr_segs--;
+		} else {
+			struct page *page;
+
+			if (cs->nr_segs == cs->max_segs)
+				return -EIO;
+
+			page = alloc_page(GFP_HIGHUSER);
+			if (!page)
+				return -ENOMEM;
+
+			buf->page = page;
+			buf->offset = 0;
+			buf->len = 0;
+
+			cs->currbuf = buf;
+			cs->mapaddr = kmap_atomic(page, KM_USER0);
+			cs->buf = cs->mapaddr;
+			cs->len = PAGE_SIZE;
+			cs->pipebufs++;
+			cs->nr_segs++;
+		}
+	} else {
+		if (!cs->seglen) {
+			BUG_ON(!cs->nr_segs);
+			cs->seglen = cs->iov[0].iov_len;
+			cs->addr = (unsigned long) cs->iov[0].iov_base;
+			cs->iov++;
+			cs->nr_segs--;
+		}
+		down_read(&current->mm->mmap_sem);
+		err = get_user_pages(current, current->mm, cs->addr, 1,
+				     cs->write, 0, &cs->pg, NULL);
+		up_read(&current->mm->mmap_sem);
+		if (err < 0)
+			return err;
+		BUG_ON(err != 1);
+		offset = cs->addr % PAGE_SIZE;
+		cs->mapaddr = kmap_atomic(cs->pg, KM_USER0);
+		cs->buf = cs->mapaddr + offset;
+		cs->len = min(PAGE_SIZE - offset, cs->seglen);
+		cs->seglen -= cs->len;
+		cs->addr += cs->len;
 	}
-	down_read(&current->mm->mmap_sem);
-	err = get_user_pages(current, current->mm, cs->addr, 1, cs->write, 0,
-			     &cs->pg, NULL);
-	up_read(&current->mm->mmap_sem);
-	if (err < 0)
-		return err;
-	BUG_ON(err != 1);
-	offset = cs->addr % PAGE_SIZE;
-	cs->mapaddr = kmap_atomic(cs->pg, KM_USER0);
-	cs->buf = cs->mapaddr + offset;
-	cs->len = min(PAGE_SIZE - offset, cs->seglen);
-	cs->seglen -= cs->len;
-	cs->addr += cs->len;
 
-	return lock_request(cs->fc, cs->req);
+	return lock_request(cs->req);
 }
 
 /* Do as much copy to/from userspace buffer as we can */
@@ -581,6 +855,34 @@ static int fuse_copy_do(struct fuse_copy_state *cs, void **val, unsigned *size)
 	return ncpy;
 }
 
+/*
+ * Hand a page of the request over to the pipe instead of copying it.
+ * The pipe buffer holds its own reference to the page.
+ */
+static int fuse_ref_page(struct fuse_copy_state *cs, struct page *page,
+			 unsigned offset, unsigned count)
+{
+	struct pipe_buffer *buf;
+
+	if (cs->nr_segs == cs->max_segs)
+		return -EIO;
+
+	unlock_request(cs->req);
+	fuse_copy_finish(cs);
+
+	buf = cs->pipebufs;
+	page_cache_get(page);
+	buf->page = page;
+	buf->offset = offset;
+	buf->len = count;
+
+	cs->pipebufs++;
+	cs->nr_segs++;
+	cs->len = 0;
+
+	return 0;
+}
+
 /*
  * Copy a page in the request to/from the userspace buffer.  Must be
  * done atomically
@@ -594,7 +896,9 @@ static int fuse_copy_page(struct fuse_copy_state *cs, struct page *page,
 		kunmap_atomic(mapaddr, KM_USER1);
 	}
 	while (count) {
-		if (!cs->len) {
+		if (cs->write && cs->pipebufs && page) {
+			return fuse_ref_page(cs, page, offset, count);
+		} else if (!cs->len) {
 			int err = fuse_copy_fill(cs);
 			if (err)
 				return err;
@@ -666,30 +970,30 @@ static int fuse_copy_args(struct fuse_copy_state *cs, unsigned numargs,
 	return err;
 }
 
-static int request_pending(struct fuse_conn *fc)
+static int request_pending(struct fuse_dev *fud)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts);
+	return !list_empty(&fud->pending) || !list_empty(&fud->interrupts);
 }
 
 /* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(&fc->lock)
-__acquires(&fc->lock)
+static void request_wait(struct fuse_dev *fud)
+__releases(&fud->lock)
+__acquires(&fud->lock)
 {
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
+	add_wait_queue_exclusive(&fud->waitq, &wait);
+	while (fud->connected && !request_pending(fud)) {
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (signal_pending(current))
 			break;
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&fud->lock);
 		schedule();
-		spin_lock(&fc->lock);
+		spin_lock(&fud->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	remove_wait_queue(&fud->waitq, &wait);
 }
 
 /*
@@ -698,20 +1002,20 @@ __acquires(&fc->lock)
  * Unlike other requests this is assembled on demand, without a need
  * to allocate a separate fuse_req structure.
  *
- * Called with fc->lock held, releases it
+ * Called with fud->lock held, releases it
  */
-static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_req *req,
-			       const struct iovec *iov, unsigned long nr_segs)
-__releases(&fc->lock)
+static int fuse_read_interrupt(struct fuse_dev *fud,
+			       struct fuse_copy_state *cs,
+			       size_t nbytes, struct fuse_req *req)
+__releases(&fud->lock)
 {
-	struct fuse_copy_state cs;
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
 	unsigned reqsize = sizeof(ih) + sizeof(arg);
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fc);
+	req->intr_unique = fuse_get_unique(fud);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -719,15 +1023,14 @@ __releases(&fc->lock)
 	ih.unique = req->intr_unique;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
-	if (iov_length(iov, nr_segs) < reqsize)
+	spin_unlock(&fud->lock);
+	if (nbytes < reqsize)
 		return -EINVAL;
 
-	fuse_copy_init(&cs, fc, 1, NULL, iov, nr_segs);
-	err = fuse_copy_one(&cs, &ih, sizeof(ih));
+	err = fuse_copy_one(cs, &ih, sizeof(ih));
 	if (!err)
-		err = fuse_copy_one(&cs, &arg, sizeof(arg));
-	fuse_copy_finish(&cs);
+		err = fuse_copy_one(cs, &arg, sizeof(arg));
+	fuse_copy_finish(cs);
 
 	return err ? err : reqsize;
 }
@@ -741,50 +1044,44 @@ __releases(&fc->lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
-			      unsigned long nr_segs, loff_t pos)
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
+				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_conn *fc = fud->fc;
 	struct fuse_req *req;
 	struct fuse_in *in;
-	struct fuse_copy_state cs;
 	unsigned reqsize;
-	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
-		return -EPERM;
-
-	FUSE_MIGHT_FREEZE(file->f_mapping->host->i_sb, "fuse_dev_read");
 
  restart:
-	spin_lock(&fc->lock);
+	spin_lock(&fud->lock);
 	err = -EAGAIN;
-	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
+	if ((file->f_flags & O_NONBLOCK) && fud->connected &&
+	    !request_pending(fud))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(fud);
 	err = -ENODEV;
-	if (!fc->connected)
+	if (!fud->connected)
 		goto err_unlock;
 	err = -ERESTARTSYS;
-	if (!request_pending(fc))
+	if (!request_pending(fud))
 		goto err_unlock;
 
-	if (!list_empty(&fc->interrupts)) {
-		req = list_entry(fc->interrupts.next, struct fuse_req,
+	if (!list_empty(&fud->interrupts)) {
+		req = list_entry(fud->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fc, req, iov, nr_segs);
+		return fuse_read_interrupt(fud, cs, nbytes, req);
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = list_entry(fud->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &fud->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
 	/* If request is too large, reply with an error and restart the read */
-	if (iov_length(iov, nr_segs) < reqsize) {
+	if (nbytes < reqsize) {
 		req->out.h.error = -EIO;
 		/* SETXATTR is special, since it may contain too large data */
 		if (in->h.opcode == FUSE_SETXATTR)
@@ -792,14 +1089,14 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 		request_end(fc, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
-	fuse_copy_init(&cs, fc, 1, req, iov, nr_segs);
-	err = fuse_copy_one(&cs, &in->h, sizeof(in->h));
+	spin_unlock(&fud->lock);
+	cs->req = req;
+	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
-		err = fuse_copy_args(&cs, in->numargs, in->argpages,
+		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
-	fuse_copy_finish(&cs);
-	spin_lock(&fc->lock);
+	fuse_copy_finish(cs);
+	spin_lock(&fud->lock);
 	req->locked = 0;
 	if (req->aborted) {
 		request_end(fc, req);
@@ -814,18 +1111,154 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 		request_end(fc, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list, &fud->processing);
 		if (req->interrupted)
-			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+			queue_interrupt(fud, req);
+		spin_unlock(&fud->lock);
 	}
 	return reqsize;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&fud->lock);
 	return err;
 }
 
+static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
+			      unsigned long nr_segs, loff_t pos)
+{
+	struct fuse_copy_state cs;
+	struct file *file = iocb->ki_filp;
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
+		return -EPERM;
+
+	FUSE_MIGHT_FREEZE(file->f_mapping->host->i_sb, "fuse_dev_read");
+
+	fuse_copy_init(&cs, fud->fc, 1, NULL, iov, nr_segs);
+
+	return fuse_dev_do_read(fud, file, &cs, iov_length(iov, nr_segs));
+}
+
+static int fuse_dev_pipe_buf_steal(struct pipe_inode_info *pipe,
+				   struct pipe_buffer *buf)
+{
+	return 1;
+}
+
+static const struct pipe_buf_operations fuse_dev_pipe_buf_ops = {
+	.can_merge = 0,
+	.map = generic_pipe_buf_map,
+	.unmap = generic_pipe_buf_unmap,
+	.confirm = generic_pipe_buf_confirm,
+	.release = generic_pipe_buf_release,
+	.steal = fuse_dev_pipe_buf_steal,
+	.get = generic_pipe_buf_get,
+};
+
+/*
+ * Read a request into a pipe.  Pages of the request are referenced by
+ * the pipe buffers instead of being copied, so the filesystem daemon
+ * can pass the data on to another file without it ever touching
+ * userspace memory.
+ */
+static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
+				    struct pipe_inode_info *pipe,
+				    size_t len, unsigned int flags)
+{
+	ssize_t ret;
+	int page_nr = 0;
+	int do_wakeup = 0;
+	struct pipe_buffer *bufs;
+	struct fuse_copy_state cs;
+	struct fuse_dev *fud = fuse_get_dev(in);
+	struct fuse_conn *fc;
+	if (!fud)
+		return -EPERM;
+
+	fc = fud->fc;
+	if (!fc->splice_read) {
+		spin_lock(&fc->lock);
+		fc->splice_read = 1;
+		fc->max_write = min_t(unsigned, fc->max_write,
+				      FUSE_SPLICE_MAX_WRITE);
+		spin_unlock(&fc->lock);
+	}
+
+	bufs = kmalloc(PIPE_BUFFERS * sizeof(struct pipe_buffer), GFP_KERNEL);
+	if (!bufs)
+		return -ENOMEM;
+
+	fuse_copy_init(&cs, fc, 1, NULL, NULL, 0);
+	cs.pipebufs = bufs;
+	cs.pipe = pipe;
+
+	/*
+	 * Once dequeued, a request that cannot be put in the pipe would
+	 * never reach the daemon.  So the pipe is checked before that and
+	 * stays locked until the pages are in it.  Wait for a request
+	 * first, so that we do not normally sleep holding the pipe lock.
+	 */
+	if (!(in->f_flags & O_NONBLOCK)) {
+		spin_lock(&fud->lock);
+		request_wait(fud);
+		spin_unlock(&fud->lock);
+	}
+
+	ret = 0;
+	pipe_lock(pipe);
+
+	if (!pipe->readers) {
+		send_sig(SIGPIPE, current, 0);
+		ret = -EPIPE;
+		goto out_unlock;
+	}
+
+	if (pipe->nrbufs == PIPE_BUFFERS) {
+		ret = -EIO;
+		goto out_unlock;
+	}
+
+	cs.max_segs = PIPE_BUFFERS - pipe->nrbufs;
+	ret = fuse_dev_do_read(fud, in, &cs, len);
+	if (ret < 0)
+		goto out_unlock;
+
+	ret = 0;
+	while (page_nr < cs.nr_segs) {
+		int newbuf = (pipe->curbuf + pipe->nrbufs) & (PIPE_BUFFERS - 1);
+		struct pipe_buffer *buf = pipe->bufs + newbuf;
+
+		buf->page = bufs[page_nr].page;
+		buf->offset = bufs[page_nr].offset;
+		buf->len = bufs[page_nr].len;
+		buf->flags = 0;
+		buf->ops = &fuse_dev_pipe_buf_ops;
+
+		pipe->nrbufs++;
+		page_nr++;
+		ret += buf->len;
+
+		if (pipe->inode)
+			do_wakeup = 1;
+	}
+
+ out_unlock:
+	pipe_unlock(pipe);
+
+	if (do_wakeup) {
+		smp_mb();
+		if (waitqueue_active(&pipe->wait))
+			wake_up_interruptible(&pipe->wait);
+		kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
+	}
+
+	for (; page_nr < cs.nr_segs; page_nr++)
+		page_cache_release(bufs[page_nr].page);
+
+	kfree(bufs);
+	return ret;
+}
+
 static int fuse_notify_poll(struct fuse_conn *fc, unsigned int size,
 			    struct fuse_copy_state *cs)
 {
@@ -861,11 +1294,11 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 }
 
 /* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+static struct fuse_req *request_find(struct fuse_dev *fud, u64 unique)
 {
 	struct list_head *entry;
 
-	list_for_each(entry, &fc->processing) {
+	list_for_each(entry, &fud->processing) {
 		struct fuse_req *req;
 		req = list_entry(entry, struct fuse_req, list);
 		if (req->in.h.unique == unique || req->intr_unique == unique)
@@ -903,27 +1336,22 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
  * list by the unique ID found in the header.  If found, then remove
  * it from the list and copy the rest of the buffer to the request.
  * The request is finished by calling request_end()
+ *
+ * Unique IDs are per device, so the reply must be written to the
+ * device the request was read from.
  */
-static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
-			       unsigned long nr_segs, loff_t pos)
+static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
+				 struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
-	unsigned nbytes = iov_length(iov, nr_segs);
+	struct fuse_conn *fc = fud->fc;
 	struct fuse_req *req;
 	struct fuse_out_header oh;
-	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(iocb->ki_filp);
-	if (!fc)
-		return -EPERM;
-
-	FUSE_MIGHT_FREEZE(iocb->ki_filp->f_mapping->host->i_sb,
-			"fuse_dev_write");
 
-	fuse_copy_init(&cs, fc, 0, NULL, iov, nr_segs);
 	if (nbytes < sizeof(struct fuse_out_header))
 		return -EINVAL;
 
-	err = fuse_copy_one(&cs, &oh, sizeof(oh));
+	err = fuse_copy_one(cs, &oh, sizeof(oh));
 	if (err)
 		goto err_finish;
 
@@ -936,7 +1364,7 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 	 * and error contains notification code.
 	 */
 	if (!oh.unique) {
-		err = fuse_notify(fc, oh.error, nbytes - sizeof(oh), &cs);
+		err = fuse_notify(fc, oh.error, nbytes - sizeof(oh), cs);
 		return err ? err : nbytes;
 	}
 
@@ -944,19 +1372,19 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
+	spin_lock(&fud->lock);
 	err = -ENOENT;
-	if (!fc->connected)
+	if (!fud->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(fud, oh.unique);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
-		fuse_copy_finish(&cs);
-		spin_lock(&fc->lock);
+		spin_unlock(&fud->lock);
+		fuse_copy_finish(cs);
+		spin_lock(&fud->lock);
 		request_end(fc, req);
 		return -ENOENT;
 	}
@@ -969,24 +1397,24 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 		if (oh.error == -ENOSYS)
 			fc->no_interrupt = 1;
 		else if (oh.error == -EAGAIN)
-			queue_interrupt(fc, req);
+			queue_interrupt(fud, req);
 
-		spin_unlock(&fc->lock);
-		fuse_copy_finish(&cs);
+		spin_unlock(&fud->lock);
+		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &fud->io);
 	req->out.h = oh;
 	req->locked = 1;
-	cs.req = req;
-	spin_unlock(&fc->lock);
+	cs->req = req;
+	spin_unlock(&fud->lock);
 
-	err = copy_out_args(&cs, &req->out, nbytes);
-	fuse_copy_finish(&cs);
+	err = copy_out_args(cs, &req->out, nbytes);
+	fuse_copy_finish(cs);
 
-	spin_lock(&fc->lock);
+	spin_lock(&fud->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
@@ -998,27 +1426,131 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&fud->lock);
  err_finish:
-	fuse_copy_finish(&cs);
+	fuse_copy_finish(cs);
 	return err;
 }
 
+static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
+			      unsigned long nr_segs, loff_t pos)
+{
+	struct fuse_copy_state cs;
+	struct fuse_dev *fud = fuse_get_dev(iocb->ki_filp);
+	if (!fud)
+		return -EPERM;
+
+	FUSE_MIGHT_FREEZE(iocb->ki_filp->f_mapping->host->i_sb,
+			"fuse_dev_write");
+
+	fuse_copy_init(&cs, fud->fc, 0, NULL, iov, nr_segs);
+
+	return fuse_dev_do_write(fud, &cs, iov_length(iov, nr_segs));
+}
+
+/*
+ * Write a reply from a pipe.  The pipe buffers are detached from the
+ * pipe up front, so the reply is consumed even if it turns out to be
+ * invalid, like with write(2).  The data is copied into the request;
+ * SPLICE_F_MOVE is accepted but pages are not stolen.
+ */
+static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
+				     struct file *out, loff_t *ppos,
+				     size_t len, unsigned int flags)
+{
+	unsigned nbuf;
+	unsigned idx;
+	struct pipe_buffer *bufs;
+	struct fuse_copy_state cs;
+	struct fuse_dev *fud;
+	size_t rem;
+	ssize_t ret;
+
+	fud = fuse_get_dev(out);
+	if (!fud)
+		return -EPERM;
+
+	bufs = kmalloc(PIPE_BUFFERS * sizeof(struct pipe_buffer), GFP_KERNEL);
+	if (!bufs)
+		return -ENOMEM;
+
+	pipe_lock(pipe);
+	nbuf = 0;
+	rem = 0;
+	for (idx = 0; idx < pipe->nrbufs && rem < len; idx++)
+		rem += pipe->bufs[(pipe->curbuf + idx) & (PIPE_BUFFERS - 1)].len;
+
+	ret = -EINVAL;
+	if (rem < len) {
+		pipe_unlock(pipe);
+		goto out;
+	}
+
+	rem = len;
+	while (rem) {
+		struct pipe_buffer *ibuf;
+		struct pipe_buffer *obuf;
+
+		BUG_ON(nbuf >= PIPE_BUFFERS);
+		BUG_ON(!pipe->nrbufs);
+		ibuf = &pipe->bufs[pipe->curbuf];
+		obuf = &bufs[nbuf];
+
+		if (rem >= ibuf->len) {
+			*obuf = *ibuf;
+			ibuf->ops = NULL;
+			pipe->curbuf = (pipe->curbuf + 1) & (PIPE_BUFFERS - 1);
+			pipe->nrbufs--;
+		} else {
+			ibuf->ops->get(pipe, ibuf);
+			*obuf = *ibuf;
+			obuf->flags &= ~PIPE_BUF_FLAG_GIFT;
+			obuf->len = rem;
+			ibuf->offset += obuf->len;
+			ibuf->len -= obuf->len;
+		}
+		nbuf++;
+		rem -= obuf->len;
+	}
+	pipe_unlock(pipe);
+
+	if (pipe->inode) {
+		smp_mb();
+		if (waitqueue_active(&pipe->wait))
+			wake_up_interruptible(&pipe->wait);
+		kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
+	}
+
+	fuse_copy_init(&cs, fud->fc, 0, NULL, NULL, nbuf);
+	cs.pipebufs = bufs;
+	cs.pipe = pipe;
+
+	ret = fuse_dev_do_write(fud, &cs, len);
+
+	for (idx = 0; idx < nbuf; idx++) {
+		struct pipe_buffer *buf = &bufs[idx];
+		buf->ops->release(pipe, buf);
+	}
+ out:
+	kfree(bufs);
+	return ret;
+}
+
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	poll_wait(file, &fud->waitq, wait);
 
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	spin_lock(&fud->lock);
+	if (!fud->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (request_pending(fud))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
+	spin_unlock(&fud->lock);
 
 	return mask;
 }
@@ -1026,18 +1558,18 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 /*
  * Abort all requests on the given list (pending or processing)
  *
- * This function releases and reacquires fc->lock
+ * This function releases and reacquires fud->lock
  */
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(&fc->lock)
-__acquires(&fc->lock)
+static void end_requests(struct fuse_dev *fud, struct list_head *head)
+__releases(&fud->lock)
+__acquires(&fud->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
-		request_end(fc, req);
-		spin_lock(&fc->lock);
+		request_end(fud->fc, req);
+		spin_lock(&fud->lock);
 	}
 }
 
@@ -1052,13 +1584,13 @@ __acquires(&fc->lock)
  * called after waiting for the request to be unlocked (if it was
  * locked).
  */
-static void end_io_requests(struct fuse_conn *fc)
-__releases(&fc->lock)
-__acquires(&fc->lock)
+static void end_io_requests(struct fuse_dev *fud)
+__releases(&fud->lock)
+__acquires(&fud->lock)
 {
-	while (!list_empty(&fc->io)) {
+	while (!list_empty(&fud->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(fud->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
@@ -1069,15 +1601,35 @@ __acquires(&fc->lock)
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&fud->lock);
 			wait_event(req->waitq, !req->locked);
-			end(fc, req);
-			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			end(fud->fc, req);
+			fuse_put_request(fud->fc, req);
+			spin_lock(&fud->lock);
 		}
 	}
 }
 
+/*
+ * Disconnect all devices of the connection, so that readers return
+ * -ENODEV.  Requests still queued are finished when the devices are
+ * aborted or released.
+ */
+void fuse_dev_disconnect(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud;
+
+	mutex_lock(&fc->dev_mutex);
+	list_for_each_entry(fud, &fc->devices, entry) {
+		spin_lock(&fud->lock);
+		fud->connected = 0;
+		spin_unlock(&fud->lock);
+		wake_up_all(&fud->waitq);
+		kill_fasync(&fud->fasync, SIGIO, POLL_IN);
+	}
+	mutex_unlock(&fc->dev_mutex);
+}
+
 /*
  * Abort all requests.
  *
@@ -1091,7 +1643,7 @@ __acquires(&fc->lock)
  *
  * During the aborting, progression of requests from the pending and
  * processing lists onto the io list, and progression of new requests
- * onto the pending list is prevented by req->connected being false.
+ * onto the pending list is prevented by fud->connected being false.
  *
  * Progression of requests under I/O to the processing list is
  * prevented by the req->aborted flag being true for these requests.
@@ -1099,43 +1651,209 @@ __acquires(&fc->lock)
  */
 void fuse_abort_conn(struct fuse_conn *fc)
 {
+	struct fuse_dev *fud;
+	int connected;
+
 	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_io_requests(fc);
-		end_requests(fc, &fc->pending);
-		end_requests(fc, &fc->processing);
-		wake_up_all(&fc->waitq);
+	connected = fc->connected;
+	fc->connected = 0;
+	fc->blocked = 0;
+	spin_unlock(&fc->lock);
+
+	if (connected) {
+		mutex_lock(&fc->dev_mutex);
+		list_for_each_entry(fud, &fc->devices, entry) {
+			spin_lock(&fud->lock);
+			fud->connected = 0;
+			end_io_requests(fud);
+			end_requests(fud, &fud->pending);
+			end_requests(fud, &fud->processing);
+			spin_unlock(&fud->lock);
+			wake_up_all(&fud->waitq);
+			kill_fasync(&fud->fasync, SIGIO, POLL_IN);
+		}
+		mutex_unlock(&fc->dev_mutex);
+		end_bg_requests(fc);
 		wake_up_all(&fc->blocked_waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	}
-	spin_unlock(&fc->lock);
+}
+
+/*
+ * Lock two devices in address order
+ */
+static void double_lock_dev(struct fuse_dev *a, struct fuse_dev *b)
+{
+	if (a > b)
+		swap(a, b);
+	spin_lock(&a->lock);
+	spin_lock_nested(&b->lock, SINGLE_DEPTH_NESTING);
+}
+
+static void double_unlock_dev(struct fuse_dev *a, struct fuse_dev *b)
+{
+	spin_unlock(&a->lock);
+	spin_unlock(&b->lock);
+}
+
+/*
+ * Move the first pending request of a device being released over to
+ * another device of the connection.  Returns zero if there was no
+ * request left to move, or if it could not be moved and was finished
+ * instead.
+ */
+static int fuse_dev_migrate_one(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_dev *to;
+	struct fuse_req *req;
+
+	rcu_read_lock();
+	to = fuse_dev_pick(fc);
+	if (to)
+		fuse_dev_get(to);
+	rcu_read_unlock();
+
+	if (!to)
+		return 0;
+
+	double_lock_dev(fud, to);
+	if (list_empty(&fud->pending)) {
+		double_unlock_dev(fud, to);
+		fuse_dev_put(to);
+		return 0;
+	}
+	req = list_entry(fud->pending.next, struct fuse_req, list);
+	if (!to->connected) {
+		spin_unlock(&to->lock);
+		fuse_dev_put(to);
+		req->out.h.error = -ECONNABORTED;
+		request_end(fc, req);
+		return 1;
+	}
+	list_del(&req->list);
+	/* The reference taken on 'to' passes to the request */
+	rcu_assign_pointer(req->fud, to);
+	__queue_request(to, req);
+	double_unlock_dev(fud, to);
+	fuse_dev_put(fud);
+
+	return 1;
 }
 
 static int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_conn *fc;
+	int last;
+
+	if (!fud)
+		return 0;
+
+	fc = fud->fc;
+	mutex_lock(&fc->dev_mutex);
+	list_del_rcu(&fud->entry);
+	fc->num_devs--;
+	fuse_dev_remap(fc);
+	last = !fc->num_devs;
+	if (last) {
 		spin_lock(&fc->lock);
 		fc->connected = 0;
-		end_requests(fc, &fc->pending);
-		end_requests(fc, &fc->processing);
 		spin_unlock(&fc->lock);
-		fuse_conn_put(fc);
 	}
+	mutex_unlock(&fc->dev_mutex);
+
+	/* Wait for queue_request() callers which may still see this device */
+	synchronize_rcu();
+
+	spin_lock(&fud->lock);
+	fud->connected = 0;
+	end_requests(fud, &fud->processing);
+	spin_unlock(&fud->lock);
+
+	/* Requests not yet read are handed over to the remaining devices */
+	while (!last && fuse_dev_migrate_one(fud))
+		;
+
+	spin_lock(&fud->lock);
+	end_requests(fud, &fud->pending);
+	spin_unlock(&fud->lock);
+
+	if (last)
+		end_bg_requests(fc);
+
+	fuse_dev_put(fud);
 
 	return 0;
 }
 
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fc->fasync);
+	return fasync_helper(fd, file, on, &fud->fasync);
+}
+
+/*
+ * Attach another device to the connection, so that the filesystem
+ * daemon can serve it from several threads with separate queues.
+ */
+static int fuse_dev_clone(struct fuse_conn *fc, struct file *new)
+{
+	struct fuse_dev *fud;
+	int err;
+
+	mutex_lock(&fuse_mutex);
+	err = -EINVAL;
+	if (new->private_data)
+		goto out_unlock;
+
+	mutex_lock(&fc->dev_mutex);
+	err = -ENODEV;
+	if (fc->connected) {
+		err = -ENOMEM;
+		fud = __fuse_dev_alloc(fc);
+		if (fud) {
+			new->private_data = fud;
+			err = 0;
+		}
+	}
+	mutex_unlock(&fc->dev_mutex);
+
+ out_unlock:
+	mutex_unlock(&fuse_mutex);
+	return err;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct file *old;
+	struct fuse_conn *fc;
+	u32 oldfd;
+	int err;
+
+	if (cmd != FUSE_DEV_IOC_CLONE)
+		return -ENOTTY;
+
+	if (get_user(oldfd, (u32 __user *) arg))
+		return -EFAULT;
+
+	old = fget(oldfd);
+	if (!old)
+		return -EINVAL;
+
+	err = -EINVAL;
+	fc = NULL;
+	if (old->f_op == file->f_op)
+		fc = fuse_get_conn(old);
+	if (fc)
+		err = fuse_dev_clone(fc, file);
+	fput(old);
+
+	return err;
 }
 
 const struct file_operations fuse_dev_operations = {
@@ -1143,11 +1861,15 @@ const struct file_operations fuse_dev_operations = {
 	.llseek		= no_llseek,
 	.read		= do_sync_read,
 	.aio_read	= fuse_dev_read,
+	.splice_read	= fuse_dev_splice_read,
 	.write		= do_sync_write,
 	.aio_write	= fuse_dev_write,
+	.splice_write	= fuse_dev_splice_write,
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 
 static struct miscdevice fuse_miscdevice = {
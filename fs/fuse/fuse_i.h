@@ -21,6 +21,7 @@
 #include <linux/rwsem.h>
 #include <linux/rbtree.h>
 #include <linux/poll.h>
+#include <linux/pipe_fs_i.h>
 
 /** Max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
@@ -40,6 +41,10 @@
 /** Number of dentries for each connection in the control filesystem */
 #define FUSE_CTL_NUM_DENTRIES 3
 
+/** Largest write that fits in a pipe when spliced: one buffer for the
+    headers and data that may start in the middle of a page */
+#define FUSE_SPLICE_MAX_WRITE ((PIPE_BUFFERS - 2) * PAGE_SIZE)
+
 /** If the FUSE_DEFAULT_PERMISSIONS flag is given, the filesystem
     module will check permissions based on the file mode.  Otherwise no
     permission checking is done in the kernel */
@@ -186,13 +191,14 @@ enum fuse_req_state {
 };
 
 struct fuse_conn;
+struct fuse_dev;
 
 /**
  * A request to the client
  */
 struct fuse_req {
 	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	    fuse_dev */
 	struct list_head list;
 
 	/** Entry on the interrupts list  */
@@ -204,10 +210,13 @@ struct fuse_req {
 	/** Unique ID for the interrupt request */
 	u64 intr_unique;
 
+	/** Device the request is queued on, holds a reference */
+	struct fuse_dev *fud;
+
 	/*
 	 * The following bitfields are either set once before the
 	 * request is queued or setting/clearing them is protected by
-	 * fuse_conn->lock
+	 * fuse_dev->lock
 	 */
 
 	/** True if the request has reply */
@@ -289,6 +298,58 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/**
+ * A Fuse device queue.
+ *
+ * Each open of /dev/fuse attached to a connection (the one passed to
+ * mount and any cloned with FUSE_DEV_IOC_CLONE) has its own request
+ * queues and lock, so that daemon threads each serving their own
+ * device do not contend with each other.  New requests are queued on
+ * the device serving the submitting CPU.  Replies must be written to
+ * the device the request was read from.
+ */
+struct fuse_dev {
+	/** The connection this device belongs to */
+	struct fuse_conn *fc;
+
+	/** Lock protecting the lists below and the state of requests
+	    queued on them */
+	spinlock_t lock;
+
+	/** Refcount: the device file and each queued request */
+	atomic_t count;
+
+	/** Cleared on device release and connection abort */
+	unsigned connected;
+
+	/** Readers of the device are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** The list of requests being processed */
+	struct list_head processing;
+
+	/** The list of requests under I/O */
+	struct list_head io;
+
+	/** Pending interrupts */
+	struct list_head interrupts;
+
+	/** The next unique request id */
+	u64 reqctr;
+
+	/** O_ASYNC requests */
+	struct fasync_struct *fasync;
+
+	/** Entry on fc->devices */
+	struct list_head entry;
+
+	/** Deferred freeing, lockless lookups may still see the device */
+	struct rcu_head rcu;
+};
+
 /**
  * A Fuse connection.
  *
@@ -321,17 +382,21 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
+	/** Requests are read through splice, max_write is limited to
+	    FUSE_SPLICE_MAX_WRITE */
+	unsigned splice_read;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Devices serving this connection (RCU list) */
+	struct list_head devices;
 
-	/** The list of requests being processed */
-	struct list_head processing;
+	/** Device serving each CPU, NULL if there are none left */
+	struct fuse_dev **dev_map;
 
-	/** The list of requests under I/O */
-	struct list_head io;
+	/** Number of devices on the devices list */
+	unsigned num_devs;
+
+	/** Mutex protecting changes to the devices list and dev_map */
+	struct mutex dev_mutex;
 
 	/** The next unique kernel file handle */
 	u64 khctr;
@@ -348,9 +413,6 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
-	struct list_head interrupts;
-
 	/** Flag indicating if connection is blocked.  This will be
 	    the case before the INIT reply is received, and if there
 	    are too many outstading backgrounds requests */
@@ -362,9 +424,6 @@ struct fuse_conn {
 	/** waitq for reserved requests */
 	wait_queue_head_t reserved_req_waitq;
 
-	/** The next unique request id */
-	u64 reqctr;
-
 	/** Connection established, cleared on umount, connection
 	    abort and device release */
 	unsigned connected;
@@ -454,9 +513,6 @@ struct fuse_conn {
 	/** number of dentries used in the above array */
 	int ctl_ndents;
 
-	/** O_ASYNC requests */
-	struct fasync_struct *fasync;
-
 	/** Key for lock owner ID scrambling */
 	u32 scramble_key[4];
 
@@ -640,6 +696,16 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 /* Abort all requests */
 void fuse_abort_conn(struct fuse_conn *fc);
 
+/**
+ * Attach the first device to a new connection
+ */
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
+
+/**
+ * Disconnect the connection's devices and wake up their readers
+ */
+void fuse_dev_disconnect(struct fuse_conn *fc);
+
 /**
  * Invalidate inode attributes
  */
@@ -284,8 +284,7 @@ static void fuse_put_super(struct super_block *sb)
 	fc->blocked = 0;
 	spin_unlock(&fc->lock);
 	/* Flush all readers on this fs */
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
-	wake_up_all(&fc->waitq);
+	fuse_dev_disconnect(fc);
 	wake_up_all(&fc->blocked_waitq);
 	wake_up_all(&fc->reserved_req_waitq);
 	mutex_lock(&fuse_mutex);
@@ -468,16 +467,16 @@ int fuse_conn_init(struct fuse_conn *fc, struct super_block *sb)
 	int err;
 
 	memset(fc, 0, sizeof(*fc));
+	fc->dev_map = kcalloc(nr_cpu_ids, sizeof(fc->dev_map[0]), GFP_KERNEL);
+	if (!fc->dev_map)
+		return -ENOMEM;
 	spin_lock_init(&fc->lock);
 	mutex_init(&fc->inst_mutex);
+	mutex_init(&fc->dev_mutex);
 	atomic_set(&fc->count, 1);
-	init_waitqueue_head(&fc->waitq);
 	init_waitqueue_head(&fc->blocked_waitq);
 	init_waitqueue_head(&fc->reserved_req_waitq);
-	INIT_LIST_HEAD(&fc->pending);
-	INIT_LIST_HEAD(&fc->processing);
-	INIT_LIST_HEAD(&fc->io);
-	INIT_LIST_HEAD(&fc->interrupts);
+	INIT_LIST_HEAD(&fc->devices);
 	INIT_LIST_HEAD(&fc->bg_queue);
 	INIT_LIST_HEAD(&fc->entry);
 	atomic_set(&fc->num_waiting, 0);
@@ -512,7 +511,6 @@ int fuse_conn_init(struct fuse_conn *fc, struct super_block *sb)
 	 *    /sys/class/bdi/<bdi>/max_ratio
 	 */
 	bdi_set_max_ratio(&fc->bdi, 1);
-	fc->reqctr = 0;
 	fc->blocked = 1;
 	fc->attr_version = 1;
 	get_random_bytes(&fc->scramble_key, sizeof(fc->scramble_key));
@@ -522,7 +520,9 @@ int fuse_conn_init(struct fuse_conn *fc, struct super_block *sb)
  error_bdi_destroy:
 	bdi_destroy(&fc->bdi);
  error_mutex_destroy:
+	mutex_destroy(&fc->dev_mutex);
 	mutex_destroy(&fc->inst_mutex);
+	kfree(fc->dev_map);
 	return err;
 }
 EXPORT_SYMBOL_GPL(fuse_conn_init);
@@ -532,7 +532,9 @@ void fuse_conn_put(struct fuse_conn *fc)
 	if (atomic_dec_and_test(&fc->count)) {
 		if (fc->destroy_req)
 			fuse_request_free(fc->destroy_req);
+		mutex_destroy(&fc->dev_mutex);
 		mutex_destroy(&fc->inst_mutex);
+		kfree(fc->dev_map);
 		fc->release(fc);
 	}
 }
@@ -759,6 +761,9 @@ static void process_init_reply(struct fuse_conn *fc, struct fuse_req *req)
 		fc->minor = arg->minor;
 		fc->max_write = arg->minor < 5 ? 4096 : arg->max_write;
 		fc->max_write = max_t(unsigned, 4096, fc->max_write);
+		if (fc->splice_read)
+			fc->max_write = min_t(unsigned, fc->max_write,
+					      FUSE_SPLICE_MAX_WRITE);
 		fc->conn_init = 1;
 	}
 	fc->blocked = 0;
@@ -802,6 +807,7 @@ static int fuse_fill_super(struct super_block *sb, void *data, int silent)
 	struct file *file;
 	struct dentry *root_dentry;
 	struct fuse_req *init_req;
+	struct fuse_dev *fud;
 	int err;
 	int is_bdev = sb->s_bdev != NULL;
 
@@ -885,10 +891,17 @@ static int fuse_fill_super(struct super_block *sb, void *data, int silent)
 	if (err)
 		goto err_unlock;
 
+	fud = fuse_dev_alloc(fc);
+	err = -ENOMEM;
+	if (!fud) {
+		fuse_ctl_remove_conn(fc);
+		goto err_unlock;
+	}
+
 	list_add_tail(&fc->entry, &fuse_conn_list);
 	sb->s_root = root_dentry;
 	fc->connected = 1;
-	file->private_data = fuse_conn_get(fc);
+	file->private_data = fud;
 	mutex_unlock(&fuse_mutex);
 	/*
 	 * atomic_dec_and_test() in fput() provides the necessary
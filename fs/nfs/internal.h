@@ -9,13 +9,12 @@
 
 struct nfs_string;
 
-/* Maximum number of readahead requests
- * FIXME: this should really be a sysctl so that users may tune it to suit
- *        their needs. People that do NFS over a slow network, might for
- *        instance want to reduce it to something closer to 1 for improved
- *        interactive response.
+/* Initial number of readahead requests.  The window is scaled from
+ * there by nfs_readahead_sample() to cover the bandwidth-delay product
+ * of the path to the server, up to NFS_MAX_READAHEAD_BYTES.
  */
 #define NFS_MAX_READAHEAD	(RPC_DEF_SLOT_TABLE - 1)
+#define NFS_MAX_READAHEAD_BYTES	(32UL << 20)
 
 struct nfs_clone_mount {
 	const struct super_block *sb;
@@ -327,6 +327,78 @@ out_bad:
 	return ret;
 }
 
+/*
+ * Adaptive readahead.
+ *
+ * A fixed readahead window of NFS_MAX_READAHEAD requests is fine on a
+ * LAN, but over a long fat pipe it cannot keep enough READs in flight
+ * to fill the path.  We sample the READ throughput over short periods
+ * and track the lowest round trip time seen recently, and size the
+ * window at twice their product.  While the window is the bottleneck
+ * the measured rate is roughly window/rtt, so the window doubles each
+ * period; once the path saturates the rate stops growing and the
+ * window settles at twice the real bandwidth-delay product.  Using the
+ * minimum rtt keeps queueing delay from inflating the estimate.
+ */
+#define NFS_RA_SAMPLE_PERIOD	(HZ / 4)
+#define NFS_RA_RTT_EXPIRE	(10 * HZ)
+
+static void nfs_readahead_sample(struct nfs_server *server,
+		struct rpc_task *task, unsigned int count)
+{
+	unsigned long now = jiffies;
+	unsigned long elapsed, pages, max_pages;
+	u64 rate, bdp;
+
+	spin_lock(&server->ra_lock);
+	if (task->tk_rtt < server->ra_min_rtt ||
+	    time_after(now, server->ra_rtt_stamp + NFS_RA_RTT_EXPIRE)) {
+		server->ra_min_rtt = task->tk_rtt;
+		server->ra_rtt_stamp = now;
+	}
+	server->ra_window_bytes += count;
+	elapsed = now - server->ra_window_start;
+	if (elapsed < NFS_RA_SAMPLE_PERIOD) {
+		spin_unlock(&server->ra_lock);
+		return;
+	}
+
+	rate = (u64)server->ra_window_bytes * HZ;
+	do_div(rate, elapsed);
+	if (server->ra_rate != 0)
+		rate = (server->ra_rate * 3 + rate) >> 2;
+	server->ra_rate = rate;
+	server->ra_window_start = now;
+	server->ra_window_bytes = 0;
+
+	bdp = rate * server->ra_min_rtt * 2;
+	do_div(bdp, HZ);
+	spin_unlock(&server->ra_lock);
+
+	max_pages = max(NFS_MAX_READAHEAD_BYTES >> PAGE_CACHE_SHIFT,
+			server->ra_min_pages);
+	pages = min_t(u64, bdp >> PAGE_CACHE_SHIFT, max_pages);
+	if (pages < server->ra_min_pages)
+		pages = server->ra_min_pages;
+	if (pages != server->backing_dev_info.ra_pages) {
+		dprintk("NFS: %s: readahead %lu pages (rate %llu, rtt %lu)\n",
+				server->nfs_client->cl_hostname, pages,
+				(unsigned long long)rate, server->ra_min_rtt);
+		server->backing_dev_info.ra_pages = pages;
+	}
+}
+
+/*
+ * Open files pick up bdi->ra_pages only at open time, so propagate the
+ * current estimate into the file's readahead state.  Files that have
+ * readahead switched off (POSIX_FADV_RANDOM) are left alone.
+ */
+static void nfs_readahead_scale(struct file *filp, struct nfs_server *server)
+{
+	if (filp != NULL && filp->f_ra.ra_pages != 0)
+		filp->f_ra.ra_pages = server->backing_dev_info.ra_pages;
+}
+
 /*
  * This is the callback from RPC telling us whether a reply was
  * received or some error occurred (timeout or socket shutdown).
@@ -343,6 +415,9 @@ int nfs_readpage_result(struct rpc_task *task, struct nfs_read_data *data)
 		return status;
 
 	nfs_add_stats(data->inode, NFSIOS_SERVERREADBYTES, data->res.count);
+	if (task->tk_status >= 0)
+		nfs_readahead_sample(NFS_SERVER(data->inode), task,
+				data->res.count);
 
 	if (task->tk_status == -ESTALE) {
 		set_bit(NFS_INO_STALE, &NFS_I(data->inode)->flags);
@@ -591,6 +666,8 @@ int nfs_readpages(struct file *filp, struct address_space *mapping,
 	if (NFS_STALE(inode))
 		goto out;
 
+	nfs_readahead_scale(filp, server);
+
 	if (filp == NULL) {
 		desc.ctx = nfs_find_open_context(inode, NULL, FMODE_READ);
 		if (desc.ctx == NULL)
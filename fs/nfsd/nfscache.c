@@ -16,56 +16,129 @@
 #include <linux/string.h>
 #include <linux/spinlock.h>
 #include <linux/list.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <net/checksum.h>
 
 #include <linux/sunrpc/svc.h>
 #include <linux/nfsd/nfsd.h>
 #include <linux/nfsd/cache.h>
 
-/* Size of reply cache. Common values are:
- * 4.3BSD:	128
- * 4.4BSD:	256
- * Solaris2:	1024
- * DEC Unix:	512-4096
+/*
+ * The cache is a hash table of buckets, each with its own lock and its
+ * own LRU list.  The LRU list doubles as the hash chain: it is short,
+ * and the entries we look for are usually the most recent ones.
+ *
+ * The number of entries scales with the amount of RAM (the BSD servers
+ * used a fixed 128 to 4096), and the number of buckets is chosen to
+ * keep about TARGET_BUCKET_SIZE entries in each.  Entries are allocated
+ * on demand and freed once they are older than RC_EXPIRE or the cache
+ * has grown past its limit.
  */
-#define CACHESIZE		1024
-#define HASHSIZE		64
-#define REQHASH(xid)		(((((__force __u32)xid) >> 24) ^ ((__force __u32)xid)) & (HASHSIZE-1))
+#define TARGET_BUCKET_SIZE	64
+#define MIN_DRC_ENTRIES		1024
+#define MAX_DRC_ENTRIES		(256 * 1024)
+
+/* Number of request bytes included in the entry checksum */
+#define RC_CSUMLEN		256U
+
+/* Entries older than this are never replayed and may be reclaimed */
+#define RC_EXPIRE		(120 * HZ)
 
-static struct hlist_head *	hash_list;
-static struct list_head 	lru_head;
+struct nfsd_drc_bucket {
+	struct list_head	lru_head;
+	spinlock_t		cache_lock;
+} ____cacheline_aligned_in_smp;
+
+/*
+ * Lookups on different buckets run in parallel, so the counters are
+ * per cpu.  They are only updated under a bucket lock, which keeps us
+ * on the cpu.
+ */
+struct nfsd_drc_stats {
+	unsigned int		hits;
+	unsigned int		misses;
+	unsigned int		lockwait;	/* bucket lock contended */
+	unsigned int		csumfail;	/* xid matched, checksum did not */
+};
+
+static DEFINE_PER_CPU(struct nfsd_drc_stats, drc_stats);
+
+static struct nfsd_drc_bucket	*drc_hashtbl;
+static unsigned int		drc_hashsize;
+static unsigned int		maskbits;
+static unsigned int		max_drc_entries;
+static atomic_t			num_drc_entries;
+static struct kmem_cache	*drc_slab;
 static int			cache_disabled = 1;
 
 static int	nfsd_cache_append(struct svc_rqst *rqstp, struct kvec *vec);
 
 /* 
  * locking for the reply cache:
- * A cache entry is "single use" if c_state == RC_INPROG
- * Otherwise, it when accessing _prev or _next, the lock must be held.
+ * Each bucket's list is protected by its cache_lock.  A cache entry is
+ * "single use" if c_state == RC_INPROG: only the thread that created it
+ * touches its contents, but the bucket lock is still needed to unlink
+ * it or move it on the LRU list.
  */
-static DEFINE_SPINLOCK(cache_lock);
 
-int nfsd_reply_cache_init(void)
+/*
+ * Size the cache at 16 entries per square root of low memory in
+ * kilobytes, which gives 16k entries for 1GB and hits the limit at
+ * 256GB.  Entries come from lowmem, so highmem does not count.
+ */
+static unsigned int nfsd_cache_size_limit(void)
 {
-	struct svc_cacherep	*rp;
-	int			i;
-
-	INIT_LIST_HEAD(&lru_head);
-	i = CACHESIZE;
-	while (i) {
-		rp = kmalloc(sizeof(*rp), GFP_KERNEL);
-		if (!rp)
-			goto out_nomem;
-		list_add(&rp->c_lru, &lru_head);
-		rp->c_state = RC_UNUSED;
-		rp->c_type = RC_NOCACHE;
-		INIT_HLIST_NODE(&rp->c_hash);
-		i--;
+	unsigned long lowmem_kb;
+	unsigned int limit;
+
+	lowmem_kb = (unsigned long)nr_free_buffer_pages() << (PAGE_SHIFT - 10);
+	limit = 16 * int_sqrt(lowmem_kb);
+	return clamp_t(unsigned int, limit, MIN_DRC_ENTRIES, MAX_DRC_ENTRIES);
+}
+
+static struct nfsd_drc_bucket *
+nfsd_cache_bucket_find(__be32 xid)
+{
+	return &drc_hashtbl[hash_32(be32_to_cpu(xid), maskbits)];
+}
+
+static inline void
+nfsd_cache_lock(struct nfsd_drc_bucket *b)
+{
+	if (!spin_trylock(&b->cache_lock)) {
+		spin_lock(&b->cache_lock);
+		__get_cpu_var(drc_stats).lockwait++;
 	}
+}
+
+int nfsd_reply_cache_init(void)
+{
+	unsigned int		i;
 
-	hash_list = kcalloc (HASHSIZE, sizeof(struct hlist_head), GFP_KERNEL);
-	if (!hash_list)
+	max_drc_entries = nfsd_cache_size_limit();
+	drc_hashsize = roundup_pow_of_two(max_drc_entries /
+					  TARGET_BUCKET_SIZE);
+	maskbits = ilog2(drc_hashsize);
+	atomic_set(&num_drc_entries, 0);
+
+	drc_slab = kmem_cache_create("nfsd_drc", sizeof(struct svc_cacherep),
+				     0, 0, NULL);
+	if (!drc_slab)
 		goto out_nomem;
 
+	drc_hashtbl = kcalloc(drc_hashsize, sizeof(*drc_hashtbl), GFP_KERNEL);
+	if (!drc_hashtbl)
+		goto out_nomem;
+	for (i = 0; i < drc_hashsize; i++) {
+		INIT_LIST_HEAD(&drc_hashtbl[i].lru_head);
+		spin_lock_init(&drc_hashtbl[i].cache_lock);
+	}
+
 	cache_disabled = 0;
 	return 0;
 out_nomem:
@@ -74,59 +147,161 @@ out_nomem:
 	return -ENOMEM;
 }
 
+static void
+nfsd_reply_cache_free_locked(struct svc_cacherep *rp)
+{
+	if (rp->c_type == RC_REPLBUFF)
+		kfree(rp->c_replvec.iov_base);
+	list_del(&rp->c_lru);
+	atomic_dec(&num_drc_entries);
+	kmem_cache_free(drc_slab, rp);
+}
+
+static void
+nfsd_reply_cache_free(struct svc_cacherep *rp)
+{
+	struct nfsd_drc_bucket *b = nfsd_cache_bucket_find(rp->c_xid);
+
+	nfsd_cache_lock(b);
+	nfsd_reply_cache_free_locked(rp);
+	spin_unlock(&b->cache_lock);
+}
+
 void nfsd_reply_cache_shutdown(void)
 {
 	struct svc_cacherep	*rp;
+	unsigned int		i;
 
-	while (!list_empty(&lru_head)) {
-		rp = list_entry(lru_head.next, struct svc_cacherep, c_lru);
-		if (rp->c_state == RC_DONE && rp->c_type == RC_REPLBUFF)
-			kfree(rp->c_replvec.iov_base);
-		list_del(&rp->c_lru);
-		kfree(rp);
+	cache_disabled = 1;
+
+	if (drc_hashtbl) {
+		for (i = 0; i < drc_hashsize; i++) {
+			struct list_head *head = &drc_hashtbl[i].lru_head;
+
+			while (!list_empty(head)) {
+				rp = list_first_entry(head, struct svc_cacherep,
+						      c_lru);
+				nfsd_reply_cache_free_locked(rp);
+			}
+		}
 	}
 
-	cache_disabled = 1;
+	kfree(drc_hashtbl);
+	drc_hashtbl = NULL;
+	drc_hashsize = 0;
 
-	kfree (hash_list);
-	hash_list = NULL;
+	if (drc_slab) {
+		kmem_cache_destroy(drc_slab);
+		drc_slab = NULL;
+	}
 }
 
 /*
  * Move cache entry to end of LRU list
  */
 static void
-lru_put_end(struct svc_cacherep *rp)
+lru_put_end(struct nfsd_drc_bucket *b, struct svc_cacherep *rp)
 {
-	list_move_tail(&rp->c_lru, &lru_head);
+	rp->c_timestamp = jiffies;
+	list_move_tail(&rp->c_lru, &b->lru_head);
 }
 
 /*
- * Move a cache entry from one hash list to another
+ * Free expired entries from the head of the bucket's LRU list, and the
+ * oldest ones regardless of age while the cache is over its limit.
  */
 static void
-hash_refile(struct svc_cacherep *rp)
+prune_bucket(struct nfsd_drc_bucket *b)
 {
-	hlist_del_init(&rp->c_hash);
-	hlist_add_head(&rp->c_hash, hash_list + REQHASH(rp->c_xid));
+	struct svc_cacherep *rp, *tmp;
+
+	list_for_each_entry_safe(rp, tmp, &b->lru_head, c_lru) {
+		if (rp->c_state == RC_INPROG)
+			continue;
+		if (atomic_read(&num_drc_entries) <= max_drc_entries &&
+		    time_before(jiffies, rp->c_timestamp + RC_EXPIRE))
+			break;
+		nfsd_reply_cache_free_locked(rp);
+	}
 }
 
 /*
- * Try to find an entry matching the current call in the cache. When none
- * is found, we grab the oldest unlocked entry off the LRU list.
- * Note that no operation within the loop may sleep.
+ * Checksum the first RC_CSUMLEN bytes of the call body, so that a new
+ * call which happens to reuse the xid of a cached one (a client that
+ * rebooted, or one that wraps its xids quickly) is not answered with
+ * the old reply.
  */
-int
-nfsd_cache_lookup(struct svc_rqst *rqstp, int type)
+static __wsum
+nfsd_cache_csum(struct svc_rqst *rqstp)
+{
+	struct xdr_buf *buf = &rqstp->rq_arg;
+	const unsigned char *p = buf->head[0].iov_base;
+	size_t csum_len = min_t(size_t, buf->head[0].iov_len + buf->page_len,
+				RC_CSUMLEN);
+	size_t len = min_t(size_t, buf->head[0].iov_len, csum_len);
+	unsigned int base, idx;
+	__wsum csum;
+
+	csum = csum_partial(p, len, 0);
+	csum_len -= len;
+
+	idx = buf->page_base >> PAGE_SHIFT;
+	base = buf->page_base & ~PAGE_MASK;
+	while (csum_len) {
+		p = page_address(buf->pages[idx]) + base;
+		len = min_t(size_t, PAGE_SIZE - base, csum_len);
+		csum = csum_partial(p, len, csum);
+		csum_len -= len;
+		base = 0;
+		idx++;
+	}
+	return csum;
+}
+
+/*
+ * Search a bucket for an entry matching the current call.  Must be
+ * called with the bucket lock held.
+ */
+static struct svc_cacherep *
+nfsd_cache_search(struct nfsd_drc_bucket *b, struct svc_rqst *rqstp,
+		  __wsum csum)
 {
-	struct hlist_node	*hn;
-	struct hlist_head 	*rh;
 	struct svc_cacherep	*rp;
 	__be32			xid = rqstp->rq_xid;
 	u32			proto =  rqstp->rq_prot,
 				vers = rqstp->rq_vers,
 				proc = rqstp->rq_proc;
+
+	list_for_each_entry(rp, &b->lru_head, c_lru) {
+		if (rp->c_state == RC_UNUSED ||
+		    xid != rp->c_xid || proc != rp->c_proc ||
+		    proto != rp->c_prot || vers != rp->c_vers ||
+		    !time_before(jiffies, rp->c_timestamp + RC_EXPIRE) ||
+		    memcmp((char*)&rqstp->rq_addr, (char*)&rp->c_addr,
+			   sizeof(rp->c_addr)) != 0)
+			continue;
+		if (csum != rp->c_csum || rqstp->rq_arg.len != rp->c_len) {
+			__get_cpu_var(drc_stats).csumfail++;
+			continue;
+		}
+		return rp;
+	}
+	return NULL;
+}
+
+/*
+ * Try to find an entry matching the current call in the cache. When none
+ * is found, a new entry is added for the call.
+ * Note that no operation under the bucket lock may sleep.
+ */
+int
+nfsd_cache_lookup(struct svc_rqst *rqstp, int type)
+{
+	struct nfsd_drc_bucket	*b;
+	struct svc_cacherep	*rp, *found;
+	__be32			xid = rqstp->rq_xid;
 	unsigned long		age;
+	__wsum			csum;
 	int rtn;
 
 	rqstp->rq_cacherep = NULL;
@@ -135,74 +310,69 @@ nfsd_cache_lookup(struct svc_rqst *rqstp, int type)
 		return RC_DOIT;
 	}
 
-	spin_lock(&cache_lock);
-	rtn = RC_DOIT;
+	csum = nfsd_cache_csum(rqstp);
+	b = nfsd_cache_bucket_find(xid);
 
-	rh = &hash_list[REQHASH(xid)];
-	hlist_for_each_entry(rp, hn, rh, c_hash) {
-		if (rp->c_state != RC_UNUSED &&
-		    xid == rp->c_xid && proc == rp->c_proc &&
-		    proto == rp->c_prot && vers == rp->c_vers &&
-		    time_before(jiffies, rp->c_timestamp + 120*HZ) &&
-		    memcmp((char*)&rqstp->rq_addr, (char*)&rp->c_addr, sizeof(rp->c_addr))==0) {
-			nfsdstats.rchits++;
-			goto found_entry;
-		}
-	}
-	nfsdstats.rcmisses++;
-
-	/* This loop shouldn't take more than a few iterations normally */
-	{
-	int	safe = 0;
-	list_for_each_entry(rp, &lru_head, c_lru) {
-		if (rp->c_state != RC_INPROG)
-			break;
-		if (safe++ > CACHESIZE) {
-			printk("nfsd: loop in repcache LRU list\n");
-			cache_disabled = 1;
-			goto out;
-		}
-	}
+	/* Allocate up front: we cannot sleep once we hold the lock */
+	rp = kmem_cache_alloc(drc_slab, GFP_KERNEL);
+	if (rp) {
+		rp->c_state = RC_UNUSED;
+		rp->c_type = RC_NOCACHE;
+		INIT_LIST_HEAD(&rp->c_lru);
 	}
 
-	/* This should not happen */
-	if (rp == NULL) {
-		static int	complaints;
+	nfsd_cache_lock(b);
+	rtn = RC_DOIT;
 
-		printk(KERN_WARNING "nfsd: all repcache entries locked!\n");
-		if (++complaints > 5) {
-			printk(KERN_WARNING "nfsd: disabling repcache.\n");
-			cache_disabled = 1;
+	found = nfsd_cache_search(b, rqstp, csum);
+	if (found) {
+		__get_cpu_var(drc_stats).hits++;
+		if (rp)
+			kmem_cache_free(drc_slab, rp);
+		rp = found;
+		goto found_entry;
+	}
+	__get_cpu_var(drc_stats).misses++;
+
+	if (!rp) {
+		/* No memory: reuse the oldest idle entry of this bucket */
+		list_for_each_entry(rp, &b->lru_head, c_lru)
+			if (rp->c_state != RC_INPROG)
+				break;
+		if (&rp->c_lru == &b->lru_head)
+			goto out;
+		list_del_init(&rp->c_lru);
+		atomic_dec(&num_drc_entries);
+		/* release any buffer */
+		if (rp->c_type == RC_REPLBUFF) {
+			kfree(rp->c_replvec.iov_base);
+			rp->c_replvec.iov_base = NULL;
 		}
-		goto out;
 	}
 
 	rqstp->rq_cacherep = rp;
 	rp->c_state = RC_INPROG;
 	rp->c_xid = xid;
-	rp->c_proc = proc;
+	rp->c_proc = rqstp->rq_proc;
 	memcpy(&rp->c_addr, svc_addr_in(rqstp), sizeof(rp->c_addr));
-	rp->c_prot = proto;
-	rp->c_vers = vers;
+	rp->c_prot = rqstp->rq_prot;
+	rp->c_vers = rqstp->rq_vers;
+	rp->c_csum = csum;
+	rp->c_len = rqstp->rq_arg.len;
 	rp->c_timestamp = jiffies;
-
-	hash_refile(rp);
-
-	/* release any buffer */
-	if (rp->c_type == RC_REPLBUFF) {
-		kfree(rp->c_replvec.iov_base);
-		rp->c_replvec.iov_base = NULL;
-	}
 	rp->c_type = RC_NOCACHE;
+
+	list_add_tail(&rp->c_lru, &b->lru_head);
+	atomic_inc(&num_drc_entries);
+	prune_bucket(b);
  out:
-	spin_unlock(&cache_lock);
+	spin_unlock(&b->cache_lock);
 	return rtn;
 
 found_entry:
 	/* We found a matching entry which is either in progress or done. */
 	age = jiffies - rp->c_timestamp;
-	rp->c_timestamp = jiffies;
-	lru_put_end(rp);
+	lru_put_end(b, rp);
 
 	rtn = RC_DROPIT;
 	/* Request being processed or excessive rexmits */
@@ -230,7 +400,7 @@ found_entry:
 		break;
 	default:
 		printk(KERN_WARNING "nfsd: bad repcache type %d\n", rp->c_type);
-		rp->c_state = RC_UNUSED;
+		nfsd_reply_cache_free_locked(rp);
 	}
 
 	goto out;
@@ -256,6 +426,7 @@ void
 nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 {
 	struct svc_cacherep *rp;
+	struct nfsd_drc_bucket *b;
 	struct kvec	*resv = &rqstp->rq_res.head[0], *cachv;
 	int		len;
 
@@ -267,7 +438,7 @@ nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 	
 	/* Don't cache excessive amounts of data and XDR failures */
 	if (!statp || len > (256 >> 2)) {
-		rp->c_state = RC_UNUSED;
+		nfsd_reply_cache_free(rp);
 		return;
 	}
 
@@ -281,25 +452,68 @@ nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 		cachv = &rp->c_replvec;
 		cachv->iov_base = kmalloc(len << 2, GFP_KERNEL);
 		if (!cachv->iov_base) {
-			spin_lock(&cache_lock);
-			rp->c_state = RC_UNUSED;
-			spin_unlock(&cache_lock);
+			nfsd_reply_cache_free(rp);
 			return;
 		}
 		cachv->iov_len = len << 2;
 		memcpy(cachv->iov_base, statp, len << 2);
 		break;
 	}
-	spin_lock(&cache_lock);
-	lru_put_end(rp);
+	b = nfsd_cache_bucket_find(rp->c_xid);
+	nfsd_cache_lock(b);
+	lru_put_end(b, rp);
 	rp->c_secure = rqstp->rq_secure;
 	rp->c_type = cachetype;
 	rp->c_state = RC_DONE;
-	rp->c_timestamp = jiffies;
-	spin_unlock(&cache_lock);
+	spin_unlock(&b->cache_lock);
 	return;
 }
 
+static void
+nfsd_cache_sum_stats(struct nfsd_drc_stats *sum)
+{
+	int cpu;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		struct nfsd_drc_stats *s = &per_cpu(drc_stats, cpu);
+
+		sum->hits += s->hits;
+		sum->misses += s->misses;
+		sum->lockwait += s->lockwait;
+		sum->csumfail += s->csumfail;
+	}
+}
+
+/*
+ * Reply cache hits and misses, for the "rc" line of /proc/net/rpc/nfsd.
+ */
+void
+nfsd_reply_cache_hits(unsigned int *hits, unsigned int *misses)
+{
+	struct nfsd_drc_stats sum;
+
+	nfsd_cache_sum_stats(&sum);
+	*hits = sum.hits;
+	*misses = sum.misses;
+}
+
+/*
+ * Reply cache line of /proc/net/rpc/nfsd: current and maximum number
+ * of entries, number of hash buckets, bucket lock contentions and
+ * calls that matched a cached xid but not its checksum.
+ */
+void
+nfsd_reply_cache_show(struct seq_file *seq)
+{
+	struct nfsd_drc_stats sum;
+
+	nfsd_cache_sum_stats(&sum);
+	seq_printf(seq, "drc %u %u %u %u %u\n",
+		   atomic_read(&num_drc_entries), max_drc_entries,
+		   drc_hashsize, sum.lockwait, sum.csumfail);
+}
+
 /*
  * Copy cached reply to current reply buffer. Should always fit.
  * FIXME as reply is in a page, we should just attach the page, and
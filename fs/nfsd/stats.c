@@ -18,6 +18,10 @@
  *	ra cache-size  <10%  <20%  <30% ... <100% not-found
  *			number of times that read-ahead entry was found that deep in
  *			the cache.
+ *	drc <entries> <max-entries> <buckets> <lock-waits> <csum-mismatches>
+ *			size of the reply cache, contention on its bucket
+ *			locks, and retransmit candidates rejected because
+ *			the call body differed
  *	plus generic RPC stats (see net/sunrpc/stats.c)
  *
  * Copyright (C) 1995, 1996, 1997 Olaf Kirch <okir@monad.swb.de>
@@ -34,6 +38,7 @@
 #include <linux/sunrpc/stats.h>
 #include <linux/nfsd/nfsd.h>
 #include <linux/nfsd/stats.h>
+#include <linux/nfsd/cache.h>
 
 struct nfsd_stats	nfsdstats;
 struct svc_stat		nfsd_svcstats = {
@@ -43,10 +48,13 @@ struct svc_stat		nfsd_svcstats = {
 static int nfsd_proc_show(struct seq_file *seq, void *v)
 {
 	int i;
+	unsigned int rchits, rcmisses;
 
+	/* repcache hits and misses are counted in nfscache.c */
+	nfsd_reply_cache_hits(&rchits, &rcmisses);
 	seq_printf(seq, "rc %u %u %u\nfh %u %u %u %u %u\nio %u %u\n",
-		      nfsdstats.rchits,
-		      nfsdstats.rcmisses,
+		      rchits,
+		      rcmisses,
 		      nfsdstats.rcnocache,
 		      nfsdstats.fh_stale,
 		      nfsdstats.fh_lookup,
@@ -68,7 +76,10 @@ static int nfsd_proc_show(struct seq_file *seq, void *v)
 	for (i=0; i<11; i++)
 		seq_printf(seq, " %u", nfsdstats.ra_depth[i]);
 	seq_putc(seq, '\n');
-	
+
+	/* reply cache */
+	nfsd_reply_cache_show(seq);
+
 	/* show my rpc info */
 	svc_seq_show(seq, &nfsd_svcstats);
 
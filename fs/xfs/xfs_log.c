@@ -99,13 +99,6 @@ STATIC void xlog_ungrant_log_space(xlog_t	 *log,
 				   xlog_ticket_t *ticket);
 
 
-/* local ticket functions */
-STATIC xlog_ticket_t	*xlog_ticket_alloc(xlog_t *log,
-					 int	unit_bytes,
-					 int	count,
-					 char	clientid,
-					 uint	flags);
-
 #if defined(DEBUG)
 STATIC void	xlog_verify_dest_ptr(xlog_t *log, __psint_t ptr);
 STATIC void	xlog_verify_grant_head(xlog_t *log, int equals);
@@ -404,6 +397,19 @@ _xfs_log_force(
 
 	XFS_STATS_INC(xs_log_force);
 
+	/*
+	 * On a delaylog mount the caller hands us a checkpoint sequence
+	 * rather than an lsn.  Push the CIL up to that sequence and force
+	 * the iclog holding the checkpoint commit record instead.  If the
+	 * checkpoint has already completed there is nothing left to do.
+	 * A zero lsn still forces everything, after the whole CIL.
+	 */
+	if (log->l_cilp) {
+		lsn = xlog_cil_force_lsn(log, lsn);
+		if (lsn == NULLCOMMITLSN)
+			return XLOG_FORCED_SHUTDOWN(log) ? XFS_ERROR(EIO) : 0;
+	}
+
 	if (log->l_flags & XLOG_IO_ERROR)
 		return XFS_ERROR(EIO);
 	if (lsn == 0)
@@ -514,7 +520,8 @@ xfs_log_reserve(xfs_mount_t	 *mp,
 	} else {
 		/* may sleep if need to allocate more tickets */
 		internal_ticket = xlog_ticket_alloc(log, unit_bytes, cnt,
-						  client, flags);
+						  client, flags,
+						  KM_SLEEP|KM_MAYFAIL);
 		if (!internal_ticket)
 			return XFS_ERROR(ENOMEM);
 		internal_ticket->t_trans_type = t_type;
@@ -567,6 +574,15 @@ xfs_log_mount(
 		goto out;
 	}
 
+	if (mp->m_flags & XFS_MOUNT_DELAYLOG) {
+		error = xlog_cil_init(mp->m_log);
+		if (error) {
+			cmn_err(CE_WARN,
+				"XFS: CIL initialisation failed: error %d", error);
+			goto out_free_log;
+		}
+	}
+
 	/*
 	 * Initialize the AIL now we have a log.
 	 */
@@ -1602,6 +1618,8 @@ xlog_dealloc_log(xlog_t *log)
 	xlog_in_core_t	*iclog, *next_iclog;
 	int		i;
 
+	xlog_cil_destroy(log);
+
 	iclog = log->l_iclog;
 	for (i=0; i<log->l_iclog_bufs; i++) {
 		sv_destroy(&iclog->ic_force_wait);
@@ -1714,7 +1732,9 @@ xlog_print_tic_res(xfs_mount_t *mp, xlog_ticket_t *ticket)
 	    "GROWFSRT_ALLOC",
 	    "GROWFSRT_ZERO",
 	    "GROWFSRT_FREE",
-	    "SWAPEXT"
+	    "SWAPEXT",
+	    "SB_COUNT",
+	    "CHECKPOINT"
 	};
 
 	xfs_fs_cmn_err(CE_WARN, mp,
@@ -3224,17 +3244,18 @@ xfs_log_ticket_get(
 /*
  * Allocate and initialise a new log ticket.
  */
-STATIC xlog_ticket_t *
+xlog_ticket_t *
 xlog_ticket_alloc(xlog_t		*log,
 		int		unit_bytes,
 		int		cnt,
 		char		client,
-		uint		xflags)
+		uint		xflags,
+		unsigned int	alloc_flags)
 {
 	xlog_ticket_t	*tic;
 	uint		num_headers;
 
-	tic = kmem_zone_zalloc(xfs_log_ticket_zone, KM_SLEEP|KM_MAYFAIL);
+	tic = kmem_zone_zalloc(xfs_log_ticket_zone, alloc_flags);
 	if (!tic)
 		return NULL;
 
@@ -3561,6 +3582,15 @@ xfs_log_force_umount(
 		return 1;
 	}
 	retval = 0;
+
+	/*
+	 * If this is not a log error, get the checkpoints sitting in the
+	 * CIL into the iclogs so that they are flushed out below along with
+	 * everything else before the log is sealed off.
+	 */
+	if (!logerror && log->l_cilp)
+		xlog_cil_push(log, 0);
+
 	/*
 	 * We must hold both the GRANT lock and the LOG lock,
 	 * before we mark the filesystem SHUTDOWN and wake
@@ -3628,6 +3658,18 @@ xfs_log_force_umount(
 	 */
 	xlog_state_do_callback(log, XFS_LI_ABORTED, NULL);
 
+	/*
+	 * Wake anyone waiting on a checkpoint commit record, then abort
+	 * whatever is still sitting in the CIL so that its items are
+	 * unpinned.  Pushing a shut down log does exactly that.
+	 */
+	if (log->l_cilp) {
+		spin_lock(&log->l_cilp->xc_cil_lock);
+		sv_broadcast(&log->l_cilp->xc_commit_wait);
+		spin_unlock(&log->l_cilp->xc_cil_lock);
+		xlog_cil_push(log, 0);
+	}
+
 #ifdef XFSERRORDEBUG
 	{
 		xlog_in_core_t	*iclog;
@@ -120,6 +120,23 @@ typedef struct xfs_log_iovec {
 
 typedef void* xfs_log_ticket_t;
 
+/*
+ * Log vector: the formatted copy of a log item held in the CIL on a
+ * delaylog mount.  The regions described by lv_iovecp all point into
+ * lv_buf, so the item itself can be modified again as soon as it has
+ * been unlocked.
+ */
+struct xfs_log_vec {
+	struct list_head	lv_list;	/* CIL lv chain */
+	struct xfs_log_item	*lv_item;	/* owner */
+	xfs_log_iovec_t		*lv_iovecp;	/* iovec array */
+	int			lv_niovecs;	/* number of iovecs in lv */
+	char			*lv_buf;	/* formatted buffer */
+	int			lv_buf_len;	/* size of formatted buffer */
+	int			lv_pincount;	/* pins taken in this chkpt */
+	int			lv_stale;	/* buffer stale at last commit */
+};
+
 /*
  * Structure used to pass callback function and the function's argument
  * to the log manager.
@@ -175,6 +192,12 @@ void      xfs_log_unmount(struct xfs_mount *mp);
 int	  xfs_log_force_umount(struct xfs_mount *mp, int logerror);
 int	  xfs_log_need_covered(struct xfs_mount *mp);
 
+struct xfs_trans;
+void	  xfs_log_commit_cil(struct xfs_mount *mp,
+			     struct xfs_trans *tp,
+			     xfs_lsn_t *commit_lsn,
+			     uint flags);
+
 void	  xlog_iodone(struct xfs_buf *);
 
 struct xlog_ticket * xfs_log_ticket_get(struct xlog_ticket *ticket);
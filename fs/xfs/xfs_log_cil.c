@@ -0,0 +1,535 @@
+/*
+ * Copyright (c) 2000-2005 Silicon Graphics, Inc.
+ * All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write the Free Software Foundation,
+ * Inc.,  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "xfs.h"
+#include "xfs_fs.h"
+#include "xfs_types.h"
+#include "xfs_bit.h"
+#include "xfs_log.h"
+#include "xfs_inum.h"
+#include "xfs_trans.h"
+#include "xfs_sb.h"
+#include "xfs_ag.h"
+#include "xfs_dir2.h"
+#include "xfs_dmapi.h"
+#include "xfs_mount.h"
+#include "xfs_error.h"
+#include "xfs_log_priv.h"
+#include "xfs_trans_priv.h"
+
+/*
+ * Allocate a new checkpoint context.  The ticket does not hold any log
+ * space of its own: its reservation is stolen from the transactions that
+ * are committed into the checkpoint, starting with the overhead of the
+ * checkpoint transaction itself, which the first commit pays for.
+ */
+STATIC struct xfs_cil_ctx *
+xlog_cil_ctx_alloc(
+	xlog_t			*log)
+{
+	struct xfs_cil_ctx	*ctx;
+
+	ctx = kmem_zalloc(sizeof(*ctx), KM_SLEEP|KM_NOFS);
+	ctx->cil = log->l_cilp;
+	INIT_LIST_HEAD(&ctx->lv_list);
+	INIT_LIST_HEAD(&ctx->trans_list);
+	INIT_LIST_HEAD(&ctx->committing);
+
+	ctx->ticket = xlog_ticket_alloc(log, 0, 1, XFS_TRANSACTION, 0,
+					KM_SLEEP|KM_NOFS);
+	ctx->ticket->t_trans_type = XFS_TRANS_CHECKPOINT;
+	ctx->ticket->t_curr_res = 0;
+	return ctx;
+}
+
+STATIC void
+xlog_cil_ctx_free(
+	struct xfs_cil_ctx	*ctx)
+{
+	xfs_log_ticket_put(ctx->ticket);
+	kmem_free(ctx);
+}
+
+STATIC void
+xlog_cil_free_lv(
+	struct xfs_log_vec	*lv)
+{
+	if (lv->lv_buf)
+		kmem_free(lv->lv_buf);
+	kmem_free(lv);
+}
+
+int
+xlog_cil_init(
+	xlog_t			*log)
+{
+	struct xfs_cil		*cil;
+
+	cil = kmem_zalloc(sizeof(*cil), KM_SLEEP|KM_MAYFAIL);
+	if (!cil)
+		return ENOMEM;
+
+	cil->xc_log = log;
+	init_rwsem(&cil->xc_ctx_lock);
+	spin_lock_init(&cil->xc_cil_lock);
+	INIT_LIST_HEAD(&cil->xc_committing);
+	sv_init(&cil->xc_commit_wait, SV_DEFAULT, "cilwait");
+	log->l_cilp = cil;
+
+	cil->xc_ctx = xlog_cil_ctx_alloc(log);
+	cil->xc_ctx->sequence = 1;
+	return 0;
+}
+
+void
+xlog_cil_destroy(
+	xlog_t			*log)
+{
+	struct xfs_cil		*cil = log->l_cilp;
+
+	if (!cil)
+		return;
+
+	ASSERT(list_empty(&cil->xc_ctx->lv_list));
+	ASSERT(list_empty(&cil->xc_committing));
+	xlog_cil_ctx_free(cil->xc_ctx);
+	sv_destroy(&cil->xc_commit_wait);
+	spinlock_destroy(&cil->xc_cil_lock);
+	kmem_free(cil);
+	log->l_cilp = NULL;
+}
+
+/*
+ * Format each dirty item of the transaction into a log vector of its own.
+ * The regions are copied out of the item into the vector's buffer straight
+ * away, as the item may be changed again as soon as the transaction has
+ * unlocked it.  Each item is pinned for this commit just as it would be
+ * when written directly to the iclogs.
+ */
+STATIC void
+xlog_cil_format_items(
+	struct xfs_trans	*tp,
+	struct list_head	*lv_chain)
+{
+	xfs_log_item_desc_t	*lidp;
+
+	for (lidp = xfs_trans_first_item(tp);
+	     lidp != NULL;
+	     lidp = xfs_trans_next_item(tp, lidp)) {
+		struct xfs_log_item	*lip = lidp->lid_item;
+		struct xfs_log_vec	*lv;
+		char			*ptr;
+		int			len = 0;
+		int			i;
+
+		if (!(lidp->lid_flags & XFS_LID_DIRTY))
+			continue;
+
+		lidp->lid_size = IOP_SIZE(lip);
+		lv = kmem_zalloc(sizeof(*lv) +
+				 lidp->lid_size * sizeof(xfs_log_iovec_t),
+				 KM_SLEEP|KM_NOFS|KM_LARGE);
+		lv->lv_item = lip;
+		lv->lv_niovecs = lidp->lid_size;
+		lv->lv_iovecp = (xfs_log_iovec_t *)&lv[1];
+		lv->lv_stale = lidp->lid_flags & XFS_LID_BUF_STALE;
+
+		IOP_FORMAT(lip, lv->lv_iovecp);
+		for (i = 0; i < lv->lv_niovecs; i++)
+			len += lv->lv_iovecp[i].i_len;
+
+		if (len) {
+			lv->lv_buf = kmem_alloc(len, KM_SLEEP|KM_NOFS|KM_LARGE);
+			lv->lv_buf_len = len;
+			ptr = lv->lv_buf;
+			for (i = 0; i < lv->lv_niovecs; i++) {
+				xfs_log_iovec_t	*vecp = &lv->lv_iovecp[i];
+
+				memcpy(ptr, vecp->i_addr, vecp->i_len);
+				vecp->i_addr = ptr;
+				ptr += vecp->i_len;
+			}
+		}
+
+		IOP_PIN(lip);
+		list_add_tail(&lv->lv_list, lv_chain);
+	}
+}
+
+/*
+ * Insert the formatted log vectors into the current checkpoint.  An item
+ * that is already in this checkpoint has its old vector replaced by the new
+ * one, which also takes over the pins the old vector was holding and moves
+ * to the tail of the list so that the checkpoint keeps the order in which
+ * items were last committed.  Replaced vectors are passed back on
+ * @free_chain as they cannot be freed under the CIL lock.
+ *
+ * The log space used by the checkpoint grows by the difference in formatted
+ * size, and that much reservation is moved from the transaction's ticket
+ * to the checkpoint ticket.  Called with the context lock held shared.
+ */
+STATIC void
+xlog_cil_insert_items(
+	xlog_t			*log,
+	struct list_head	*lv_chain,
+	struct xlog_ticket	*ticket,
+	struct list_head	*free_chain)
+{
+	struct xfs_cil		*cil = log->l_cilp;
+	struct xfs_cil_ctx	*ctx = cil->xc_ctx;
+	struct xfs_log_vec	*lv;
+	struct xfs_log_vec	*next;
+	int			iclog_space;
+	int			len = 0;
+
+	spin_lock(&cil->xc_cil_lock);
+	list_for_each_entry_safe(lv, next, lv_chain, lv_list) {
+		struct xfs_log_item	*lip = lv->lv_item;
+		struct xfs_log_vec	*old = NULL;
+
+		list_del(&lv->lv_list);
+		lv->lv_pincount = 1;
+
+		if (lip->li_seq == ctx->sequence && lip->li_lv) {
+			old = lip->li_lv;
+			lv->lv_pincount += old->lv_pincount;
+			len -= old->lv_buf_len +
+			       old->lv_niovecs * sizeof(xlog_op_header_t);
+			ctx->nvecs -= old->lv_niovecs;
+			if (old->lv_niovecs)
+				ctx->nitems--;
+			list_move_tail(&old->lv_list, free_chain);
+		}
+
+		len += lv->lv_buf_len +
+		       lv->lv_niovecs * sizeof(xlog_op_header_t);
+		ctx->nvecs += lv->lv_niovecs;
+		if (lv->lv_niovecs)
+			ctx->nitems++;
+		list_add_tail(&lv->lv_list, &ctx->lv_list);
+		lip->li_lv = lv;
+		lip->li_seq = ctx->sequence;
+	}
+
+	/*
+	 * The first commit into a checkpoint pays for the checkpoint
+	 * transaction header, start and commit records.
+	 */
+	if (ctx->ticket->t_curr_res == 0) {
+		ctx->ticket->t_curr_res = ctx->ticket->t_unit_res;
+		ticket->t_curr_res -= ctx->ticket->t_unit_res;
+	}
+
+	/*
+	 * If the checkpoint now spans more iclogs, take the space for the
+	 * extra log record headers and split region headers as well.
+	 */
+	iclog_space = log->l_iclog_size - log->l_iclog_hsize;
+	if (len > 0 && (ctx->space_used / iclog_space !=
+				(ctx->space_used + len) / iclog_space)) {
+		int	hdrs;
+
+		hdrs = (len + iclog_space - 1) / iclog_space;
+		hdrs *= log->l_iclog_hsize + sizeof(xlog_op_header_t);
+		ctx->ticket->t_unit_res += hdrs;
+		ctx->ticket->t_curr_res += hdrs;
+		ticket->t_curr_res -= hdrs;
+	}
+
+	ctx->ticket->t_curr_res += len;
+	ticket->t_curr_res -= len;
+	ctx->space_used += len;
+	spin_unlock(&cil->xc_cil_lock);
+}
+
+/*
+ * Commit a transaction into the CIL.  The items are formatted, inserted
+ * into the current checkpoint and unlocked, and what is left of the
+ * transaction's reservation is released or regranted.  All of that
+ * happens under the context lock so that the checkpoint cannot be written
+ * and completed while the transaction still holds any of its items.
+ *
+ * *commit_lsn is set to the checkpoint sequence the transaction went into.
+ * The transaction structure must not be referenced once this returns.
+ */
+void
+xfs_log_commit_cil(
+	struct xfs_mount	*mp,
+	struct xfs_trans	*tp,
+	xfs_lsn_t		*commit_lsn,
+	uint			flags)
+{
+	xlog_t			*log = mp->m_log;
+	struct xfs_cil		*cil = log->l_cilp;
+	struct xlog_ticket	*ticket = tp->t_ticket;
+	struct xfs_log_vec	*lv;
+	struct xfs_log_vec	*next;
+	LIST_HEAD(lv_chain);
+	LIST_HEAD(free_chain);
+	int			overrun;
+	int			push;
+
+	xlog_cil_format_items(tp, &lv_chain);
+
+	down_read(&cil->xc_ctx_lock);
+	xlog_cil_insert_items(log, &lv_chain, ticket, &free_chain);
+	overrun = ticket->t_curr_res < 0;
+
+	*commit_lsn = cil->xc_ctx->sequence;
+	tp->t_commit_lsn = *commit_lsn;
+	xfs_log_done(mp, ticket, NULL, flags);
+
+	/*
+	 * Transactions that freed extents hang off the checkpoint until
+	 * it is on disk, so that the extents cannot be reused before the
+	 * frees are stable.
+	 */
+	if (xfs_trans_cil_done(tp, *commit_lsn)) {
+		spin_lock(&cil->xc_cil_lock);
+		list_add_tail(&tp->t_cil_list, &cil->xc_ctx->trans_list);
+		spin_unlock(&cil->xc_cil_lock);
+	}
+
+	push = cil->xc_ctx->space_used > XLOG_CIL_SPACE_LIMIT(log);
+	up_read(&cil->xc_ctx_lock);
+
+	list_for_each_entry_safe(lv, next, &free_chain, lv_list) {
+		list_del(&lv->lv_list);
+		xlog_cil_free_lv(lv);
+	}
+
+	if (overrun) {
+		xfs_cmn_err(XFS_PTAG_LOGRES, CE_ALERT, mp,
+			"xfs_log_commit_cil: reservation ran out. "
+			"Need to up reservation");
+		xfs_force_shutdown(mp, SHUTDOWN_CORRUPT_INCORE);
+	}
+
+	if (push)
+		xlog_cil_push(log, 0);
+}
+
+/*
+ * Checkpoint completion, called from the iclog callbacks once the commit
+ * record is on disk, or directly if the checkpoint had to be aborted.
+ * The items are processed in the order they were last committed in, each
+ * dropping every pin taken by the transactions aggregated into it.
+ */
+STATIC void
+xlog_cil_committed(
+	void			*args,
+	int			abort)
+{
+	struct xfs_cil_ctx	*ctx = args;
+	struct xfs_cil		*cil = ctx->cil;
+	struct xfs_log_vec	*lv;
+	struct xfs_log_vec	*next;
+	struct xfs_trans	*tp;
+	struct xfs_trans	*tnext;
+
+	list_for_each_entry_safe(lv, next, &ctx->lv_list, lv_list) {
+		list_del(&lv->lv_list);
+		xfs_trans_item_committed(lv->lv_item, ctx->start_lsn, abort,
+					 lv->lv_stale, lv->lv_pincount);
+		xlog_cil_free_lv(lv);
+	}
+
+	list_for_each_entry_safe(tp, tnext, &ctx->trans_list, t_cil_list) {
+		list_del(&tp->t_cil_list);
+		xfs_trans_cil_committed(tp, abort);
+	}
+
+	spin_lock(&cil->xc_cil_lock);
+	list_del(&ctx->committing);
+	sv_broadcast(&cil->xc_commit_wait);
+	spin_unlock(&cil->xc_cil_lock);
+
+	kmem_free(ctx);
+}
+
+/*
+ * Write the current checkpoint to the log.  A push_seq of zero pushes
+ * whatever is in the CIL; otherwise nothing is done if that sequence has
+ * already been pushed.
+ *
+ * The context is switched under the exclusive context lock, after which
+ * new transactions go into the next checkpoint while this one is written.
+ * Checkpoints can be written concurrently, but their commit records must
+ * reach the log in sequence order for recovery to replay them correctly,
+ * so the commit record is held back until every earlier checkpoint has
+ * written its own.
+ */
+void
+xlog_cil_push(
+	xlog_t			*log,
+	xfs_lsn_t		push_seq)
+{
+	struct xfs_cil		*cil = log->l_cilp;
+	struct xfs_cil_ctx	*ctx;
+	struct xfs_cil_ctx	*new_ctx;
+	struct xfs_cil_ctx	*prev;
+	struct xfs_log_vec	*lv;
+	xfs_log_iovec_t		*iovecs;
+	xfs_log_iovec_t		*vecp;
+	void			*commit_iclog;
+	xfs_lsn_t		commit_lsn;
+	int			nvecs;
+	int			error;
+
+	if (!cil)
+		return;
+
+	new_ctx = xlog_cil_ctx_alloc(log);
+
+	down_write(&cil->xc_ctx_lock);
+	ctx = cil->xc_ctx;
+	if (list_empty(&ctx->lv_list) ||
+	    (push_seq && push_seq < ctx->sequence)) {
+		up_write(&cil->xc_ctx_lock);
+		xlog_cil_ctx_free(new_ctx);
+		return;
+	}
+
+	new_ctx->sequence = ctx->sequence + 1;
+	cil->xc_ctx = new_ctx;
+	spin_lock(&cil->xc_cil_lock);
+	list_add_tail(&ctx->committing, &cil->xc_committing);
+	spin_unlock(&cil->xc_cil_lock);
+	up_write(&cil->xc_ctx_lock);
+
+	if (XLOG_FORCED_SHUTDOWN(log))
+		goto out_abort_ticket;
+
+	/*
+	 * Build the checkpoint: a transaction header followed by the
+	 * regions of every log vector, in list order.
+	 */
+	nvecs = ctx->nvecs + 1;
+	iovecs = kmem_alloc(nvecs * sizeof(xfs_log_iovec_t),
+			    KM_SLEEP|KM_NOFS|KM_LARGE);
+
+	ctx->header.th_magic = XFS_TRANS_HEADER_MAGIC;
+	ctx->header.th_type = XFS_TRANS_CHECKPOINT;
+	ctx->header.th_tid = ctx->ticket->t_tid;
+	ctx->header.th_num_items = ctx->nitems;
+	iovecs[0].i_addr = (xfs_caddr_t)&ctx->header;
+	iovecs[0].i_len = sizeof(xfs_trans_header_t);
+	XLOG_VEC_SET_TYPE(&iovecs[0], XLOG_REG_TYPE_TRANSHDR);
+
+	vecp = &iovecs[1];
+	list_for_each_entry(lv, &ctx->lv_list, lv_list) {
+		memcpy(vecp, lv->lv_iovecp,
+		       lv->lv_niovecs * sizeof(xfs_log_iovec_t));
+		vecp += lv->lv_niovecs;
+	}
+	ASSERT(vecp - iovecs == nvecs);
+
+	error = xfs_log_write(log->l_mp, iovecs, nvecs, ctx->ticket,
+			      &ctx->start_lsn);
+	kmem_free(iovecs);
+	if (error)
+		goto out_abort_ticket;
+
+restart:
+	spin_lock(&cil->xc_cil_lock);
+	list_for_each_entry(prev, &cil->xc_committing, committing) {
+		if (prev->sequence >= ctx->sequence)
+			continue;
+		if (XLOG_FORCED_SHUTDOWN(log)) {
+			spin_unlock(&cil->xc_cil_lock);
+			goto out_abort_ticket;
+		}
+		if (!prev->commit_lsn) {
+			sv_wait(&cil->xc_commit_wait, 0, &cil->xc_cil_lock, 0);
+			goto restart;
+		}
+	}
+	spin_unlock(&cil->xc_cil_lock);
+
+	commit_lsn = xfs_log_done(log->l_mp, ctx->ticket, &commit_iclog, 0);
+	if (commit_lsn == -1)
+		goto out_abort;
+
+	ctx->log_cb.cb_func = xlog_cil_committed;
+	ctx->log_cb.cb_arg = ctx;
+	error = xfs_log_notify(log->l_mp, commit_iclog, &ctx->log_cb);
+	if (error) {
+		xlog_cil_committed(ctx, XFS_LI_ABORTED);
+		xfs_log_release_iclog(log->l_mp, commit_iclog);
+		return;
+	}
+
+	/*
+	 * The completion callback may run as soon as the iclog is released,
+	 * so publish the commit record to later checkpoints and to log
+	 * forces before letting it go.
+	 */
+	spin_lock(&cil->xc_cil_lock);
+	ctx->commit_lsn = commit_lsn;
+	sv_broadcast(&cil->xc_commit_wait);
+	spin_unlock(&cil->xc_cil_lock);
+
+	xfs_log_release_iclog(log->l_mp, commit_iclog);
+	return;
+
+out_abort_ticket:
+	xfs_log_done(log->l_mp, ctx->ticket, NULL, 0);
+out_abort:
+	xlog_cil_committed(ctx, XFS_LI_ABORTED);
+}
+
+/*
+ * Translate a checkpoint sequence into the lsn of its commit record for a
+ * log force, pushing the CIL first if the sequence is still in it.  Every
+ * checkpoint up to the sequence (or every checkpoint, for a sequence of
+ * zero) is waited on until its commit record is in an iclog.
+ *
+ * Returns 0 for a sequence of zero, as the caller then forces the whole
+ * log, and NULLCOMMITLSN if the checkpoint has already completed.
+ */
+xfs_lsn_t
+xlog_cil_force_lsn(
+	xlog_t			*log,
+	xfs_lsn_t		sequence)
+{
+	struct xfs_cil		*cil = log->l_cilp;
+	struct xfs_cil_ctx	*ctx;
+	xfs_lsn_t		commit_lsn;
+
+	xlog_cil_push(log, sequence);
+
+restart:
+	commit_lsn = NULLCOMMITLSN;
+	spin_lock(&cil->xc_cil_lock);
+	list_for_each_entry(ctx, &cil->xc_committing, committing) {
+		if (sequence && ctx->sequence > sequence)
+			continue;
+		if (!ctx->commit_lsn) {
+			if (XLOG_FORCED_SHUTDOWN(log))
+				break;
+			sv_wait(&cil->xc_commit_wait, 0, &cil->xc_cil_lock, 0);
+			goto restart;
+		}
+		if (ctx->sequence == sequence)
+			commit_lsn = ctx->commit_lsn;
+	}
+	spin_unlock(&cil->xc_cil_lock);
+
+	if (!sequence)
+		return 0;
+	return commit_lsn;
+}
@@ -403,6 +403,7 @@ typedef struct log {
 	xfs_daddr_t		l_logBBstart;   /* start block of log */
 	int			l_logsize;      /* size of log in bytes */
 	int			l_logBBsize;    /* size of log in BB chunks */
+	struct xfs_cil		*l_cilp;	/* delayed logging CIL, or NULL */
 
 	/* The following block of fields are changed while holding icloglock */
 	sv_t			l_flush_wait ____cacheline_aligned_in_smp;
@@ -442,6 +443,60 @@ typedef struct log {
 
 #define XLOG_FORCED_SHUTDOWN(log)	((log)->l_flags & XLOG_IO_ERROR)
 
+/*
+ * Delayed logging.
+ *
+ * Transactions committed on a delaylog mount are not written to the iclogs
+ * directly.  Instead each dirty item is formatted into a private log vector
+ * and linked into the Committed Item List (CIL) of the current checkpoint
+ * context.  An item that is relogged while it is still in the current
+ * context simply has its log vector replaced, so however many transactions
+ * modify it, it is only written to the log once per checkpoint.
+ *
+ * The checkpoint is written to the log as a single transaction when the CIL
+ * is pushed, which happens on a log force covering one of its sequences or
+ * when the CIL grows beyond XLOG_CIL_SPACE_LIMIT.  The space the checkpoint
+ * needs in the log is stolen from the reservations of the transactions that
+ * are committed into it, so pushing never has to wait for log space.
+ *
+ * Log forces and item lsns handed out by a delaylog mount are checkpoint
+ * sequence numbers rather than real log sequence numbers; _xfs_log_force()
+ * translates them back into the lsn of the checkpoint commit record.
+ */
+struct xfs_cil_ctx {
+	struct xfs_cil		*cil;
+	xfs_lsn_t		sequence;	/* chkpt sequence # */
+	xfs_lsn_t		start_lsn;	/* first LSN of chkpt commit */
+	xfs_lsn_t		commit_lsn;	/* chkpt commit record lsn */
+	struct xlog_ticket	*ticket;	/* chkpt ticket */
+	int			nvecs;		/* number of regions */
+	int			nitems;		/* number of logged items */
+	int			space_used;	/* aggregate size of regions */
+	struct list_head	lv_list;	/* formatted log vectors */
+	struct list_head	trans_list;	/* transactions awaiting done */
+	struct list_head	committing;	/* ctx committing list */
+	xfs_trans_header_t	header;		/* checkpoint trans header */
+	xfs_log_callback_t	log_cb;		/* completion callback hook */
+};
+
+struct xfs_cil {
+	struct log		*xc_log;
+	struct xfs_cil_ctx	*xc_ctx;	/* context being filled */
+	struct rw_semaphore	xc_ctx_lock;	/* excludes commits from push */
+	spinlock_t		xc_cil_lock;	/* protects lists and counts */
+	struct list_head	xc_committing;	/* contexts being written */
+	sv_t			xc_commit_wait;	/* waiting for commit_lsn */
+};
+
+/*
+ * The CIL is pushed in the background once the formatted size of the
+ * current checkpoint exceeds an eighth of the log.  That keeps the amount
+ * of log space pinned by an unwritten checkpoint well clear of what the
+ * log needs to make progress, while still giving plenty of room for
+ * repeatedly modified items to be aggregated.
+ */
+#define XLOG_CIL_SPACE_LIMIT(log)	((log)->l_logsize >> 3)
+
 
 /* common routines */
 extern xfs_lsn_t xlog_assign_tail_lsn(struct xfs_mount *mp);
@@ -457,6 +512,15 @@ extern struct xfs_buf *xlog_get_bp(xlog_t *, int);
 extern void	 xlog_put_bp(struct xfs_buf *);
 
 extern kmem_zone_t	*xfs_log_ticket_zone;
+extern xlog_ticket_t *xlog_ticket_alloc(xlog_t *log, int unit_bytes, int count,
+				       char clientid, uint flags,
+				       unsigned int alloc_flags);
+
+/* delayed logging */
+extern int	 xlog_cil_init(xlog_t *log);
+extern void	 xlog_cil_destroy(xlog_t *log);
+extern void	 xlog_cil_push(xlog_t *log, xfs_lsn_t push_seq);
+extern xfs_lsn_t xlog_cil_force_lsn(xlog_t *log, xfs_lsn_t sequence);
 
 /* iclog tracing */
 #define XLOG_TRACE_GRAB_FLUSH  1
@@ -53,6 +53,9 @@ STATIC void	xfs_trans_uncommit(xfs_trans_t *, uint);
 STATIC void	xfs_trans_committed(xfs_trans_t *, int);
 STATIC void	xfs_trans_chunk_committed(xfs_log_item_chunk_t *, xfs_lsn_t, int);
 STATIC void	xfs_trans_free(xfs_trans_t *);
+STATIC void	xfs_trans_clear_busy(xfs_trans_t *);
+STATIC int	xfs_trans_commit_cil(struct xfs_mount *, struct xfs_trans *,
+				     int, int *);
 
 kmem_zone_t	*xfs_trans_zone;
 
@@ -855,6 +858,13 @@ shut_us_down:
 	}
 	XFS_TRANS_APPLY_DQUOT_DELTAS(mp, tp);
 
+	/*
+	 * On a delaylog mount the transaction goes into the CIL rather
+	 * than straight into the iclogs.
+	 */
+	if (mp->m_flags & XFS_MOUNT_DELAYLOG)
+		return xfs_trans_commit_cil(mp, tp, log_flags, log_flushed);
+
 	/*
 	 * Ask each log item how many log_vector entries it will
 	 * need so we can figure out how many to allocate.
@@ -996,6 +1006,80 @@ shut_us_down:
 }
 
 
+/*
+ * Commit a transaction on a delaylog mount.  The dirty items are formatted
+ * into private log vectors and inserted into the CIL, and the items are
+ * unlocked before xfs_log_commit_cil() returns.  The transaction structure
+ * must not be referenced after that; if it freed extents it stays around
+ * until the checkpoint it went into is on disk, and is freed from
+ * xfs_trans_cil_committed() then.
+ *
+ * The lsn handed back is the checkpoint sequence, which is what a
+ * synchronous transaction has to force the log up to.
+ */
+STATIC int
+xfs_trans_commit_cil(
+	struct xfs_mount	*mp,
+	struct xfs_trans	*tp,
+	int			log_flags,
+	int			*log_flushed)
+{
+	xfs_lsn_t		commit_lsn;
+	int			sync;
+	int			error = 0;
+
+	xfs_trans_unreserve_and_mod_sb(tp);
+	sync = tp->t_flags & XFS_TRANS_SYNC;
+	current_restore_flags_nested(&tp->t_pflags, PF_FSTRANS);
+
+	xfs_log_commit_cil(mp, tp, &commit_lsn, log_flags);
+
+	if (sync) {
+		error = _xfs_log_force(mp, commit_lsn,
+				       XFS_LOG_FORCE | XFS_LOG_SYNC,
+				       log_flushed);
+		XFS_STATS_INC(xs_trans_sync);
+	} else {
+		XFS_STATS_INC(xs_trans_async);
+	}
+	return error;
+}
+
+/*
+ * Called by the CIL once the items of a transaction have been inserted and
+ * unlocked.  Free the item descriptors that are left and drop the active
+ * transaction count.  If the transaction has busy extents or a completion
+ * callback, return 1 to have the CIL keep it until the checkpoint is on
+ * disk; otherwise free it and return 0.
+ */
+int
+xfs_trans_cil_done(
+	xfs_trans_t	*tp,
+	xfs_lsn_t	commit_lsn)
+{
+	xfs_log_item_chunk_t	*licp;
+	xfs_log_item_chunk_t	*next_licp;
+
+	xfs_trans_unlock_items(tp, commit_lsn);
+
+	licp = tp->t_items.lic_next;
+	while (licp != NULL) {
+		next_licp = licp->lic_next;
+		kmem_free(licp);
+		licp = next_licp;
+	}
+	tp->t_items.lic_next = NULL;
+
+	atomic_dec(&tp->t_mountp->m_active_trans);
+	XFS_TRANS_FREE_DQINFO(tp->t_mountp, tp);
+
+	if (tp->t_callback == NULL && tp->t_busy.lbc_unused == 0) {
+		kmem_zone_free(xfs_trans_zone, tp);
+		return 0;
+	}
+	return 1;
+}
+
 /*
  * Total up the number of log iovecs needed to commit this
  * transaction.  The transaction itself needs one for the
@@ -1307,9 +1391,6 @@ xfs_trans_committed(
 {
 	xfs_log_item_chunk_t	*licp;
 	xfs_log_item_chunk_t	*next_licp;
-	xfs_log_busy_chunk_t	*lbcp;
-	xfs_log_busy_slot_t	*lbsp;
-	int			i;
 
 	/*
 	 * Call the transaction's completion callback if there
@@ -1339,9 +1420,25 @@ xfs_trans_committed(
 		licp = next_licp;
 	}
 
+	xfs_trans_clear_busy(tp);
+
 	/*
-	 * Clear all the per-AG busy list items listed in this transaction
+	 * That's it for the transaction structure.  Free it.
 	 */
+	xfs_trans_free(tp);
+}
+
+/*
+ * Clear all the per-AG busy list items listed in this transaction
+ */
+STATIC void
+xfs_trans_clear_busy(
+	xfs_trans_t	*tp)
+{
+	xfs_log_busy_chunk_t	*lbcp;
+	xfs_log_busy_slot_t	*lbsp;
+	int			i;
+
 	lbcp = &tp->t_busy;
 	while (lbcp != NULL) {
 		for (i = 0, lbsp = lbcp->lbc_busy; i < lbcp->lbc_unused; i++, lbsp++) {
@@ -1353,33 +1450,28 @@ xfs_trans_committed(
 		lbcp = lbcp->lbc_next;
 	}
 	xfs_trans_free_busy(tp);
+}
 
-	/*
-	 * That's it for the transaction structure.  Free it.
-	 */
-	xfs_trans_free(tp);
+/*
+ * Completion for a transaction kept by the CIL: the checkpoint it was
+ * committed into has reached the disk, or has been aborted.  The items
+ * are dealt with by the CIL, so all that is left is the callback and the
+ * busy extents, which can now be reused.
+ */
+void
+xfs_trans_cil_committed(
+	xfs_trans_t	*tp,
+	int		abortflag)
+{
+	if (tp->t_callback != NULL)
+		tp->t_callback(tp, tp->t_callarg);
+	xfs_trans_clear_busy(tp);
+	kmem_zone_free(xfs_trans_zone, tp);
 }
 
 /*
  * This is called to perform the commit processing for each
  * item described by the given chunk.
- *
- * The commit processing consists of unlocking items which were
- * held locked with the SYNC_UNLOCK attribute, calling the committed
- * routine of each logged item, updating the item's position in the AIL
- * if necessary, and unpinning each item.  If the committed routine
- * returns -1, then do nothing further with the item because it
- * may have been freed.
- *
- * Since items are unlocked when they are copied to the incore
- * log, it is possible for two transactions to be completing
- * and manipulating the same item simultaneously.  The AIL lock
- * will protect the lsn field of each item.  The value of this
- * field can never go backwards.
- *
- * We unpin the items after repositioning them in the AIL, because
- * otherwise they could be immediately flushed and we'd have to race
- * with the flusher trying to pull the item from the AIL as we add it.
  */
 STATIC void
 xfs_trans_chunk_committed(
@@ -1388,72 +1480,101 @@ xfs_trans_chunk_committed(
 	int			aborted)
 {
 	xfs_log_item_desc_t	*lidp;
-	xfs_log_item_t		*lip;
-	xfs_lsn_t		item_lsn;
 	int			i;
 
 	lidp = licp->lic_descs;
 	for (i = 0; i < licp->lic_unused; i++, lidp++) {
-		struct xfs_ail		*ailp;
-
 		if (xfs_lic_isfree(licp, i)) {
 			continue;
 		}
 
-		lip = lidp->lid_item;
-		if (aborted)
-			lip->li_flags |= XFS_LI_ABORTED;
+		xfs_trans_item_committed(lidp->lid_item, lsn, aborted,
+				lidp->lid_flags & XFS_LID_BUF_STALE, 1);
+	}
+}
 
-		/*
-		 * Send in the ABORTED flag to the COMMITTED routine
-		 * so that it knows whether the transaction was aborted
-		 * or not.
-		 */
-		item_lsn = IOP_COMMITTED(lip, lsn);
+/*
+ * The commit processing for a single logged item consists of
+ * calling the committed routine of the item, updating the item's
+ * position in the AIL if necessary, and unpinning the item once
+ * for each time it was pinned by the commit(s) being completed.
+ * If the committed routine returns -1, then do nothing further
+ * with the item because it may have been freed.
+ *
+ * Since items are unlocked when they are copied to the incore
+ * log, it is possible for two transactions to be completing
+ * and manipulating the same item simultaneously.  The AIL lock
+ * will protect the lsn field of each item.  The value of this
+ * field can never go backwards.
+ *
+ * We unpin the items after repositioning them in the AIL, because
+ * otherwise they could be immediately flushed and we'd have to race
+ * with the flusher trying to pull the item from the AIL as we add it.
+ */
+void
+xfs_trans_item_committed(
+	xfs_log_item_t		*lip,
+	xfs_lsn_t		lsn,
+	int			aborted,
+	int			stale,
+	int			pincount)
+{
+	struct xfs_ail		*ailp;
+	xfs_lsn_t		item_lsn;
 
-		/*
-		 * If the committed routine returns -1, make
-		 * no more references to the item.
-		 */
-		if (XFS_LSN_CMP(item_lsn, (xfs_lsn_t)-1) == 0) {
-			continue;
-		}
+	if (aborted)
+		lip->li_flags |= XFS_LI_ABORTED;
 
-		/*
-		 * If the returned lsn is greater than what it
-		 * contained before, update the location of the
-		 * item in the AIL.  If it is not, then do nothing.
-		 * Items can never move backwards in the AIL.
-		 *
-		 * While the new lsn should usually be greater, it
-		 * is possible that a later transaction completing
-		 * simultaneously with an earlier one using the
-		 * same item could complete first with a higher lsn.
-		 * This would cause the earlier transaction to fail
-		 * the test below.
-		 */
-		ailp = lip->li_ailp;
-		spin_lock(&ailp->xa_lock);
-		if (XFS_LSN_CMP(item_lsn, lip->li_lsn) > 0) {
-			/*
-			 * This will set the item's lsn to item_lsn
-			 * and update the position of the item in
-			 * the AIL.
-			 *
-			 * xfs_trans_ail_update() drops the AIL lock.
-			 */
-			xfs_trans_ail_update(ailp, lip, item_lsn);
-		} else {
-			spin_unlock(&ailp->xa_lock);
-		}
+	/*
+	 * Send in the ABORTED flag to the COMMITTED routine
+	 * so that it knows whether the transaction was aborted
+	 * or not.
+	 */
+	item_lsn = IOP_COMMITTED(lip, lsn);
+
+	/*
+	 * If the committed routine returns -1, make
+	 * no more references to the item.
+	 */
+	if (XFS_LSN_CMP(item_lsn, (xfs_lsn_t)-1) == 0)
+		return;
 
+	/*
+	 * If the returned lsn is greater than what it
+	 * contained before, update the location of the
+	 * item in the AIL.  If it is not, then do nothing.
+	 * Items can never move backwards in the AIL.
+	 *
+	 * While the new lsn should usually be greater, it
+	 * is possible that a later transaction completing
+	 * simultaneously with an earlier one using the
+	 * same item could complete first with a higher lsn.
+	 * This would cause the earlier transaction to fail
+	 * the test below.
+	 */
+	ailp = lip->li_ailp;
+	spin_lock(&ailp->xa_lock);
+	if (XFS_LSN_CMP(item_lsn, lip->li_lsn) > 0) {
 		/*
-		 * Now that we've repositioned the item in the AIL,
-		 * unpin it so it can be flushed. Pass information
-		 * about buffer stale state down from the log item
-		 * flags, if anyone else stales the buffer we do not
-		 * want to pay any attention to it.
+		 * This will set the item's lsn to item_lsn
+		 * and update the position of the item in
+		 * the AIL.
+		 *
+		 * xfs_trans_ail_update() drops the AIL lock.
 		 */
-		IOP_UNPIN(lip, lidp->lid_flags & XFS_LID_BUF_STALE);
+		xfs_trans_ail_update(ailp, lip, item_lsn);
+	} else {
+		spin_unlock(&ailp->xa_lock);
 	}
+
+	/*
+	 * Now that we've repositioned the item in the AIL,
+	 * unpin it so it can be flushed. Pass information
+	 * about buffer stale state down from the log item
+	 * flags, if anyone else stales the buffer we do not
+	 * want to pay any attention to it.  Only the last
+	 * unpin can free the item.
+	 */
+	while (pincount-- > 0)
+		IOP_UNPIN(lip, stale);
 }
@@ -43,6 +43,16 @@ xfs_log_busy_slot_t		*xfs_trans_add_busy(xfs_trans_t *tp,
 						    xfs_agnumber_t ag,
 						    xfs_extlen_t idx);
 
+/*
+ * From xfs_trans.c, for delayed logging
+ */
+void				xfs_trans_item_committed(struct xfs_log_item *,
+					xfs_lsn_t, int, int, int);
+int				xfs_trans_cil_done(struct xfs_trans *,
+						   xfs_lsn_t);
+void				xfs_trans_cil_committed(struct xfs_trans *,
+							int);
+
 /*
  * AIL traversal cursor.
  *
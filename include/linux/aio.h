@@ -78,11 +78,12 @@ struct kioctx;
  * If ki_retry returns -EIOCBRETRY it has made a promise that kick_iocb()
  * will be called on the kiocb pointer in the future.  This may happen
  * through generic helpers that associate kiocb->ki_wait with a wait
- * queue head that ki_retry uses via current->io_wait.  It can also happen
- * with custom tracking and manual calls to kick_iocb(), though that is
- * discouraged.  In either case, kick_iocb() must be called once and only
- * once.  ki_retry must ensure forward progress, the AIO core will wait
- * indefinitely for kick_iocb() to be called.
+ * queue head, such as lock_page_async() used by buffered reads to wait
+ * for a page under I/O.  It can also happen with custom tracking and
+ * manual calls to kick_iocb(), though that is discouraged.  In either
+ * case, kick_iocb() must be called once and only once.  ki_retry must
+ * ensure forward progress, the AIO core will wait indefinitely for
+ * kick_iocb() to be called.
  */
 struct kiocb {
 	struct list_head	ki_run_list;
@@ -102,7 +103,7 @@ struct kiocb {
 	} ki_obj;
 
 	__u64			ki_user_data;	/* user's data for completion */
-	wait_queue_t		ki_wait;
+	struct wait_bit_queue	ki_wait;	/* key set for page bit waits */
 	loff_t			ki_pos;
 
 	void			*private;
@@ -140,11 +141,20 @@ struct kiocb {
 		(x)->ki_dtor = NULL;			\
 		(x)->ki_obj.tsk = tsk;			\
 		(x)->ki_user_data = 0;                  \
-		init_wait((&(x)->ki_wait));             \
+		init_wait((&(x)->ki_wait.wait));        \
 	} while (0)
 
+/*
+ * The event ring is mapped into the owning process at ctx_id.  With
+ * AIO_RING_COMPAT_USER_REAP set in compat_features, userspace may reap
+ * events without io_getevents(): events between head and tail (both
+ * taken modulo nr) are valid once tail has been read, and are consumed
+ * by advancing head with an atomic compare-and-swap after copying them.
+ * The kernel reaps the same way, so both can be used on one ring.
+ */
 #define AIO_RING_MAGIC			0xa10a10a1
-#define AIO_RING_COMPAT_FEATURES	1
+#define AIO_RING_COMPAT_USER_REAP	2
+#define AIO_RING_COMPAT_FEATURES	(1 | AIO_RING_COMPAT_USER_REAP)
 #define AIO_RING_INCOMPAT_FEATURES	0
 struct aio_ring {
 	unsigned	id;	/* kernel internal index number */
@@ -169,7 +179,6 @@ struct aio_ring_info {
 	unsigned long		mmap_size;
 
 	struct page		**ring_pages;
-	spinlock_t		ring_lock;
 	long			nr_pages;
 
 	unsigned		nr, tail;
@@ -212,6 +221,8 @@ extern ssize_t wait_on_sync_kiocb(struct kiocb *iocb);
 extern int aio_put_req(struct kiocb *iocb);
 extern void kick_iocb(struct kiocb *iocb);
 extern int aio_complete(struct kiocb *iocb, long res, long res2);
+extern void aio_complete_batch(struct kiocb **iocbs, long *res, long *res2,
+			       int nr);
 struct mm_struct;
 extern void exit_aio(struct mm_struct *mm);
 #else
@@ -219,11 +230,13 @@ static inline ssize_t wait_on_sync_kiocb(struct kiocb *iocb) { return 0; }
 static inline int aio_put_req(struct kiocb *iocb) { return 0; }
 static inline void kick_iocb(struct kiocb *iocb) { }
 static inline int aio_complete(struct kiocb *iocb, long res, long res2) { return 0; }
+static inline void aio_complete_batch(struct kiocb **iocbs, long *res,
+				      long *res2, int nr) { }
 struct mm_struct;
 static inline void exit_aio(struct mm_struct *mm) { }
 #endif /* CONFIG_AIO */
 
-#define io_wait_to_kiocb(wait) container_of(wait, struct kiocb, ki_wait)
+#define io_wait_to_kiocb(wait) container_of(wait, struct kiocb, ki_wait.wait)
 
 #include <linux/aio_abi.h>
 
@@ -31,6 +31,7 @@
 #define _LINUX_FUSE_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /** Version number of this interface */
 #define FUSE_KERNEL_VERSION 7
@@ -477,4 +478,15 @@ struct fuse_dirent {
 #define FUSE_DIRENT_SIZE(d) \
 	FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET + (d)->namelen)
 
+/*
+ * Device ioctls
+ *
+ * FUSE_DEV_IOC_CLONE: attach the device file to the connection of the
+ * device file whose descriptor is passed in, so that the filesystem
+ * daemon can serve requests from separate queues in each thread.
+ * Replies must be written to the file the request was read from.
+ */
+#define FUSE_DEV_IOC_MAGIC	229
+#define FUSE_DEV_IOC_CLONE	_IOR(FUSE_DEV_IOC_MAGIC, 0, __u32)
+
 #endif /* _LINUX_FUSE_H */
@@ -39,6 +39,8 @@
 
 #include <linux/device.h>
 #include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/smp.h>
 #include <linux/dmaengine.h>
 #include <linux/workqueue.h>
 
@@ -186,6 +188,9 @@ struct netif_rx_stats
 	unsigned dropped;
 	unsigned time_squeeze;
 	unsigned cpu_collision;
+	unsigned received_rps;
+	unsigned recycle_hits;
+	unsigned recycle_misses;
 };
 
 DECLARE_PER_CPU(struct netif_rx_stats, netdev_rx_stat);
@@ -455,6 +460,19 @@ struct netdev_queue {
 	struct Qdisc		*qdisc_sleeping;
 } ____cacheline_aligned_in_smp;
 
+#ifdef CONFIG_RPS
+/*
+ * This structure holds an RPS map which can be of variable length.  The
+ * map is an array of CPUs, received packets are steered to one of them
+ * based on a hash of their flow.
+ */
+struct rps_map {
+	unsigned int	len;
+	struct rcu_head	rcu;
+	u16		cpus[0];
+};
+#define RPS_MAP_SIZE(_num) (sizeof(struct rps_map) + ((_num) * sizeof(u16)))
+#endif
 
 /*
  * This structure defines the management hooks for network devices.
@@ -681,6 +699,8 @@ struct net_device
 #define NETIF_F_TSO_ECN		(SKB_GSO_TCP_ECN << NETIF_F_GSO_SHIFT)
 #define NETIF_F_TSO6		(SKB_GSO_TCPV6 << NETIF_F_GSO_SHIFT)
 #define NETIF_F_FSO		(SKB_GSO_FCOE << NETIF_F_GSO_SHIFT)
+#define NETIF_F_GSO_TUNNEL	(SKB_GSO_TUNNEL << NETIF_F_GSO_SHIFT)
+#define NETIF_F_GSO_UDP_L4	(SKB_GSO_UDP_L4 << NETIF_F_GSO_SHIFT)
 
 	/* List of features with software fallbacks. */
 #define NETIF_F_GSO_SOFTWARE	(NETIF_F_TSO | NETIF_F_TSO_ECN | NETIF_F_TSO6)
@@ -783,6 +803,11 @@ struct net_device
 
 	struct netdev_queue	rx_queue;
 
+#ifdef CONFIG_RPS
+	/* CPUs to steer received packets to, see get_rps_cpu() */
+	struct rps_map		*rps_map;
+#endif
+
 	struct netdev_queue	*_tx ____cacheline_aligned_in_smp;
 
 	/* Number of TX queues allocated at alloc_netdev_mq() time  */
@@ -1190,6 +1215,16 @@ struct softnet_data
 	struct sk_buff		*completion_queue;
 
 	struct napi_struct	backlog;
+
+#ifdef CONFIG_RPS
+	/* Remote CPUs this CPU has queued packets to and must kick */
+	struct softnet_data	*rps_ipi_list;
+
+	/* Elements below can be accessed between CPUs for RPS */
+	struct call_single_data	csd ____cacheline_aligned_in_smp;
+	struct softnet_data	*rps_ipi_next;
+	unsigned int		cpu;
+#endif
 };
 
 DECLARE_PER_CPU(struct softnet_data,softnet_data);
@@ -1865,6 +1900,7 @@ static inline int netif_needs_gso(struct net_device *dev, struct sk_buff *skb)
 	       (!skb_gso_ok(skb, dev->features) ||
 	        (skb_shinfo(skb)->frag_list &&
 	         !(dev->features & NETIF_F_FRAGLIST)) ||
+		skb->len - skb_network_offset(skb) > dev->gso_max_size ||
 		unlikely(skb->ip_summed != CHECKSUM_PARTIAL));
 }
 
@@ -84,6 +84,13 @@ struct nfs_server {
 	struct nlm_host		*nlm_host;	/* NLM client handle */
 	struct nfs_iostats *	io_stats;	/* I/O statistics */
 	struct backing_dev_info	backing_dev_info;
+	spinlock_t		ra_lock;	/* protects the ra_ estimators */
+	unsigned long		ra_min_pages;	/* readahead floor */
+	unsigned long		ra_min_rtt;	/* lowest READ rtt (jiffies) */
+	unsigned long		ra_rtt_stamp;	/* when ra_min_rtt was taken */
+	unsigned long		ra_window_start; /* start of rate sample */
+	unsigned long		ra_window_bytes; /* bytes read in sample */
+	u64			ra_rate;	/* READ bytes per second */
 	atomic_long_t		writeback;	/* number of writeback pages */
 	int			flags;		/* various flags */
 	unsigned int		caps;		/* server capabilities */
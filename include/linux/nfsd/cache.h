@@ -12,13 +12,13 @@
 
 #include <linux/in.h>
 #include <linux/uio.h>
+#include <linux/types.h>
 
 /*
- * Representation of a reply cache entry. The first two members *must*
- * be hash_next and hash_prev.
+ * Representation of a reply cache entry.  c_lru links the entry into
+ * its hash bucket, which is kept in LRU order.
  */
 struct svc_cacherep {
-	struct hlist_node	c_hash;
 	struct list_head	c_lru;
 
 	unsigned char		c_state,	/* unused, inprog, done */
@@ -30,6 +30,8 @@ struct svc_cacherep {
 	u32			c_proc;
 	u32			c_vers;
 	unsigned long		c_timestamp;
+	__wsum			c_csum;		/* checksum of call body */
+	u32			c_len;		/* length of call */
 	union {
 		struct kvec	u_vec;
 		__be32		u_status;
@@ -75,6 +77,9 @@ int	nfsd_reply_cache_init(void);
 void	nfsd_reply_cache_shutdown(void);
 int	nfsd_cache_lookup(struct svc_rqst *, int);
 void	nfsd_cache_update(struct svc_rqst *, int, __be32 *);
+struct seq_file;
+void	nfsd_reply_cache_hits(unsigned int *, unsigned int *);
+void	nfsd_reply_cache_show(struct seq_file *);
 
 #ifdef CONFIG_NFSD_V4
 void	nfsd4_set_statp(struct svc_rqst *rqstp, __be32 *statp);
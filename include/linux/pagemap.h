@@ -301,6 +301,7 @@ static inline pgoff_t linear_page_index(struct vm_area_struct *vma,
 
 extern void __lock_page(struct page *page);
 extern int __lock_page_killable(struct page *page);
+extern int __lock_page_async(struct page *page, struct wait_bit_queue *wait);
 extern void __lock_page_nosync(struct page *page);
 extern void unlock_page(struct page *page);
 
@@ -342,6 +343,20 @@ static inline int lock_page_killable(struct page *page)
 	return 0;
 }
 
+/*
+ * lock_page_async never sleeps.  It returns 0 if it locked the page and
+ * -EIOCBRETRY if the page is locked by someone else, in which case @wait
+ * (normally an AIO kiocb's ki_wait) has been queued to be woken when the
+ * page is unlocked.  A NULL @wait just reports -EIOCBRETRY.
+ */
+static inline int lock_page_async(struct page *page,
+				  struct wait_bit_queue *wait)
+{
+	if (!trylock_page(page))
+		return __lock_page_async(page, wait);
+	return 0;
+}
+
 /*
  * lock_page_nosync should only be used if we can't pin the page's inode.
  * Doesn't play quite so well with block device plugging.
@@ -239,6 +239,13 @@ enum {
 	SKB_GSO_TCPV6 = 1 << 4,
 
 	SKB_GSO_FCOE = 1 << 5,
+
+	/* This indicates the tcp segment is carried in an IPIP or GRE
+	 * tunnel; the outer headers precede the inner IP header. */
+	SKB_GSO_TUNNEL = 1 << 6,
+
+	/* UDP datagrams of gso_size bytes each, sharing one header. */
+	SKB_GSO_UDP_L4 = 1 << 7,
 };
 
 #if BITS_PER_LONG > 32
@@ -441,6 +448,7 @@ static inline struct sk_buff *alloc_skb_fclone(unsigned int size,
 }
 
 extern int skb_recycle_check(struct sk_buff *skb, int skb_size);
+extern int sysctl_skb_recycle_max;
 
 extern struct sk_buff *skb_morph(struct sk_buff *dst, struct sk_buff *src);
 extern struct sk_buff *skb_clone(struct sk_buff *skb,
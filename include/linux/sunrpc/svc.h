@@ -31,6 +31,10 @@ struct svc_pool_stats {
 	unsigned long	threads_woken;
 	unsigned long	overloads_avoided;
 	unsigned long	threads_timedout;
+	unsigned long	xprts_handled;	/* transports picked up by threads */
+	unsigned long	handoffs;	/* ... received on another pool's cpus */
+	unsigned long	wait_usecs;	/* total time transports were queued */
+	unsigned long	wait_usecs_max;
 };
 
 /*
@@ -9,6 +9,7 @@
 
 #include <linux/sunrpc/svc.h>
 #include <linux/module.h>
+#include <linux/ktime.h>
 
 struct svc_xprt_ops {
 	struct svc_xprt	*(*xpo_create)(struct svc_serv *,
@@ -53,6 +54,9 @@ struct svc_xprt {
 #define XPT_CACHE_AUTH	12		/* cache auth info */
 
 	struct svc_pool		*xpt_pool;	/* current pool iff queued */
+	int			xpt_rx_cpu;	/* cpu that last received data,
+						 * or -1 */
+	ktime_t			xpt_qtime;	/* when it was last queued */
 	struct svc_serv		*xpt_server;	/* service for transport */
 	atomic_t    	    	xpt_reserved;	/* space on outq that is rsvd */
 	struct mutex		xpt_mutex;	/* to serialize sending data */
@@ -85,6 +89,16 @@ struct	svc_xprt *svc_find_xprt(struct svc_serv *serv, const char *xcl_name,
 			const sa_family_t af, const unsigned short port);
 int	svc_xprt_names(struct svc_serv *serv, char *buf, int buflen);
 
+/*
+ * Called by transports from their receive callbacks, so that the
+ * transport is queued to the pool local to the cpu taking its
+ * interrupts rather than to whichever pool last touched it.
+ */
+static inline void svc_xprt_note_rx(struct svc_xprt *xprt)
+{
+	xprt->xpt_rx_cpu = raw_smp_processor_id();
+}
+
 static inline void svc_xprt_get(struct svc_xprt *xprt)
 {
 	kref_get(&xprt->xpt_ref);
@@ -96,6 +96,7 @@ enum {
 #define TCP_QUICKACK		12	/* Block/reenable quick acks */
 #define TCP_CONGESTION		13	/* Congestion control algorithm */
 #define TCP_MD5SIG		14	/* TCP MD5 Signature (RFC2385) */
+#define TCP_PACING		15	/* Pace output at the estimated rate */
 
 #define TCPI_OPT_TIMESTAMPS	1
 #define TCPI_OPT_SACK		2
@@ -174,6 +175,7 @@ struct tcp_md5sig {
 
 #include <linux/skbuff.h>
 #include <linux/dmaengine.h>
+#include <linux/hrtimer.h>
 #include <net/sock.h>
 #include <net/inet_connection_sock.h>
 #include <net/inet_timewait_sock.h>
@@ -316,6 +318,7 @@ struct tcp_sock {
 	u32	snd_up;		/* Urgent pointer		*/
 
 	u8	keepalive_probes; /* num of allowed keep alive probes	*/
+	u8	pacing;		/* Pace output at pacing_rate		*/
 /*
  *      Options received (usually on last packet, some only on SYN packets).
  */
@@ -408,6 +411,21 @@ struct tcp_sock {
 #endif
 
 	int			linger2;
+
+/* TCP small queues: limits bytes queued below the socket */
+	unsigned long		tsq_flags;
+	struct list_head	tsq_node; /* anchor in tsq_tasklet.head list */
+
+/* Pacing: next departure time and rate in bytes per second */
+	struct hrtimer		pacing_timer;
+	ktime_t			pacing_next;
+	u32			pacing_rate;
+};
+
+enum tsq_flags {
+	TSQ_THROTTLED,
+	TSQ_QUEUED,
+	TCP_TSQ_DEFERRED,	   /* tcp_tasklet_func() found socket was owned */
 };
 
 static inline struct tcp_sock *tcp_sk(const struct sock *sk)
@@ -29,6 +29,8 @@ struct udphdr {
 /* UDP socket options */
 #define UDP_CORK	1	/* Never send partially complete segments */
 #define UDP_ENCAP	100	/* Set the socket to accept encapsulated packets */
+#define UDP_SEGMENT	103	/* Send datagrams of this size as one GSO packet */
+#define UDP_GRO		104	/* Receive coalesced datagrams, see cmsg */
 
 /* UDP encapsulation types */
 #define UDP_ENCAP_ESPINUDP_NON_IKE	1 /* draft-ietf-ipsec-nat-t-ike-00/01 */
@@ -73,7 +75,13 @@ struct udp_sock {
 #define UDPLITE_SEND_CC  0x2  		/* set via udplite setsockopt         */
 #define UDPLITE_RECV_CC  0x4		/* set via udplite setsocktopt        */
 	__u8		 pcflag;        /* marks socket as UDP-Lite if > 0    */
-	__u8		 unused[3];
+	__u8		 gro_enabled;	/* UDP_GRO: accept coalesced datagrams */
+	__u16		 gso_size;	/* UDP_SEGMENT: size of sent segments  */
+	/*
+	 * Secondary hash linkage, keyed on (local address, local port).
+	 */
+	struct hlist_nulls_node udp_portaddr_node;
+	unsigned int	 udp_portaddr_hash;
 	/*
 	 * For encapsulation sockets.
 	 */
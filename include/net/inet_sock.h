@@ -142,6 +142,7 @@ struct inet_sock {
 		int			length; /* Total length of all frames */
 		__be32			addr;
 		struct flowi		fl;
+		unsigned int		gso_size; /* UDP segment size, or 0 */
 	} cork;
 };
 
@@ -2,11 +2,19 @@
 #define __NET_IPIP_H 1
 
 #include <linux/if_tunnel.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
 #include <net/ip.h>
 
 /* Keep error state on tunnel for 30 sec */
 #define IPTUNNEL_ERR_TIMEO	(30*HZ)
 
+/* Offloads of IPv4 tunnel devices; TCP segmentation and checksumming
+ * are done by the underlying device, in software if need be. */
+#define IPTUNNEL_FEATURES	(NETIF_F_SG | NETIF_F_FRAGLIST |	\
+				 NETIF_F_HIGHDMA | NETIF_F_HW_CSUM |	\
+				 NETIF_F_TSO | NETIF_F_TSO_ECN)
+
 struct ip_tunnel
 {
 	struct ip_tunnel	*next;
@@ -39,8 +47,11 @@ struct ip_tunnel_prl_entry
 	int err;							\
 	int pkt_len = skb->len - skb_transport_offset(skb);		\
 									\
-	skb->ip_summed = CHECKSUM_NONE;					\
-	ip_select_ident(iph, &rt->u.dst, NULL);				\
+	if (skb->ip_summed != CHECKSUM_PARTIAL)				\
+		skb->ip_summed = CHECKSUM_NONE;				\
+	ip_select_ident_more(iph, &rt->u.dst, NULL,			\
+			     skb_shinfo(skb)->gso_segs ?		\
+			     skb_shinfo(skb)->gso_segs - 1 : 0);	\
 									\
 	err = ip_local_out(skb);					\
 	if (net_xmit_eval(err) == 0) {					\
@@ -52,4 +63,25 @@ struct ip_tunnel_prl_entry
 	}								\
 } while (0)
 
+/* Size of the largest inner datagram a GSO packet is split into, for
+ * comparing against the tunnel's path MTU. */
+static inline unsigned int ip_tunnel_gso_seglen(const struct sk_buff *skb)
+{
+	unsigned int hlen = skb_transport_header(skb) - skb_network_header(skb);
+
+	if (skb_shinfo(skb)->gso_type & (SKB_GSO_TCPV4 | SKB_GSO_TCPV6))
+		hlen += tcp_hdrlen(skb);
+	else if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		hlen += sizeof(struct udphdr);
+
+	return hlen + skb_shinfo(skb)->gso_size;
+}
+
+extern struct sk_buff **ip_tunnel_gro_receive(struct sk_buff **head,
+					      struct sk_buff *skb,
+					      unsigned int hlen);
+extern int ip_tunnel_gro_complete(struct sk_buff *skb, unsigned int hlen);
+extern struct sk_buff *ip_tunnel_gso_segment(struct sk_buff *skb,
+					     int features, unsigned int hlen);
+
 #endif
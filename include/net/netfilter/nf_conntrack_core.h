@@ -73,6 +73,14 @@ print_tuple(struct seq_file *s, const struct nf_conntrack_tuple *tuple,
             const struct nf_conntrack_l3proto *l3proto,
             const struct nf_conntrack_l4proto *proto);
 
+/*
+ * The conntrack hash chains are protected by nf_conntrack_locks[], indexed
+ * by hash % CONNTRACK_LOCKS.  nf_conntrack_lock protects expectations,
+ * helpers and hash table resizing.
+ */
+#define CONNTRACK_LOCKS 1024
+
+extern spinlock_t nf_conntrack_locks[CONNTRACK_LOCKS];
 extern spinlock_t nf_conntrack_lock ;
 
 #endif /* _NF_CONNTRACK_CORE_H */
@@ -88,6 +88,8 @@ extern void qdisc_put_stab(struct qdisc_size_table *tab);
 extern void qdisc_warn_nonwc(char *txt, struct Qdisc *qdisc);
 
 extern void __qdisc_run(struct Qdisc *q);
+extern bool qdisc_bypass_xmit(struct sk_buff *skb, struct Qdisc *q,
+			      struct netdev_queue *txq);
 
 static inline void qdisc_run(struct Qdisc *q)
 {
@@ -45,6 +45,7 @@ struct Qdisc
 #define TCQ_F_BUILTIN		1
 #define TCQ_F_THROTTLED		2
 #define TCQ_F_INGRESS		4
+#define TCQ_F_CAN_BYPASS	8
 #define TCQ_F_WARN_NONWC	(1 << 16)
 	int			padded;
 	struct Qdisc_ops	*ops;
@@ -67,6 +68,8 @@ struct Qdisc
 	struct Qdisc		*next_sched;
 
 	struct sk_buff		*gso_skb;
+	/* per-cpu byte/packet counts of skbs that bypassed the queue */
+	struct gnet_stats_basic	*cpu_bstats;
 	/*
 	 * For performance sake on SMP, we put highly modified fields at the end
 	 */
@@ -298,6 +301,8 @@ extern void dev_activate(struct net_device *dev);
 extern void dev_deactivate(struct net_device *dev);
 extern void qdisc_reset(struct Qdisc *qdisc);
 extern void qdisc_destroy(struct Qdisc *qdisc);
+extern void qdisc_read_bstats(const struct Qdisc *qdisc,
+			      struct gnet_stats_basic *bstats);
 extern void qdisc_tree_decrease_qlen(struct Qdisc *qdisc, unsigned int n);
 extern struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
 				 struct Qdisc_ops *ops);
@@ -23,6 +23,7 @@
 #define _UDP_H
 
 #include <linux/list.h>
+#include <linux/jhash.h>
 #include <net/inet_sock.h>
 #include <net/sock.h>
 #include <net/snmp.h>
@@ -50,16 +51,50 @@ struct udp_skb_cb {
 };
 #define UDP_SKB_CB(__skb)	((struct udp_skb_cb *)((__skb)->cb))
 
+/**
+ *	struct udp_hslot - UDP hash slot
+ *
+ *	@head:	head of list of sockets
+ *	@count:	number of sockets in 'head' list
+ *	@lock:	spinlock protecting changes to head/count
+ */
 struct udp_hslot {
 	struct hlist_nulls_head	head;
+	int			count;
 	spinlock_t		lock;
 } __attribute__((aligned(2 * sizeof(long))));
+
+/**
+ *	struct udp_table - UDP table
+ *
+ *	@hash:	hash table, sockets are hashed on local port
+ *	@hash2:	hash table, sockets are hashed on (local port, local address)
+ */
 struct udp_table {
 	struct udp_hslot	hash[UDP_HTABLE_SIZE];
+	struct udp_hslot	hash2[UDP_HTABLE_SIZE];
 };
 extern struct udp_table udp_table;
 extern void udp_table_init(struct udp_table *);
 
+static inline struct udp_hslot *udp_hashslot2(struct udp_table *table,
+					      unsigned int hash)
+{
+	return &table->hash2[hash & (UDP_HTABLE_SIZE - 1)];
+}
+
+static inline unsigned int udp4_portaddr_hash(struct net *net, __be32 saddr,
+					      unsigned int port)
+{
+	return jhash_1word((__force u32)saddr, net_hash_mix(net)) ^ port;
+}
+
+/* Primary chains longer than this are looked up through the secondary hash */
+#define UDP_HSLOT2_THRESHOLD	10
+
+#define udp_portaddr_for_each_entry_rcu(__up, node, list) \
+	hlist_nulls_for_each_entry_rcu(__up, node, list, udp_portaddr_node)
+
 
 /* Note: this must match 'valbool' in sock_setsockopt */
 #define UDP_CSUM_NOXMIT		1
@@ -125,7 +160,9 @@ static inline void udp_lib_close(struct sock *sk, long timeout)
 }
 
 extern int	udp_lib_get_port(struct sock *sk, unsigned short snum,
-		int (*)(const struct sock*,const struct sock*));
+		int (*)(const struct sock*,const struct sock*),
+		unsigned int hash2_partial);
+extern void	udp_lib_rehash(struct sock *sk, unsigned int newhash);
 
 /* net/ipv4/udp.c */
 extern int	udp_get_port(struct sock *sk, unsigned short snum,
@@ -151,6 +188,11 @@ extern struct sock *udp4_lib_lookup(struct net *net, __be32 saddr, __be16 sport,
 				    __be32 daddr, __be16 dport,
 				    int dif);
 
+extern struct sk_buff *udp4_gso_segment(struct sk_buff *skb, int features);
+extern struct sk_buff **udp4_gro_receive(struct sk_buff **head,
+					 struct sk_buff *skb);
+extern int udp4_gro_complete(struct sk_buff *skb);
+
 /*
  * 	SNMP statistics for UDP and UDP-Lite
  */
@@ -187,28 +187,29 @@ extern const unsigned long __start___kcrctab_unused_gpl[];
 #define symversion(base, idx) ((base != NULL) ? ((base) + (idx)) : NULL)
 #endif
 
-static bool each_symbol_in_section(const struct symsearch *arr,
-				   unsigned int arrsize,
-				   struct module *owner,
-				   bool (*fn)(const struct symsearch *syms,
-					      struct module *owner,
-					      unsigned int symnum, void *data),
-				   void *data)
+static bool each_symbol_in_sections(const struct symsearch *arr,
+				    unsigned int arrsize,
+				    struct module *owner,
+				    bool (*fn)(const struct symsearch *syms,
+					       struct module *owner,
+					       void *data),
+				    void *data)
 {
-	unsigned int i, j;
+	unsigned int j;
 
 	for (j = 0; j < arrsize; j++) {
-		for (i = 0; i < arr[j].stop - arr[j].start; i++)
-			if (fn(&arr[j], owner, i, data))
-				return true;
+		if (fn(&arr[j], owner, data))
+			return true;
 	}
 
 	return false;
 }
 
 /* Returns true as soon as fn returns true, otherwise false. */
-bool each_symbol(bool (*fn)(const struct symsearch *arr, struct module *owner,
-			    unsigned int symnum, void *data), void *data)
+static bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
+					   struct module *owner,
+					   void *data),
+				void *data)
 {
 	struct module *mod;
 	const struct symsearch arr[] = {
@@ -230,7 +231,7 @@ bool each_symbol(bool (*fn)(const struct symsearch *arr, struct module *owner,
 #endif
 	};
 
-	if (each_symbol_in_section(arr, ARRAY_SIZE(arr), NULL, fn, data))
+	if (each_symbol_in_sections(arr, ARRAY_SIZE(arr), NULL, fn, data))
 		return true;
 
 	list_for_each_entry_rcu(mod, &modules, list) {
@@ -256,13 +257,96 @@ bool each_symbol(bool (*fn)(const struct symsearch *arr, struct module *owner,
 #endif
 		};
 
-		if (each_symbol_in_section(arr, ARRAY_SIZE(arr), mod, fn, data))
+		if (each_symbol_in_sections(arr, ARRAY_SIZE(arr), mod, fn,
+					    data))
 			return true;
 	}
 	return false;
 }
+
+struct each_symbol_arg {
+	bool (*fn)(const struct symsearch *arr, struct module *owner,
+		   unsigned int symnum, void *data);
+	void *data;
+};
+
+static bool each_symbol_in_section(const struct symsearch *syms,
+				   struct module *owner, void *data)
+{
+	struct each_symbol_arg *esa = data;
+	unsigned int i;
+
+	for (i = 0; i < syms->stop - syms->start; i++)
+		if (esa->fn(syms, owner, i, esa->data))
+			return true;
+
+	return false;
+}
+
+/* Returns true as soon as fn returns true, otherwise false. */
+bool each_symbol(bool (*fn)(const struct symsearch *arr, struct module *owner,
+			    unsigned int symnum, void *data), void *data)
+{
+	struct each_symbol_arg esa = {
+		.fn = fn,
+		.data = data,
+	};
+
+	return each_symbol_section(each_symbol_in_section, &esa);
+}
 EXPORT_SYMBOL_GPL(each_symbol);
 
+/*
+ * Look up name in a range of kernel_symbols.  Export tables are sorted
+ * by name, by the linker scripts or at module load, so bisect.
+ */
+static const struct kernel_symbol *lookup_symbol(const char *name,
+	const struct kernel_symbol *start,
+	const struct kernel_symbol *stop)
+{
+	while (start < stop) {
+		const struct kernel_symbol *ks = start + (stop - start) / 2;
+		int cmp = strcmp(name, ks->name);
+
+		if (cmp < 0)
+			stop = ks;
+		else if (cmp > 0)
+			start = ks + 1;
+		else
+			return ks;
+	}
+	return NULL;
+}
+
+/*
+ * Put an export table and its CRCs in name order.  Tables linked through
+ * scripts/module-common.lds are already sorted, which this insertion sort
+ * confirms in a single pass.  The tables are still writable at this point.
+ */
+static void sort_symbols(const struct kernel_symbol *start,
+			 const unsigned long *crcs, unsigned int num)
+{
+	struct kernel_symbol *syms = (struct kernel_symbol *)start;
+	unsigned long *crc = (unsigned long *)crcs;
+	unsigned int i, j;
+
+	for (i = 1; i < num; i++) {
+		struct kernel_symbol ks = syms[i];
+		unsigned long c = crc ? crc[i] : 0;
+
+		for (j = i; j > 0; j--) {
+			if (strcmp(syms[j - 1].name, ks.name) <= 0)
+				break;
+			syms[j] = syms[j - 1];
+			if (crc)
+				crc[j] = crc[j - 1];
+		}
+		syms[j] = ks;
+		if (crc)
+			crc[j] = c;
+	}
+}
+
 struct find_symbol_arg {
 	/* Input */
 	const char *name;
@@ -277,11 +361,13 @@ struct find_symbol_arg {
 
 static bool find_symbol_in_section(const struct symsearch *syms,
 				   struct module *owner,
-				   unsigned int symnum, void *data)
+				   void *data)
 {
 	struct find_symbol_arg *fsa = data;
+	const struct kernel_symbol *sym;
 
-	if (strcmp(syms->start[symnum].name, fsa->name) != 0)
+	sym = lookup_symbol(fsa->name, syms->start, syms->stop);
+	if (!sym)
 		return false;
 
 	if (!fsa->gplok) {
@@ -312,8 +398,8 @@ static bool find_symbol_in_section(const struct symsearch *syms,
 #endif
 
 	fsa->owner = owner;
-	fsa->crc = symversion(syms->crcs, symnum);
-	fsa->sym = &syms->start[symnum];
+	fsa->crc = symversion(syms->crcs, sym - syms->start);
+	fsa->sym = sym;
 	return true;
 }
 
@@ -331,7 +417,7 @@ const struct kernel_symbol *find_symbol(const char *name,
 	fsa.gplok = gplok;
 	fsa.warn = warn;
 
-	if (each_symbol(find_symbol_in_section, &fsa)) {
+	if (each_symbol_section(find_symbol_in_section, &fsa)) {
 		if (owner)
 			*owner = fsa.owner;
 		if (crc)
@@ -1765,18 +1851,6 @@ static void setup_modinfo(struct module *mod, Elf_Shdr *sechdrs,
 
 #ifdef CONFIG_KALLSYMS
 
-/* lookup symbol in given range of kernel_symbols */
-static const struct kernel_symbol *lookup_symbol(const char *name,
-	const struct kernel_symbol *start,
-	const struct kernel_symbol *stop)
-{
-	const struct kernel_symbol *ks = start;
-	for (; ks < stop; ks++)
-		if (strcmp(ks->name, name) == 0)
-			return ks;
-	return NULL;
-}
-
 static int is_exported(const char *name, unsigned long value,
 		       const struct module *mod)
 {
@@ -2211,6 +2285,18 @@ static noinline struct module *load_module(void __user *umod,
 			goto cleanup;
 	}
 
+	/* Export names are relocated now: sort for find_symbol(). */
+	sort_symbols(mod->syms, mod->crcs, mod->num_syms);
+	sort_symbols(mod->gpl_syms, mod->gpl_crcs, mod->num_gpl_syms);
+	sort_symbols(mod->gpl_future_syms, mod->gpl_future_crcs,
+		     mod->num_gpl_future_syms);
+#ifdef CONFIG_UNUSED_SYMBOLS
+	sort_symbols(mod->unused_syms, mod->unused_crcs,
+		     mod->num_unused_syms);
+	sort_symbols(mod->unused_gpl_syms, mod->unused_gpl_crcs,
+		     mod->num_unused_gpl_syms);
+#endif
+
         /* Find duplicate symbols */
 	err = verify_export_symbols(mod);
 	if (err < 0)
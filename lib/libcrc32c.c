@@ -32,14 +32,95 @@
  */
 
 #include <crypto/hash.h>
+#include <linux/crc32.h>
 #include <linux/err.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/random.h>
+#ifdef CONFIG_X86
+#include <asm/cpufeature.h>
+#endif
 
+/*
+ * The implementations crc32c() can use.  The fastest one is picked
+ * when the module is loaded and called directly, not through a
+ * function pointer.
+ */
+enum {
+	CRC32C_TABLE,	/* slice-by-8 tables in lib/crc32.c */
+	CRC32C_HW,	/* SSE4.2 crc32 instruction */
+	CRC32C_SHASH,	/* best "crc32c" driver of the crypto API */
+	CRC32C_NR_IMPLS,
+};
+
+static const char *crc32c_impl_names[CRC32C_NR_IMPLS] = {
+	[CRC32C_TABLE]	= "table",
+	[CRC32C_HW]	= "sse4.2",
+	[CRC32C_SHASH]	= "shash",
+};
+
+static int crc32c_impl __read_mostly = CRC32C_TABLE;
 static struct crypto_shash *tfm;
 
-u32 crc32c(u32 crc, const void *address, unsigned int length)
+#ifdef CONFIG_X86
+#ifdef CONFIG_X86_64
+#define REX_PRE "0x48, "
+#else
+#define REX_PRE
+#endif
+
+/* Same as the crc32c-intel crypto driver, without the crypto API */
+static u32 crc32c_hw(u32 crc, const unsigned char *p, unsigned int len)
+{
+	const unsigned long *ptmp = (const unsigned long *)p;
+	unsigned int iquotient = len / sizeof(unsigned long);
+	unsigned int iremainder = len % sizeof(unsigned long);
+
+	while (iquotient--) {
+		__asm__ __volatile__(
+			".byte 0xf2, " REX_PRE "0xf, 0x38, 0xf1, 0xf1;"
+			:"=S"(crc)
+			:"0"(crc), "c"(*ptmp)
+		);
+		ptmp++;
+	}
+
+	p = (const unsigned char *)ptmp;
+	while (iremainder--) {
+		__asm__ __volatile__(
+			".byte 0xf2, 0xf, 0x38, 0xf0, 0xf1"
+			:"=S"(crc)
+			:"0"(crc), "c"(*p)
+		);
+		p++;
+	}
+
+	return crc;
+}
+
+static int crc32c_hw_available(void)
+{
+	return cpu_has_xmm4_2;
+}
+#else
+static u32 crc32c_hw(u32 crc, const unsigned char *p, unsigned int len)
+{
+	BUG();
+	return crc;
+}
+
+static int crc32c_hw_available(void)
+{
+	return 0;
+}
+#endif
+
+static u32 crc32c_shash(u32 crc, const void *address, unsigned int length)
 {
 	struct {
 		struct shash_desc shash;
@@ -57,20 +138,107 @@ u32 crc32c(u32 crc, const void *address, unsigned int length)
 	return *(u32 *)desc.ctx;
 }
 
+static inline u32 __crc32c(int impl, u32 crc, const void *address,
+			   unsigned int length)
+{
+	if (impl == CRC32C_HW)
+		return crc32c_hw(crc, address, length);
+	if (impl == CRC32C_SHASH)
+		return crc32c_shash(crc, address, length);
+	return __crc32c_le(crc, address, length);
+}
+
+u32 crc32c(u32 crc, const void *address, unsigned int length)
+{
+	return __crc32c(crc32c_impl, crc, address, length);
+}
+
 EXPORT_SYMBOL(crc32c);
 
+#define CRC32C_BENCH_LEN	4096
+#define CRC32C_BENCH_LOOPS	64
+
+/*
+ * Returns the speed of an implementation in MB/s, or 0 if it does not
+ * agree with the table-driven one.
+ */
+static unsigned long __init crc32c_bench(int impl, const void *buf,
+					 u32 expect)
+{
+	ktime_t start;
+	u64 ns;
+	u32 crc = ~0;
+	int i;
+
+	if (__crc32c(impl, ~0, buf + 1, CRC32C_BENCH_LEN - 3) != expect) {
+		printk(KERN_WARNING "crc32c: %s implementation is broken\n",
+		       crc32c_impl_names[impl]);
+		return 0;
+	}
+
+	start = ktime_get();
+	for (i = 0; i < CRC32C_BENCH_LOOPS; i++)
+		crc = __crc32c(impl, crc, buf, CRC32C_BENCH_LEN);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	/* bytes per ns is GB/s */
+	return div64_u64((u64)CRC32C_BENCH_LEN * CRC32C_BENCH_LOOPS * 1000,
+			 ns ? ns : 1);
+}
+
+static void __init crc32c_select(void)
+{
+	unsigned long speed, best = 0;
+	void *buf;
+	u32 expect;
+	int impl;
+
+	buf = kmalloc(CRC32C_BENCH_LEN, GFP_KERNEL);
+	if (!buf)
+		return;
+	get_random_bytes(buf, CRC32C_BENCH_LEN);
+	/* Odd length at an odd offset exercises the unaligned tails */
+	expect = __crc32c_le(~0, buf + 1, CRC32C_BENCH_LEN - 3);
+
+	for (impl = 0; impl < CRC32C_NR_IMPLS; impl++) {
+		if (impl == CRC32C_HW && !crc32c_hw_available())
+			continue;
+		if (impl == CRC32C_SHASH && !tfm)
+			continue;
+		speed = crc32c_bench(impl, buf, expect);
+		printk(KERN_INFO "crc32c: %-8s %6lu MB/s\n",
+		       crc32c_impl_names[impl], speed);
+		if (speed > best) {
+			best = speed;
+			crc32c_impl = impl;
+		}
+	}
+	kfree(buf);
+
+	printk(KERN_INFO "crc32c: using %s implementation\n",
+	       crc32c_impl_names[crc32c_impl]);
+}
+
 static int __init libcrc32c_mod_init(void)
 {
+	/* The crypto API is only a candidate, not a requirement */
 	tfm = crypto_alloc_shash("crc32c", 0, 0);
 	if (IS_ERR(tfm))
-		return PTR_ERR(tfm);
+		tfm = NULL;
+
+	crc32c_select();
+	if (crc32c_impl != CRC32C_SHASH && tfm) {
+		crypto_free_shash(tfm);
+		tfm = NULL;
+	}
 
 	return 0;
 }
 
 static void __exit libcrc32c_mod_fini(void)
 {
-	crypto_free_shash(tfm);
+	if (tfm)
+		crypto_free_shash(tfm);
 }
 
 module_init(libcrc32c_mod_init);
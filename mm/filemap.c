@@ -649,6 +649,47 @@ int __lock_page_killable(struct page *page)
 }
 EXPORT_SYMBOL_GPL(__lock_page_killable);
 
+/**
+ * __lock_page_async - try to lock the page, queueing @wait if we cannot
+ * @page: the page to lock
+ * @wait: bit waiter to queue on the page's wait queue, or NULL
+ *
+ * Unlike the other lock_page variants the caller does not sleep: when the
+ * page is locked by somebody else @wait is queued and -EIOCBRETRY returned.
+ * The waiter's wake function (aio_wake_function for kiocbs) will run when
+ * the page is unlocked; it has to retry the lock itself.  @wait is only
+ * queued if it is not already on a wait queue.
+ */
+int __lock_page_async(struct page *page, struct wait_bit_queue *wait)
+{
+	wait_queue_head_t *q;
+	unsigned long flags;
+	int ret = -EIOCBRETRY;
+
+	if (!wait || !list_empty(&wait->wait.task_list))
+		return ret;
+
+	q = page_waitqueue(page);
+	wait->key.flags = &page->flags;
+	wait->key.bit_nr = PG_locked;
+
+	spin_lock_irqsave(&q->lock, flags);
+	__add_wait_queue_tail(q, &wait->wait);
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	/* Recheck, unlock_page() may have run before we were queued */
+	if (trylock_page(page)) {
+		spin_lock_irqsave(&q->lock, flags);
+		ret = list_empty(&wait->wait.task_list) ? -EIOCBRETRY : 0;
+		list_del_init(&wait->wait.task_list);
+		spin_unlock_irqrestore(&q->lock, flags);
+		if (ret)
+			unlock_page(page);
+	}
+	return ret;
+}
+EXPORT_SYMBOL(__lock_page_async);
+
 /**
  * __lock_page_nosync - get a lock on the page, without calling sync_page()
  * @page: the page to lock
@@ -1016,15 +1057,22 @@ static void shrink_readahead_size_eio(struct file *filp,
  * @ppos:	current file position
  * @desc:	read_descriptor
  * @actor:	read method
+ * @wait:	AIO waiter for asynchronous reads, or NULL
  *
  * This is a generic file read routine, and uses the
  * mapping->a_ops->readpage() function for the actual low-level stuff.
  *
+ * If @wait is non-NULL the read never sleeps on page I/O.  When a page
+ * is not yet uptodate the read stops with desc->error = -EIOCBRETRY,
+ * having queued @wait on the page if nothing was copied yet, so that
+ * the AIO core retries it once the page is unlocked.
+ *
  * This is really ugly. But the goto's actually try to clarify some
  * of the logic when it comes to error handling etc.
  */
 static void do_generic_file_read(struct file *filp, loff_t *ppos,
-		read_descriptor_t *desc, read_actor_t actor)
+		read_descriptor_t *desc, read_actor_t actor,
+		struct wait_bit_queue *wait)
 {
 	struct address_space *mapping = filp->f_mapping;
 	struct inode *inode = mapping->host;
@@ -1141,9 +1189,22 @@ page_ok:
 
 page_not_up_to_date:
 		/* Get exclusive access to the page ... */
-		error = lock_page_killable(page);
-		if (unlikely(error))
-			goto readpage_error;
+		if (wait) {
+			error = lock_page_async(page,
+						desc->written ? NULL : wait);
+			if (error)
+				goto readpage_error;
+			/* The read we were waiting for failed */
+			if (!PageUptodate(page) && PageError(page)) {
+				unlock_page(page);
+				error = -EIO;
+				goto readpage_error;
+			}
+		} else {
+			error = lock_page_killable(page);
+			if (unlikely(error))
+				goto readpage_error;
+		}
 
 page_not_up_to_date_locked:
 		/* Did it get truncated before we got the lock? */
@@ -1172,7 +1233,11 @@ readpage:
 		}
 
 		if (!PageUptodate(page)) {
-			error = lock_page_killable(page);
+			if (wait)
+				error = lock_page_async(page,
+						desc->written ? NULL : wait);
+			else
+				error = lock_page_killable(page);
 			if (unlikely(error))
 				goto readpage_error;
 			if (!PageUptodate(page)) {
@@ -1327,6 +1392,7 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 	unsigned long seg;
 	size_t count;
 	loff_t *ppos = &iocb->ki_pos;
+	struct wait_bit_queue *wait = NULL;
 
 	count = 0;
 	retval = generic_segment_checks(iov, &nr_segs, &count, VERIFY_WRITE);
@@ -1360,16 +1426,31 @@ generic_file_aio_read(struct kiocb *iocb, const struct iovec *iov,
 		}
 	}
 
+	/*
+	 * Buffered AIO reads don't block on page I/O: they return
+	 * -EIOCBRETRY and are retried from the aio workqueue when the
+	 * page they wait for is unlocked.
+	 */
+	if (!is_sync_kiocb(iocb))
+		wait = &iocb->ki_wait;
+
 	for (seg = 0; seg < nr_segs; seg++) {
 		read_descriptor_t desc;
 
+		/*
+		 * An async read that made progress returns it, so the
+		 * waiter is only ever queued before anything was copied.
+		 */
+		if (wait && retval)
+			break;
+
 		desc.written = 0;
 		desc.arg.buf = iov[seg].iov_base;
 		desc.count = iov[seg].iov_len;
 		if (desc.count == 0)
 			continue;
 		desc.error = 0;
-		do_generic_file_read(filp, ppos, &desc, file_read_actor);
+		do_generic_file_read(filp, ppos, &desc, file_read_actor, wait);
 		retval += desc.written;
 		if (desc.error) {
 			retval = retval ?: desc.error;
@@ -54,6 +54,7 @@
 #include <linux/cache.h>
 #include <linux/rtnetlink.h>
 #include <linux/init.h>
+#include <linux/cpu.h>
 #include <linux/scatterlist.h>
 #include <linux/errqueue.h>
 
@@ -72,6 +73,31 @@
 static struct kmem_cache *skbuff_head_cache __read_mostly;
 static struct kmem_cache *skbuff_fclone_cache __read_mostly;
 
+/*
+ * Per-cpu caches of receive buffers.  Devices flagged IFF_SKB_RECYCLE
+ * take their receive skbs from here, and __kfree_skb() refills the cache
+ * of the freeing cpu with any linear skb whose data buffer has exactly one
+ * of the recycle sizes, already reset to the state __alloc_skb() returns
+ * it in.  The sizes are chosen to use up whole kmalloc size classes.
+ */
+#define SKB_RECYCLE_CLASSES	4
+
+static const unsigned int skb_recycle_sizes[SKB_RECYCLE_CLASSES] = {
+	SKB_WITH_OVERHEAD(512),
+	SKB_WITH_OVERHEAD(1024),
+	SKB_WITH_OVERHEAD(2048),
+	SKB_WITH_OVERHEAD(4096),
+};
+
+struct skb_recycle_cache {
+	struct sk_buff_head	list[SKB_RECYCLE_CLASSES];
+};
+
+static DEFINE_PER_CPU(struct skb_recycle_cache, skb_recycle_cache);
+
+/* Upper bound on the number of skbs kept per size class and cpu */
+int sysctl_skb_recycle_max __read_mostly = 64;
+
 static void sock_pipe_buf_release(struct pipe_inode_info *pipe,
 				  struct pipe_buffer *buf)
 {
@@ -231,6 +257,40 @@ nodata:
 }
 EXPORT_SYMBOL(__alloc_skb);
 
+/*
+ *	Allocate a receive skb of at least size bytes from the recycle
+ *	cache of this cpu, falling back to __alloc_skb() with the size
+ *	rounded up to the recycle size class so the buffer can be cached
+ *	once it is freed.
+ */
+static struct sk_buff *skb_recycle_get(unsigned int size, gfp_t gfp_mask,
+				       int node)
+{
+	struct netif_rx_stats *stats;
+	struct sk_buff *skb;
+	unsigned long flags;
+	int i;
+
+	for (i = 0; i < SKB_RECYCLE_CLASSES; i++)
+		if (SKB_DATA_ALIGN(size) <= skb_recycle_sizes[i])
+			break;
+	if (i == SKB_RECYCLE_CLASSES)
+		return __alloc_skb(size, gfp_mask, 0, node);
+
+	local_irq_save(flags);
+	skb = __skb_dequeue(&__get_cpu_var(skb_recycle_cache).list[i]);
+	stats = &__get_cpu_var(netdev_rx_stat);
+	if (skb)
+		stats->recycle_hits++;
+	else
+		stats->recycle_misses++;
+	local_irq_restore(flags);
+
+	if (skb)
+		return skb;
+	return __alloc_skb(skb_recycle_sizes[i], gfp_mask, 0, node);
+}
+
 /**
  *	__netdev_alloc_skb - allocate an skbuff for rx on a specific device
  *	@dev: network device to receive on
@@ -250,7 +310,10 @@ struct sk_buff *__netdev_alloc_skb(struct net_device *dev,
 	int node = dev->dev.parent ? dev_to_node(dev->dev.parent) : -1;
 	struct sk_buff *skb;
 
-	skb = __alloc_skb(length + NET_SKB_PAD, gfp_mask, 0, node);
+	if ((dev->priv_flags & IFF_SKB_RECYCLE) && !(gfp_mask & __GFP_DMA))
+		skb = skb_recycle_get(length + NET_SKB_PAD, gfp_mask, node);
+	else
+		skb = __alloc_skb(length + NET_SKB_PAD, gfp_mask, 0, node);
 	if (likely(skb)) {
 		skb_reserve(skb, NET_SKB_PAD);
 		skb->dev = dev;
@@ -379,6 +442,75 @@ static void kfree_skbmem(struct sk_buff *skb)
 	}
 }
 
+/* Really free an skb from the recycle cache */
+static void skb_recycle_destroy(struct sk_buff *skb)
+{
+	kfree(skb->head);
+	kmem_cache_free(skbuff_head_cache, skb);
+}
+
+/*
+ *	Put an skb whose head state has been released into the recycle
+ *	cache of this cpu.  Returns 0 if the skb cannot be recycled and
+ *	has to be freed by the caller.
+ */
+static int skb_recycle_put(struct sk_buff *skb)
+{
+	struct skb_recycle_cache *rc;
+	struct skb_shared_info *shinfo;
+	unsigned long flags;
+	unsigned int size;
+	int i, queued = 0;
+
+	if (!sysctl_skb_recycle_max ||
+	    skb->fclone != SKB_FCLONE_UNAVAILABLE || skb->cloned)
+		return 0;
+
+	size = skb_end_pointer(skb) - skb->head;
+	for (i = 0; i < SKB_RECYCLE_CLASSES; i++)
+		if (size == skb_recycle_sizes[i])
+			break;
+	if (i == SKB_RECYCLE_CLASSES)
+		return 0;
+
+	shinfo = skb_shinfo(skb);
+	if (shinfo->nr_frags) {
+		int j;
+		for (j = 0; j < shinfo->nr_frags; j++)
+			put_page(shinfo->frags[j].page);
+	}
+	if (shinfo->frag_list)
+		skb_drop_fraglist(skb);
+
+	atomic_set(&shinfo->dataref, 1);
+	shinfo->nr_frags = 0;
+	shinfo->gso_size = 0;
+	shinfo->gso_segs = 0;
+	shinfo->gso_type = 0;
+	shinfo->ip6_frag_id = 0;
+	shinfo->tx_flags.flags = 0;
+	shinfo->frag_list = NULL;
+	memset(&shinfo->hwtstamps, 0, sizeof(shinfo->hwtstamps));
+
+	memset(skb, 0, offsetof(struct sk_buff, tail));
+	skb->truesize = size + sizeof(struct sk_buff);
+	atomic_set(&skb->users, 1);
+	skb->data = skb->head;
+	skb_reset_tail_pointer(skb);
+
+	local_irq_save(flags);
+	rc = &__get_cpu_var(skb_recycle_cache);
+	if (skb_queue_len(&rc->list[i]) < sysctl_skb_recycle_max) {
+		__skb_queue_head(&rc->list[i], skb);
+		queued = 1;
+	}
+	local_irq_restore(flags);
+
+	if (!queued)
+		skb_recycle_destroy(skb);
+	return 1;
+}
+
 static void skb_release_head_state(struct sk_buff *skb)
 {
 	dst_release(skb->dst);
@@ -423,7 +555,10 @@ static void skb_release_all(struct sk_buff *skb)
 
 void __kfree_skb(struct sk_buff *skb)
 {
-	skb_release_all(skb);
+	skb_release_head_state(skb);
+	if (skb_recycle_put(skb))
+		return;
+	skb_release_data(skb);
 	kfree_skbmem(skb);
 }
 EXPORT_SYMBOL(__kfree_skb);
@@ -2753,8 +2888,28 @@ done:
 }
 EXPORT_SYMBOL_GPL(skb_gro_receive);
 
+static int skb_recycle_cpu_callback(struct notifier_block *nfb,
+				    unsigned long action, void *hcpu)
+{
+	struct skb_recycle_cache *rc;
+	struct sk_buff *skb;
+	int i;
+
+	if (action != CPU_DEAD && action != CPU_DEAD_FROZEN)
+		return NOTIFY_OK;
+
+	rc = &per_cpu(skb_recycle_cache, (unsigned long)hcpu);
+	for (i = 0; i < SKB_RECYCLE_CLASSES; i++)
+		while ((skb = __skb_dequeue(&rc->list[i])) != NULL)
+			skb_recycle_destroy(skb);
+
+	return NOTIFY_OK;
+}
+
 void __init skb_init(void)
 {
+	int cpu, i;
+
 	skbuff_head_cache = kmem_cache_create("skbuff_head_cache",
 					      sizeof(struct sk_buff),
 					      0,
@@ -2766,6 +2921,14 @@ void __init skb_init(void)
 						0,
 						SLAB_HWCACHE_ALIGN|SLAB_PANIC,
 						NULL);
+
+	for_each_possible_cpu(cpu) {
+		struct skb_recycle_cache *rc = &per_cpu(skb_recycle_cache, cpu);
+
+		for (i = 0; i < SKB_RECYCLE_CLASSES; i++)
+			__skb_queue_head_init(&rc->list[i]);
+	}
+	hotcpu_notifier(skb_recycle_cpu_callback, 0);
 }
 
 /**
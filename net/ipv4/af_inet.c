@@ -1189,6 +1189,7 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb, int features)
 	int proto;
 	int ihl;
 	int id;
+	int fixedid;
 
 	if (!(features & NETIF_F_V4_CSUM))
 		features &= ~NETIF_F_SG;
@@ -1198,6 +1199,8 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb, int features)
 		       SKB_GSO_UDP |
 		       SKB_GSO_DODGY |
 		       SKB_GSO_TCP_ECN |
+		       SKB_GSO_TUNNEL |
+		       SKB_GSO_UDP_L4 |
 		       0)))
 		goto out;
 
@@ -1216,6 +1219,8 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb, int features)
 	skb_reset_transport_header(skb);
 	iph = ip_hdr(skb);
 	id = ntohs(iph->id);
+	/* Atomic datagrams sent without a socket (tunnels) keep id 0. */
+	fixedid = !id && iph->frag_off == htons(IP_DF);
 	proto = iph->protocol & (MAX_INET_PROTOS - 1);
 	segs = ERR_PTR(-EPROTONOSUPPORT);
 
@@ -1231,7 +1236,9 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb, int features)
 	skb = segs;
 	do {
 		iph = ip_hdr(skb);
-		iph->id = htons(id++);
+		iph->id = htons(id);
+		if (!fixedid)
+			id++;
 		iph->tot_len = htons(skb->len - skb->mac_len);
 		iph->check = 0;
 		iph->check = ip_fast_csum(skb_network_header(skb), iph->ihl);
@@ -1290,9 +1297,13 @@ static struct sk_buff **inet_gro_receive(struct sk_buff **head,
 		}
 
 		/* All fields must match except length and checksum. */
-		NAPI_GRO_CB(p)->flush |=
-			(iph->ttl ^ iph2->ttl) |
-			((u16)(ntohs(iph2->id) + NAPI_GRO_CB(p)->count) ^ id);
+		NAPI_GRO_CB(p)->flush |= iph->ttl ^ iph2->ttl;
+
+		/* Ids must be consecutive, unless they are all zero on
+		 * atomic datagrams as tunnels send them. */
+		if (id || iph2->id || iph->frag_off != htons(IP_DF))
+			NAPI_GRO_CB(p)->flush |=
+				(u16)(ntohs(iph2->id) + NAPI_GRO_CB(p)->count) ^ id;
 
 		NAPI_GRO_CB(p)->flush |= flush;
 	}
@@ -1336,6 +1347,103 @@ out_unlock:
 	return err;
 }
 
+/*
+ *	IPIP and GRE carry a second IP header @hlen bytes past the outer
+ *	one.  The helpers below let the tunnel protocols run the inner
+ *	IPv4/TCP offload handlers: the network header is pointed at the
+ *	inner IP header for the duration of the call, since the inner
+ *	handlers compare held packets through ip_hdr().
+ */
+struct sk_buff **ip_tunnel_gro_receive(struct sk_buff **head,
+				       struct sk_buff *skb, unsigned int hlen)
+{
+	struct sk_buff **pp;
+	struct sk_buff *p;
+	struct iphdr *iph;
+	int nhoff;
+
+	iph = skb_gro_header(skb, sizeof(*iph));
+	if (unlikely(!iph) || iph->protocol != IPPROTO_TCP) {
+		NAPI_GRO_CB(skb)->flush = 1;
+		return NULL;
+	}
+
+	nhoff = skb_network_offset(skb);
+	skb_set_network_header(skb, skb_gro_offset(skb));
+	for (p = *head; p; p = p->next) {
+		if (NAPI_GRO_CB(p)->same_flow)
+			skb_set_network_header(p, skb_network_offset(p) +
+					       sizeof(struct iphdr) + hlen);
+	}
+
+	pp = inet_gro_receive(head, skb);
+
+	skb_set_network_header(skb, nhoff);
+	for (p = *head; p; p = p->next)
+		p->network_header = p->mac_header + p->mac_len;
+
+	return pp;
+}
+EXPORT_SYMBOL(ip_tunnel_gro_receive);
+
+int ip_tunnel_gro_complete(struct sk_buff *skb, unsigned int hlen)
+{
+	int nhoff = skb_network_offset(skb);
+	int err;
+
+	skb_set_network_header(skb, nhoff + sizeof(struct iphdr) + hlen);
+	err = inet_gro_complete(skb);
+	skb_set_network_header(skb, nhoff);
+
+	skb_shinfo(skb)->gso_type |= SKB_GSO_TUNNEL;
+
+	return err;
+}
+EXPORT_SYMBOL(ip_tunnel_gro_complete);
+
+/*
+ *	Segment a tunnelled TCP packet.  On entry skb->data points at the
+ *	tunnel header; the outer IP header (and anything before it) is
+ *	replicated into every segment together with the inner headers and
+ *	fixed up by the caller, inet_gso_segment().
+ */
+struct sk_buff *ip_tunnel_gso_segment(struct sk_buff *skb, int features,
+				      unsigned int hlen)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	int mac_len = skb->mac_len;
+
+	if (unlikely(!(skb_shinfo(skb)->gso_type & SKB_GSO_TUNNEL)))
+		goto out;
+
+	if (unlikely(!pskb_may_pull(skb, hlen + sizeof(struct iphdr))))
+		goto out;
+
+	__skb_pull(skb, hlen);
+	skb_reset_network_header(skb);
+	if (ip_hdr(skb)->protocol != IPPROTO_TCP)
+		goto out;
+	skb->mac_len = skb->network_header - skb->mac_header;
+
+	/* Only a device with generic checksumming can find the inner
+	 * transport header, otherwise checksum in software. */
+	if (!(features & NETIF_F_GEN_CSUM))
+		features &= ~NETIF_F_SG;
+
+	segs = inet_gso_segment(skb, features);
+	if (IS_ERR(segs))
+		goto out;
+
+	for (skb = segs; skb; skb = skb->next) {
+		skb->mac_len = mac_len;
+		skb_set_network_header(skb, mac_len);
+	}
+
+out:
+	return segs;
+}
+EXPORT_SYMBOL(ip_tunnel_gso_segment);
+
 int inet_ctl_sock_create(struct sock **sk, unsigned short family,
 			 unsigned short type, unsigned char protocol,
 			 struct net *net)
@@ -1420,6 +1528,9 @@ static struct net_protocol tcp_protocol = {
 static struct net_protocol udp_protocol = {
 	.handler =	udp_rcv,
 	.err_handler =	udp_err,
+	.gso_segment =	udp4_gso_segment,
+	.gro_receive =	udp4_gro_receive,
+	.gro_complete =	udp4_gro_complete,
 	.no_policy =	1,
 	.netns_ok =	1,
 };
@@ -599,6 +599,7 @@ static int ipgre_rcv(struct sk_buff *skb)
 		__pskb_pull(skb, offset);
 		skb_postpull_rcsum(skb, skb_transport_header(skb), offset);
 		skb->pkt_type = PACKET_HOST;
+		skb_shinfo(skb)->gso_type &= ~SKB_GSO_TUNNEL;
 #ifdef CONFIG_NET_IPGRE_BROADCAST
 		if (ipv4_is_multicast(iph->daddr)) {
 			/* Looped back packet, drop it! */
@@ -775,7 +776,8 @@ static int ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev)
 		df |= (old_iph->frag_off&htons(IP_DF));
 
 		if ((old_iph->frag_off&htons(IP_DF)) &&
-		    mtu < ntohs(old_iph->tot_len)) {
+		    mtu < (skb_is_gso(skb) ? ip_tunnel_gso_seglen(skb) :
+					     ntohs(old_iph->tot_len))) {
 			icmp_send(skb, ICMP_DEST_UNREACH, ICMP_FRAG_NEEDED, htonl(mtu));
 			ip_rt_put(rt);
 			goto tx_error;
@@ -814,8 +816,10 @@ static int ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev)
 
 	max_headroom = LL_RESERVED_SPACE(tdev) + gre_hlen;
 
+	/* A GSO packet gets its own skb_shared_info, gso_type changes. */
 	if (skb_headroom(skb) < max_headroom || skb_shared(skb)||
-	    (skb_cloned(skb) && !skb_clone_writable(skb, 0))) {
+	    (skb_cloned(skb) &&
+	     (!skb_clone_writable(skb, 0) || skb_is_gso(skb)))) {
 		struct sk_buff *new_skb = skb_realloc_headroom(skb, max_headroom);
 		if (!new_skb) {
 			ip_rt_put(rt);
@@ -831,6 +835,16 @@ static int ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev)
 		old_iph = ip_hdr(skb);
 	}
 
+	if (skb_is_gso(skb))
+		skb_shinfo(skb)->gso_type |= SKB_GSO_TUNNEL;
+	else if (skb->ip_summed == CHECKSUM_PARTIAL) {
+		if (skb_checksum_help(skb)) {
+			ip_rt_put(rt);
+			goto tx_error;
+		}
+		old_iph = ip_hdr(skb);
+	}
+
 	skb_reset_transport_header(skb);
 	skb_push(skb, gre_hlen);
 	skb_reset_network_header(skb);
@@ -1266,6 +1280,14 @@ static int ipgre_tunnel_init(struct net_device *dev)
 	} else
 		dev->header_ops = &ipgre_header_ops;
 
+	/* Segmentation replicates the GRE header, which rules out
+	 * per-packet checksums and sequence numbers. */
+	if (!dev->header_ops &&
+	    !(tunnel->parms.o_flags & (GRE_CSUM | GRE_SEQ))) {
+		dev->features |= IPTUNNEL_FEATURES;
+		netif_set_gso_max_size(dev, GSO_MAX_SIZE - tunnel->hlen);
+	}
+
 	return 0;
 }
 
@@ -1288,9 +1310,78 @@ static void ipgre_fb_tunnel_init(struct net_device *dev)
 }
 
 
+/*
+ *	Offloads for GRE version 0 carrying IPv4, without checksum,
+ *	sequence number or routing fields.  The key, if present, is
+ *	compared on receive and replicated into every segment on send.
+ */
+static struct sk_buff *ipgre_gso_segment(struct sk_buff *skb, int features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	__be16 *h;
+
+	if (unlikely(!pskb_may_pull(skb, 4)))
+		goto out;
+
+	h = (__be16 *)skb->data;
+	if ((h[0] & (GRE_CSUM|GRE_ROUTING|GRE_SEQ|GRE_VERSION)) ||
+	    h[1] != htons(ETH_P_IP))
+		goto out;
+
+	segs = ip_tunnel_gso_segment(skb, features, h[0] & GRE_KEY ? 8 : 4);
+out:
+	return segs;
+}
+
+static struct sk_buff **ipgre_gro_receive(struct sk_buff **head,
+					  struct sk_buff *skb)
+{
+	struct sk_buff *p;
+	unsigned int hlen = 4;
+	__be16 *h;
+
+	h = skb_gro_header(skb, 8);
+	if (unlikely(!h))
+		goto flush;
+
+	if ((h[0] & (GRE_CSUM|GRE_ROUTING|GRE_SEQ|GRE_VERSION)) ||
+	    h[1] != htons(ETH_P_IP))
+		goto flush;
+
+	if (h[0] & GRE_KEY)
+		hlen += 4;
+
+	for (p = *head; p; p = p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		if (memcmp(skb_network_header(p) + sizeof(struct iphdr),
+			   h, hlen))
+			NAPI_GRO_CB(p)->same_flow = 0;
+	}
+
+	skb_gro_pull(skb, hlen);
+
+	return ip_tunnel_gro_receive(head, skb, hlen);
+
+flush:
+	NAPI_GRO_CB(skb)->flush = 1;
+	return NULL;
+}
+
+static int ipgre_gro_complete(struct sk_buff *skb)
+{
+	__be16 *h = (__be16 *)(skb_network_header(skb) + sizeof(struct iphdr));
+
+	return ip_tunnel_gro_complete(skb, h[0] & GRE_KEY ? 8 : 4);
+}
+
 static struct net_protocol ipgre_protocol = {
 	.handler	=	ipgre_rcv,
 	.err_handler	=	ipgre_err,
+	.gso_segment	=	ipgre_gso_segment,
+	.gro_receive	=	ipgre_gro_receive,
+	.gro_complete	=	ipgre_gro_complete,
 	.netns_ok	=	1,
 };
 
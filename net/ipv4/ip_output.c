@@ -753,9 +753,18 @@ static inline int ip_ufo_append_data(struct sock *sk,
 		skb->csum = 0;
 		sk->sk_sndmsg_off = 0;
 
-		/* specify the length of each IP datagram fragment */
-		skb_shinfo(skb)->gso_size = mtu - fragheaderlen;
-		skb_shinfo(skb)->gso_type = SKB_GSO_UDP;
+		if (inet_sk(sk)->cork.gso_size) {
+			/* one UDP datagram per gso_size bytes of payload */
+			skb_shinfo(skb)->gso_size = inet_sk(sk)->cork.gso_size;
+			skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+			skb_shinfo(skb)->gso_segs =
+				DIV_ROUND_UP(length - transhdrlen,
+					     inet_sk(sk)->cork.gso_size);
+		} else {
+			/* specify the length of each IP datagram fragment */
+			skb_shinfo(skb)->gso_size = mtu - fragheaderlen;
+			skb_shinfo(skb)->gso_type = SKB_GSO_UDP;
+		}
 		__skb_queue_tail(&sk->sk_write_queue, skb);
 	}
 
@@ -859,9 +868,10 @@ int ip_append_data(struct sock *sk,
 		csummode = CHECKSUM_PARTIAL;
 
 	inet->cork.length += length;
-	if (((length> mtu) || !skb_queue_empty(&sk->sk_write_queue)) &&
-	    (sk->sk_protocol == IPPROTO_UDP) &&
-	    (rt->u.dst.dev->features & NETIF_F_UFO)) {
+	if (inet->cork.gso_size ||
+	    (((length> mtu) || !skb_queue_empty(&sk->sk_write_queue)) &&
+	     (sk->sk_protocol == IPPROTO_UDP) &&
+	     (rt->u.dst.dev->features & NETIF_F_UFO))) {
 		err = ip_ufo_append_data(sk, getfrag, from, length, hh_len,
 					 fragheaderlen, transhdrlen, mtu,
 					 flags);
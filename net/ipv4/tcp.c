@@ -2198,6 +2198,10 @@ static int do_tcp_setsockopt(struct sock *sk, int level,
 		}
 		break;
 
+	case TCP_PACING:
+		tp->pacing = !!val;
+		break;
+
 #ifdef CONFIG_TCP_MD5SIG
 	case TCP_MD5SIG:
 		/* Read the IP->Key mappings from userspace */
@@ -2372,6 +2376,9 @@ static int do_tcp_getsockopt(struct sock *sk, int level,
 	case TCP_QUICKACK:
 		val = !icsk->icsk_ack.pingpong;
 		break;
+	case TCP_PACING:
+		val = tp->pacing;
+		break;
 
 	case TCP_CONGESTION:
 		if (get_user(len, optlen))
@@ -2920,6 +2927,7 @@ void __init tcp_init(void)
 	       tcp_hashinfo.ehash_size, tcp_hashinfo.bhash_size);
 
 	tcp_register_congestion_control(&tcp_reno);
+	tcp_tasklet_init();
 }
 
 EXPORT_SYMBOL(tcp_close);
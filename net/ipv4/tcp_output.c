@@ -59,6 +59,15 @@ int sysctl_tcp_base_mss __read_mostly = 512;
 /* By default, RFC2861 behavior.  */
 int sysctl_tcp_slow_start_after_idle __read_mostly = 1;
 
+/* Bytes a socket may have queued in qdiscs and device rings before
+ * tcp_write_xmit() stops and waits for some of them to be freed.
+ * Zero disables the limit.
+ */
+int sysctl_tcp_limit_output_bytes __read_mostly = 131072;
+
+/* Default for the TCP_PACING socket option. */
+int sysctl_tcp_pacing __read_mostly = 0;
+
 static void tcp_event_new_data_sent(struct sock *sk, struct sk_buff *skb)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
@@ -580,6 +589,147 @@ static unsigned tcp_established_options(struct sock *sk, struct sk_buff *skb,
 	return size;
 }
 
+/* TCP small queues (TSQ)
+ *
+ * Limit the number of bytes a socket keeps in qdiscs and device queues
+ * so that bulk senders do not build standing queues below the stack.
+ * When tcp_write_xmit() hits the limit it sets TSQ_THROTTLED; the
+ * destructor of the next skb freed below us then hands the socket to a
+ * per-cpu tasklet which resumes transmission.
+ */
+struct tsq_tasklet {
+	struct tasklet_struct	tasklet;
+	struct list_head	head; /* queue of tcp sockets */
+};
+static DEFINE_PER_CPU(struct tsq_tasklet, tsq_tasklet);
+
+/* Queue sk to this cpu's TSQ tasklet.  The caller's reference on sk is
+ * handed over to the tasklet, or dropped if sk is already queued.
+ */
+static void tcp_tsq_queue(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct tsq_tasklet *tsq;
+	unsigned long flags;
+
+	if (test_and_set_bit(TSQ_QUEUED, &tp->tsq_flags)) {
+		sock_put(sk);
+		return;
+	}
+
+	local_irq_save(flags);
+	tsq = &__get_cpu_var(tsq_tasklet);
+	list_add(&tp->tsq_node, &tsq->head);
+	tasklet_schedule(&tsq->tasklet);
+	local_irq_restore(flags);
+}
+
+/* Write buffer destructor for skbs sent by tcp_transmit_skb(). */
+static void tcp_wfree(struct sk_buff *skb)
+{
+	struct sock *sk = skb->sk;
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (test_and_clear_bit(TSQ_THROTTLED, &tp->tsq_flags)) {
+		/* Keep the reference from skb_set_owner_w() for the tasklet */
+		atomic_sub(skb->truesize, &sk->sk_wmem_alloc);
+		tcp_tsq_queue(sk);
+		return;
+	}
+	sock_wfree(skb);
+}
+
+/* Returns nonzero if too many bytes are queued below the socket. */
+static int tcp_tsq_throttle(struct sock *sk)
+{
+	int limit = sysctl_tcp_limit_output_bytes;
+
+	if (!limit || atomic_read(&sk->sk_wmem_alloc) <= limit)
+		return 0;
+
+	set_bit(TSQ_THROTTLED, &tcp_sk(sk)->tsq_flags);
+	/* An skb may have been freed before THROTTLED became visible to
+	 * tcp_wfree(); check again so that we do not wait forever.
+	 */
+	smp_mb__after_clear_bit();
+	return atomic_read(&sk->sk_wmem_alloc) > limit;
+}
+
+/* Pacing
+ *
+ * With TCP_PACING set, new data leaves at pacing_rate instead of in
+ * bursts as ACKs arrive.  The rate is twice cwnd per smoothed RTT, so
+ * that slow start can still double the window every round trip.
+ */
+void tcp_update_pacing_rate(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u64 rate;
+
+	/* srtt is kept in jiffies << 3 and never drops below 1 once
+	 * sampled.  Up to a single jiffy (8) we either have no estimate
+	 * or the RTT is below the clock resolution, and a rate derived
+	 * from it would be far too low.  Do not pace then.
+	 */
+	if (!tp->pacing || tp->srtt <= 8) {
+		tp->pacing_rate = 0;
+		return;
+	}
+
+	rate = (u64)tp->mss_cache * 2 * max(tp->snd_cwnd, tp->packets_out);
+	rate *= HZ << 3;
+	do_div(rate, tp->srtt);
+	tp->pacing_rate = min_t(u64, rate, ~0U);
+}
+
+/* Fires at pacing_next and lets the TSQ tasklet resume transmission. */
+enum hrtimer_restart tcp_pace_kick(struct hrtimer *timer)
+{
+	struct tcp_sock *tp = container_of(timer, struct tcp_sock,
+					   pacing_timer);
+
+	tcp_tsq_queue((struct sock *)tp);
+	return HRTIMER_NORESTART;
+}
+
+/* Returns nonzero if the next segment must wait for the pacing timer. */
+static int tcp_pacing_defer(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (!tp->pacing || !tp->pacing_rate)
+		return 0;
+
+	if (ktime_to_ns(tp->pacing_next) <= ktime_to_ns(ktime_get()))
+		return 0;
+
+	if (!hrtimer_active(&tp->pacing_timer)) {
+		sock_hold(sk);
+		hrtimer_start(&tp->pacing_timer, tp->pacing_next,
+			      HRTIMER_MODE_ABS);
+	}
+	return 1;
+}
+
+static void tcp_pacing_advance(struct sock *sk, unsigned int len)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	ktime_t now;
+	u64 delay;
+
+	if (!tp->pacing || !tp->pacing_rate)
+		return;
+
+	/* Idle time does not earn credit for a later burst. */
+	now = ktime_get();
+	if (ktime_to_ns(tp->pacing_next) < ktime_to_ns(now))
+		tp->pacing_next = now;
+
+	delay = (u64)len * NSEC_PER_SEC;
+	do_div(delay, tp->pacing_rate);
+	tp->pacing_next = ktime_add_ns(tp->pacing_next, delay);
+}
+
 /* This routine actually transmits TCP packets queued in by
  * tcp_do_sendmsg().  This is used by both the initial
  * transmission and possible later retransmissions.
@@ -640,6 +790,7 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 	skb_push(skb, tcp_header_size);
 	skb_reset_transport_header(skb);
 	skb_set_owner_w(skb, sk);
+	skb->destructor = tcp_wfree;
 
 	/* Build TCP header and checksum it. */
 	th = tcp_hdr(skb);
@@ -1512,7 +1663,8 @@ static int tcp_mtu_probe(struct sock *sk)
  * account rare use of URG, this is not a big flaw.
  *
  * Returns 1, if no segments are in flight and we have queued segments, but
- * cannot send anything now because of SWS or another problem.
+ * cannot send anything now because of SWS or another problem.  Waiting
+ * for the pacing timer or for TSQ to free space is not such a problem.
  */
 static int tcp_write_xmit(struct sock *sk, unsigned int mss_now, int nonagle,
 			  int push_one, gfp_t gfp)
@@ -1522,6 +1674,7 @@ static int tcp_write_xmit(struct sock *sk, unsigned int mss_now, int nonagle,
 	unsigned int tso_segs, sent_pkts;
 	int cwnd_quota;
 	int result;
+	int deferred = 0;
 
 	sent_pkts = 0;
 
@@ -1558,6 +1711,16 @@ static int tcp_write_xmit(struct sock *sk, unsigned int mss_now, int nonagle,
 				break;
 		}
 
+		if (tcp_pacing_defer(sk)) {
+			deferred = 1;
+			break;
+		}
+
+		if (tcp_tsq_throttle(sk)) {
+			deferred = 1;
+			break;
+		}
+
 		limit = mss_now;
 		if (tso_segs > 1 && !tcp_urg_mode(tp))
 			limit = tcp_mss_split_point(sk, skb, mss_now,
@@ -1578,6 +1741,7 @@ static int tcp_write_xmit(struct sock *sk, unsigned int mss_now, int nonagle,
 		tcp_event_new_data_sent(sk, skb);
 
 		tcp_minshall_update(tp, mss_now, skb);
+		tcp_pacing_advance(sk, skb->len);
 		sent_pkts++;
 
 		if (push_one)
@@ -1588,7 +1752,84 @@ static int tcp_write_xmit(struct sock *sk, unsigned int mss_now, int nonagle,
 		tcp_cwnd_validate(sk);
 		return 0;
 	}
-	return !tp->packets_out && tcp_send_head(sk);
+	return !tp->packets_out && tcp_send_head(sk) && !deferred;
+}
+
+/* Called with the socket locked, either from the TSQ tasklet or from
+ * tcp_release_cb(), once there is room below us or the pacing timer
+ * has fired.
+ */
+static void tcp_tsq_handler(struct sock *sk)
+{
+	if ((1 << sk->sk_state) &
+	    (TCPF_ESTABLISHED | TCPF_FIN_WAIT1 | TCPF_CLOSING |
+	     TCPF_CLOSE_WAIT | TCPF_LAST_ACK))
+		__tcp_push_pending_frames(sk, tcp_current_mss(sk),
+					  tcp_sk(sk)->nonagle);
+}
+
+/* One tasklet per cpu tries to send more skbs.  We run in tasklet
+ * context to avoid possible recursion: tcp_write_xmit() can call
+ * dev_queue_xmit(), and skbs can be freed from the same path.
+ */
+static void tcp_tasklet_func(unsigned long data)
+{
+	struct tsq_tasklet *tsq = (struct tsq_tasklet *)data;
+	LIST_HEAD(list);
+	unsigned long flags;
+	struct list_head *q, *n;
+	struct tcp_sock *tp;
+	struct sock *sk;
+
+	local_irq_save(flags);
+	list_splice_init(&tsq->head, &list);
+	local_irq_restore(flags);
+
+	list_for_each_safe(q, n, &list) {
+		tp = list_entry(q, struct tcp_sock, tsq_node);
+		list_del(&tp->tsq_node);
+		sk = (struct sock *)tp;
+
+		/* Clear QUEUED before sending, so that a destructor running
+		 * after tcp_write_xmit() throttled again requeues us.
+		 */
+		clear_bit(TSQ_QUEUED, &tp->tsq_flags);
+		smp_mb__after_clear_bit();
+
+		bh_lock_sock(sk);
+		if (!sock_owned_by_user(sk))
+			tcp_tsq_handler(sk);
+		else
+			set_bit(TCP_TSQ_DEFERRED, &tp->tsq_flags);
+		bh_unlock_sock(sk);
+
+		sock_put(sk);
+	}
+}
+
+/* Run the TSQ work deferred by tcp_tasklet_func() while the socket
+ * was owned by the user.  Called from release_sock().
+ */
+void tcp_release_cb(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (test_and_clear_bit(TCP_TSQ_DEFERRED, &tp->tsq_flags))
+		tcp_tsq_handler(sk);
+}
+EXPORT_SYMBOL(tcp_release_cb);
+
+void __init tcp_tasklet_init(void)
+{
+	int i;
+
+	for_each_possible_cpu(i) {
+		struct tsq_tasklet *tsq = &per_cpu(tsq_tasklet, i);
+
+		INIT_LIST_HEAD(&tsq->head);
+		tasklet_init(&tsq->tasklet, tcp_tasklet_func,
+			     (unsigned long)tsq);
+	}
 }
 
 /* Push out any pending frames which were held back due to
@@ -10,6 +10,7 @@
 #include <linux/skbuff.h>
 #include <net/icmp.h>
 #include <net/ip.h>
+#include <net/ipip.h>
 #include <net/protocol.h>
 #include <net/xfrm.h>
 
@@ -132,9 +133,28 @@ static void tunnel64_err(struct sk_buff *skb, u32 info)
 }
 #endif
 
+static struct sk_buff *tunnel4_gso_segment(struct sk_buff *skb, int features)
+{
+	return ip_tunnel_gso_segment(skb, features, 0);
+}
+
+static struct sk_buff **tunnel4_gro_receive(struct sk_buff **head,
+					    struct sk_buff *skb)
+{
+	return ip_tunnel_gro_receive(head, skb, 0);
+}
+
+static int tunnel4_gro_complete(struct sk_buff *skb)
+{
+	return ip_tunnel_gro_complete(skb, 0);
+}
+
 static struct net_protocol tunnel4_protocol = {
 	.handler	=	tunnel4_rcv,
 	.err_handler	=	tunnel4_err,
+	.gso_segment	=	tunnel4_gso_segment,
+	.gro_receive	=	tunnel4_gro_receive,
+	.gro_complete	=	tunnel4_gro_complete,
 	.no_policy	=	1,
 	.netns_ok	=	1,
 };
@@ -157,7 +157,42 @@ struct packet_mreq_max
 };
 
 #ifdef CONFIG_PACKET_MMAP
-static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing);
+static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
+			   int closing, int tx_ring);
+
+/* Kernel side state of a TPACKET_V3 block-based receive ring */
+struct tpacket_kbdq_core {
+	unsigned int		knum_blocks;
+	unsigned int		kblk_size;
+	unsigned int		blk_sizeof_priv;
+	unsigned int		max_frame_len;
+	unsigned int		kactive_blk_num;	/* block being filled */
+	unsigned int		blk_open:1,
+				frozen:1,	/* user space owns kactive_blk_num */
+				delete_blk_timer:1;
+	char			*pkblk_start;
+	char			*pkblk_end;
+	char			*nxt_offset;	/* where the next packet goes */
+	char			*prev;		/* last packet in the block */
+	u64			knxt_seq_num;
+	atomic_t		blk_fill_in_prog;
+	unsigned long		tov_in_jiffies;
+	struct timer_list	retire_blk_timer;
+};
+
+struct packet_ring_buffer {
+	char *			*pg_vec;
+	unsigned int		head;
+	unsigned int		frames_per_block;
+	unsigned int		frame_size;
+	unsigned int		frame_max;
+
+	unsigned int		pg_vec_order;
+	unsigned int		pg_vec_pages;
+	unsigned int		pg_vec_len;
+
+	struct tpacket_kbdq_core prb_bdqc;
+};
 #endif
 
 static void packet_flush_mclist(struct sock *sk);
@@ -166,12 +201,10 @@ struct packet_sock {
 	/* struct sock has to be the first member of packet_sock */
 	struct sock		sk;
 	struct tpacket_stats	stats;
+	unsigned int		freeze_q_cnt;
 #ifdef CONFIG_PACKET_MMAP
-	char *			*pg_vec;
-	unsigned int		head;
-	unsigned int            frames_per_block;
-	unsigned int		frame_size;
-	unsigned int		frame_max;
+	struct packet_ring_buffer	rx_ring;
+	struct packet_ring_buffer	tx_ring;
 	int			copy_thresh;
 #endif
 	struct packet_type	prot_hook;
@@ -185,12 +218,10 @@ struct packet_sock {
 	struct packet_mclist	*mclist;
 #ifdef CONFIG_PACKET_MMAP
 	atomic_t		mapped;
-	unsigned int            pg_vec_order;
-	unsigned int		pg_vec_pages;
-	unsigned int		pg_vec_len;
 	enum tpacket_versions	tp_version;
 	unsigned int		tp_hdrlen;
 	unsigned int		tp_reserve;
+	unsigned int		tp_loss:1;
 #endif
 };
 
@@ -206,36 +237,28 @@ struct packet_skb_cb {
 
 #ifdef CONFIG_PACKET_MMAP
 
-static void *packet_lookup_frame(struct packet_sock *po, unsigned int position,
-				 int status)
+static void __packet_set_status(struct packet_sock *po, void *frame, int status)
 {
-	unsigned int pg_vec_pos, frame_offset;
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
 		void *raw;
 	} h;
 
-	pg_vec_pos = position / po->frames_per_block;
-	frame_offset = position % po->frames_per_block;
-
-	h.raw = po->pg_vec[pg_vec_pos] + (frame_offset * po->frame_size);
+	h.raw = frame;
 	switch (po->tp_version) {
 	case TPACKET_V1:
-		if (status != (h.h1->tp_status ? TP_STATUS_USER :
-						TP_STATUS_KERNEL))
-			return NULL;
+		h.h1->tp_status = status;
 		break;
 	case TPACKET_V2:
-		if (status != (h.h2->tp_status ? TP_STATUS_USER :
-						TP_STATUS_KERNEL))
-			return NULL;
+		h.h2->tp_status = status;
 		break;
+	default:
+		BUG();
 	}
-	return h.raw;
 }
 
-static void __packet_set_status(struct packet_sock *po, void *frame, int status)
+static int __packet_get_status(struct packet_sock *po, void *frame)
 {
 	union {
 		struct tpacket_hdr *h1;
@@ -246,12 +269,262 @@ static void __packet_set_status(struct packet_sock *po, void *frame, int status)
 	h.raw = frame;
 	switch (po->tp_version) {
 	case TPACKET_V1:
-		h.h1->tp_status = status;
-		break;
+		return h.h1->tp_status;
 	case TPACKET_V2:
-		h.h2->tp_status = status;
-		break;
+		return h.h2->tp_status;
+	default:
+		BUG();
+		return 0;
+	}
+}
+
+static void *packet_lookup_frame(struct packet_sock *po,
+				 struct packet_ring_buffer *rb,
+				 unsigned int position, int status)
+{
+	unsigned int pg_vec_pos, frame_offset;
+	char *frame;
+
+	pg_vec_pos = position / rb->frames_per_block;
+	frame_offset = position % rb->frames_per_block;
+
+	frame = rb->pg_vec[pg_vec_pos] + (frame_offset * rb->frame_size);
+	if (status != __packet_get_status(po, frame))
+		return NULL;
+	return frame;
+}
+
+static inline void *packet_current_frame(struct packet_sock *po,
+					 struct packet_ring_buffer *rb,
+					 int status)
+{
+	return packet_lookup_frame(po, rb, rb->head, status);
+}
+
+static inline void *packet_previous_frame(struct packet_sock *po,
+					  struct packet_ring_buffer *rb,
+					  int status)
+{
+	unsigned int previous = rb->head ? rb->head - 1 : rb->frame_max;
+
+	return packet_lookup_frame(po, rb, previous, status);
+}
+
+static inline void packet_increment_head(struct packet_ring_buffer *rb)
+{
+	rb->head = rb->head != rb->frame_max ? rb->head + 1 : 0;
+}
+
+static void packet_flush_dcache(char *start, char *end)
+{
+	struct page *p_start, *p_end;
+
+	p_start = virt_to_page(start);
+	p_end = virt_to_page(end - 1);
+	while (p_start <= p_end) {
+		flush_dcache_page(p_start);
+		p_start++;
+	}
+}
+
+/*
+ * TPACKET_V3 block-based receive ring.
+ *
+ * Instead of giving every packet a fixed size frame, packets are packed
+ * back to back into the active block, which is handed to user space as
+ * a whole once it is full or once retire_blk_timer fires with packets in
+ * it.  A busy ring thus costs one wakeup per block rather than one per
+ * packet, and small packets do not waste most of a frame.
+ *
+ * Block state is protected by sk_receive_queue.lock.  Packet data is
+ * copied outside of the lock; blk_fill_in_prog counts these copies so
+ * that a block is never retired with a packet still half written.
+ */
+
+#define BLK_HDR_LEN		ALIGN(sizeof(struct tpacket_block_desc), 8)
+#define BLK_PLUS_PRIV(sz_of_priv) \
+	(BLK_HDR_LEN + ALIGN((sz_of_priv), 8))
+
+static void prb_open_block(struct tpacket_kbdq_core *pkc, char *block)
+{
+	struct tpacket_block_desc *pbd = (struct tpacket_block_desc *)block;
+	struct tpacket_hdr_v1 *h1 = &pbd->hdr.bh1;
+
+	pbd->version = TPACKET_V3;
+	pbd->offset_to_priv = BLK_HDR_LEN;
+	h1->num_pkts = 0;
+	h1->offset_to_first_pkt = BLK_PLUS_PRIV(pkc->blk_sizeof_priv);
+	h1->blk_len = h1->offset_to_first_pkt;
+	h1->seq_num = pkc->knxt_seq_num++;
+	memset(&h1->ts_first_pkt, 0, sizeof(h1->ts_first_pkt));
+	memset(&h1->ts_last_pkt, 0, sizeof(h1->ts_last_pkt));
+
+	pkc->pkblk_start = block;
+	pkc->pkblk_end = block + pkc->kblk_size;
+	pkc->nxt_offset = block + h1->offset_to_first_pkt;
+	pkc->prev = NULL;
+	pkc->blk_open = 1;
+
+	mod_timer(&pkc->retire_blk_timer, jiffies + pkc->tov_in_jiffies);
+}
+
+/*
+ * Open the next block if user space has handed it back.  Otherwise the
+ * queue is frozen and packets are dropped until it catches up.
+ */
+static int prb_open_next_block(struct packet_sock *po)
+{
+	struct tpacket_kbdq_core *pkc = &po->rx_ring.prb_bdqc;
+	char *block = po->rx_ring.pg_vec[pkc->kactive_blk_num];
+	struct tpacket_block_desc *pbd = (struct tpacket_block_desc *)block;
+
+	if (pbd->hdr.bh1.block_status != TP_STATUS_KERNEL) {
+		if (!pkc->frozen) {
+			pkc->frozen = 1;
+			po->freeze_q_cnt++;
+		}
+		return 0;
 	}
+	/* Do not write the block before user space is done reading it */
+	smp_mb();
+	pkc->frozen = 0;
+	prb_open_block(pkc, block);
+	return 1;
+}
+
+static void prb_close_block(struct packet_sock *po, int status)
+{
+	struct tpacket_kbdq_core *pkc = &po->rx_ring.prb_bdqc;
+	struct tpacket_block_desc *pbd;
+	struct tpacket_hdr_v1 *h1;
+	struct tpacket3_hdr *ppd;
+
+	pbd = (struct tpacket_block_desc *)pkc->pkblk_start;
+	h1 = &pbd->hdr.bh1;
+
+	while (atomic_read(&pkc->blk_fill_in_prog))
+		cpu_relax();
+	smp_rmb();
+
+	if (h1->num_pkts) {
+		ppd = (struct tpacket3_hdr *)(pkc->pkblk_start +
+					      h1->offset_to_first_pkt);
+		h1->ts_first_pkt.ts_sec = ppd->tp_sec;
+		h1->ts_first_pkt.ts_nsec = ppd->tp_nsec;
+		ppd = (struct tpacket3_hdr *)pkc->prev;
+		h1->ts_last_pkt.ts_sec = ppd->tp_sec;
+		h1->ts_last_pkt.ts_nsec = ppd->tp_nsec;
+	}
+
+	smp_wmb();
+	h1->block_status = TP_STATUS_USER | status;
+	smp_mb();
+	packet_flush_dcache(pkc->pkblk_start, pkc->nxt_offset);
+
+	pkc->blk_open = 0;
+	if (++pkc->kactive_blk_num == pkc->knum_blocks)
+		pkc->kactive_blk_num = 0;
+
+	po->sk.sk_data_ready(&po->sk, 0);
+}
+
+/*
+ * Reserve len bytes for a packet in the active block, retiring it first
+ * if it is full.  Called with sk_receive_queue.lock held; the caller has
+ * to drop blk_fill_in_prog once the packet is written.
+ */
+static void *prb_find_slot(struct packet_sock *po, unsigned int len)
+{
+	struct tpacket_kbdq_core *pkc = &po->rx_ring.prb_bdqc;
+	struct tpacket_block_desc *pbd;
+	char *curr;
+
+	if (unlikely(len > pkc->max_frame_len))
+		return NULL;
+
+	if (pkc->blk_open && pkc->nxt_offset + len > pkc->pkblk_end)
+		prb_close_block(po, 0);
+	if (!pkc->blk_open && !prb_open_next_block(po))
+		return NULL;
+
+	curr = pkc->nxt_offset;
+	((struct tpacket3_hdr *)curr)->tp_next_offset = 0;
+	if (pkc->prev)
+		((struct tpacket3_hdr *)pkc->prev)->tp_next_offset =
+			curr - pkc->prev;
+	pkc->prev = curr;
+	pkc->nxt_offset += len;
+
+	pbd = (struct tpacket_block_desc *)pkc->pkblk_start;
+	pbd->hdr.bh1.num_pkts++;
+	pbd->hdr.bh1.blk_len += len;
+
+	atomic_inc(&pkc->blk_fill_in_prog);
+	return curr;
+}
+
+static void prb_retire_rx_blk_timer_expired(unsigned long data)
+{
+	struct packet_sock *po = (struct packet_sock *)data;
+	struct tpacket_kbdq_core *pkc = &po->rx_ring.prb_bdqc;
+	struct tpacket_block_desc *pbd;
+
+	spin_lock(&po->sk.sk_receive_queue.lock);
+	if (unlikely(pkc->delete_blk_timer))
+		goto out;
+
+	if (pkc->blk_open) {
+		pbd = (struct tpacket_block_desc *)pkc->pkblk_start;
+		if (!pbd->hdr.bh1.num_pkts) {
+			mod_timer(&pkc->retire_blk_timer,
+				  jiffies + pkc->tov_in_jiffies);
+			goto out;
+		}
+		prb_close_block(po, TP_STATUS_BLK_TMO);
+	}
+
+	/* This also thaws a frozen queue once user space has caught up */
+	if (!prb_open_next_block(po))
+		mod_timer(&pkc->retire_blk_timer,
+			  jiffies + pkc->tov_in_jiffies);
+out:
+	spin_unlock(&po->sk.sk_receive_queue.lock);
+}
+
+static void prb_init_blk_timer(struct packet_sock *po,
+			       struct packet_ring_buffer *rb,
+			       struct tpacket_req3 *req3)
+{
+	struct tpacket_kbdq_core *pkc = &rb->prb_bdqc;
+	unsigned int tov = req3->tp_retire_blk_tov;
+
+	memset(pkc, 0, sizeof(*pkc));
+	pkc->knum_blocks = req3->tp_block_nr;
+	pkc->kblk_size = req3->tp_block_size;
+	pkc->blk_sizeof_priv = req3->tp_sizeof_priv;
+	pkc->max_frame_len = (pkc->kblk_size -
+			      BLK_PLUS_PRIV(pkc->blk_sizeof_priv)) &
+			     ~(TPACKET_ALIGNMENT - 1);
+
+	/* By default give a block the time it takes to fill it at 1Gb/s */
+	if (!tov)
+		tov = DIV_ROUND_UP(pkc->kblk_size, 125000);
+	pkc->tov_in_jiffies = msecs_to_jiffies(tov);
+
+	setup_timer(&pkc->retire_blk_timer, prb_retire_rx_blk_timer_expired,
+		    (unsigned long)po);
+}
+
+static int prb_previous_blk_status(struct packet_sock *po)
+{
+	struct tpacket_kbdq_core *pkc = &po->rx_ring.prb_bdqc;
+	unsigned int previous;
+	struct tpacket_block_desc *pbd;
+
+	previous = pkc->kactive_blk_num ? pkc->kactive_blk_num - 1 :
+					  pkc->knum_blocks - 1;
+	pbd = (struct tpacket_block_desc *)po->rx_ring.pg_vec[previous];
+	return pbd->hdr.bh1.block_status;
 }
 #endif
 
@@ -597,6 +870,7 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} h;
 	u8 * skb_head = skb->data;
@@ -648,7 +922,15 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 		macoff = netoff - maclen;
 	}
 
-	if (macoff + snaplen > po->frame_size) {
+	if (po->tp_version == TPACKET_V3) {
+		unsigned int max_frame_len = po->rx_ring.prb_bdqc.max_frame_len;
+
+		if (macoff + snaplen > max_frame_len) {
+			snaplen = max_frame_len - macoff;
+			if ((int)snaplen < 0)
+				snaplen = 0;
+		}
+	} else if (macoff + snaplen > po->rx_ring.frame_size) {
 		if (po->copy_thresh &&
 		    atomic_read(&sk->sk_rmem_alloc) + skb->truesize <
 		    (unsigned)sk->sk_rcvbuf) {
@@ -661,16 +943,23 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 			if (copy_skb)
 				skb_set_owner_r(copy_skb, sk);
 		}
-		snaplen = po->frame_size - macoff;
+		snaplen = po->rx_ring.frame_size - macoff;
 		if ((int)snaplen < 0)
 			snaplen = 0;
 	}
 
 	spin_lock(&sk->sk_receive_queue.lock);
-	h.raw = packet_lookup_frame(po, po->head, TP_STATUS_KERNEL);
-	if (!h.raw)
-		goto ring_is_full;
-	po->head = po->head != po->frame_max ? po->head+1 : 0;
+	if (po->tp_version == TPACKET_V3) {
+		h.raw = prb_find_slot(po, TPACKET_ALIGN(macoff + snaplen));
+		if (!h.raw)
+			goto ring_is_full;
+	} else {
+		h.raw = packet_current_frame(po, &po->rx_ring,
+					     TP_STATUS_KERNEL);
+		if (!h.raw)
+			goto ring_is_full;
+		packet_increment_head(&po->rx_ring);
+	}
 	po->stats.tp_packets++;
 	if (copy_skb) {
 		status |= TP_STATUS_COPY;
@@ -710,6 +999,23 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 		h.h2->tp_vlan_tci = skb->vlan_tci;
 		hdrlen = sizeof(*h.h2);
 		break;
+	case TPACKET_V3:
+		/* tp_next_offset is maintained by prb_find_slot() */
+		h.h3->tp_status = status;
+		h.h3->tp_len = skb->len;
+		h.h3->tp_snaplen = snaplen;
+		h.h3->tp_mac = macoff;
+		h.h3->tp_net = netoff;
+		if (skb->tstamp.tv64)
+			ts = ktime_to_timespec(skb->tstamp);
+		else
+			getnstimeofday(&ts);
+		h.h3->tp_sec = ts.tv_sec;
+		h.h3->tp_nsec = ts.tv_nsec;
+		h.h3->hv1.tp_rxhash = 0;
+		h.h3->hv1.tp_vlan_tci = skb->vlan_tci;
+		hdrlen = sizeof(*h.h3);
+		break;
 	default:
 		BUG();
 	}
@@ -725,20 +1031,16 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev, struct packe
 	else
 		sll->sll_ifindex = dev->ifindex;
 
+	if (po->tp_version == TPACKET_V3) {
+		/* The whole block is handed over when it is retired */
+		smp_mb__before_atomic_dec();
+		atomic_dec(&po->rx_ring.prb_bdqc.blk_fill_in_prog);
+		goto drop_n_restore;
+	}
+
 	__packet_set_status(po, h.raw, status);
 	smp_mb();
-
-	{
-		struct page *p_start, *p_end;
-		u8 *h_end = h.raw + macoff + snaplen - 1;
-
-		p_start = virt_to_page(h.raw);
-		p_end = virt_to_page(h_end);
-		while (p_start <= p_end) {
-			flush_dcache_page(p_start);
-			p_start++;
-		}
-	}
+	packet_flush_dcache(h.raw, h.raw + macoff + snaplen);
 
 	sk->sk_data_ready(sk, 0);
 
@@ -760,6 +1062,139 @@ ring_is_full:
 	goto drop_n_restore;
 }
 
+/*
+ * A malformed TX frame is skipped if the socket tolerates loss, otherwise
+ * it is flagged and left at the head of the ring for user space to fix.
+ */
+static int tpacket_skip_frame(struct packet_sock *po, void *frame)
+{
+	if (!po->tp_loss) {
+		__packet_set_status(po, frame, TP_STATUS_WRONG_FORMAT);
+		return 0;
+	}
+	__packet_set_status(po, frame, TP_STATUS_AVAILABLE);
+	packet_increment_head(&po->tx_ring);
+	return 1;
+}
+
+/*
+ * Send every frame user space has marked TP_STATUS_SEND_REQUEST in the
+ * TX ring, starting at its head.  The frame contents are copied into
+ * the skb, so each frame is handed back as soon as it has been queued.
+ */
+static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
+{
+	struct sock *sk = &po->sk;
+	struct sockaddr_ll *saddr = (struct sockaddr_ll *)msg->msg_name;
+	struct sk_buff *skb;
+	struct net_device *dev;
+	__be16 proto;
+	unsigned char *addr;
+	int ifindex, err, reserve = 0;
+	unsigned int tp_len, size_max;
+	int len_sum = 0;
+	union {
+		struct tpacket_hdr *h1;
+		struct tpacket2_hdr *h2;
+		void *raw;
+	} ph;
+
+	if (saddr == NULL) {
+		ifindex	= po->ifindex;
+		proto	= po->num;
+		addr	= NULL;
+	} else {
+		if (msg->msg_namelen < sizeof(struct sockaddr_ll))
+			return -EINVAL;
+		if (msg->msg_namelen < (saddr->sll_halen + offsetof(struct sockaddr_ll, sll_addr)))
+			return -EINVAL;
+		ifindex	= saddr->sll_ifindex;
+		proto	= saddr->sll_protocol;
+		addr	= saddr->sll_addr;
+	}
+
+	dev = dev_get_by_index(sock_net(sk), ifindex);
+	if (dev == NULL)
+		return -ENXIO;
+	if (sk->sk_type == SOCK_RAW)
+		reserve = dev->hard_header_len;
+
+	err = -ENETDOWN;
+	if (!(dev->flags & IFF_UP))
+		goto out_put;
+
+	mutex_lock(&po->pg_vec_lock);
+	err = 0;
+	if (unlikely(po->tx_ring.pg_vec == NULL))
+		goto out_unlock;
+
+	/* Packet data follows the tpacket header in the frame */
+	size_max = po->tx_ring.frame_size -
+		   (po->tp_hdrlen - sizeof(struct sockaddr_ll));
+	if (size_max > dev->mtu + reserve)
+		size_max = dev->mtu + reserve;
+
+	while ((ph.raw = packet_current_frame(po, &po->tx_ring,
+					      TP_STATUS_SEND_REQUEST))) {
+		/* Read the frame only after having seen its status */
+		smp_rmb();
+		if (po->tp_version == TPACKET_V2)
+			tp_len = ph.h2->tp_len;
+		else
+			tp_len = ph.h1->tp_len;
+
+		err = -EMSGSIZE;
+		if (unlikely(tp_len > size_max)) {
+			if (tpacket_skip_frame(po, ph.raw))
+				continue;
+			goto out_unlock;
+		}
+
+		skb = sock_alloc_send_skb(sk, tp_len + LL_ALLOCATED_SPACE(dev),
+					  msg->msg_flags & MSG_DONTWAIT, &err);
+		if (skb == NULL)
+			goto out_unlock;
+
+		skb_reserve(skb, LL_RESERVED_SPACE(dev));
+		skb_reset_network_header(skb);
+
+		err = -EINVAL;
+		if (sk->sk_type == SOCK_DGRAM &&
+		    dev_hard_header(skb, dev, ntohs(proto), addr, NULL,
+				    tp_len) < 0) {
+			kfree_skb(skb);
+			if (tpacket_skip_frame(po, ph.raw))
+				continue;
+			goto out_unlock;
+		}
+
+		memcpy(skb_put(skb, tp_len),
+		       ph.raw + po->tp_hdrlen - sizeof(struct sockaddr_ll),
+		       tp_len);
+
+		skb->protocol = proto;
+		skb->dev = dev;
+		skb->priority = sk->sk_priority;
+
+		smp_mb();
+		__packet_set_status(po, ph.raw, TP_STATUS_AVAILABLE);
+		flush_dcache_page(virt_to_page(ph.raw));
+		packet_increment_head(&po->tx_ring);
+
+		err = dev_queue_xmit(skb);
+		if (err > 0 && (err = net_xmit_errno(err)) != 0)
+			goto out_unlock;
+		len_sum += tp_len;
+	}
+	err = len_sum;
+
+out_unlock:
+	mutex_unlock(&po->pg_vec_lock);
+out_put:
+	dev_put(dev);
+	return err;
+}
+
 #endif
 
 
@@ -774,6 +1209,11 @@ static int packet_sendmsg(struct kiocb *iocb, struct socket *sock,
 	unsigned char *addr;
 	int ifindex, err, reserve = 0;
 
+#ifdef CONFIG_PACKET_MMAP
+	if (pkt_sk(sk)->tx_ring.pg_vec)
+		return tpacket_snd(pkt_sk(sk), msg);
+#endif
+
 	/*
 	 *	Get and verify the address.
 	 */
@@ -893,10 +1333,17 @@ static int packet_release(struct socket *sock)
 	packet_flush_mclist(sk);
 
 #ifdef CONFIG_PACKET_MMAP
-	if (po->pg_vec) {
-		struct tpacket_req req;
-		memset(&req, 0, sizeof(req));
-		packet_set_ring(sk, &req, 1);
+	{
+		union tpacket_req_u req_u;
+
+		if (po->rx_ring.pg_vec) {
+			memset(&req_u, 0, sizeof(req_u));
+			packet_set_ring(sk, &req_u, 1, 0);
+		}
+		if (po->tx_ring.pg_vec) {
+			memset(&req_u, 0, sizeof(req_u));
+			packet_set_ring(sk, &req_u, 1, 1);
+		}
 	}
 #endif
 
@@ -1415,14 +1862,21 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 
 #ifdef CONFIG_PACKET_MMAP
 	case PACKET_RX_RING:
+	case PACKET_TX_RING:
 	{
-		struct tpacket_req req;
+		union tpacket_req_u req_u;
+		int len;
 
-		if (optlen<sizeof(req))
+		if (po->tp_version == TPACKET_V3)
+			len = sizeof(req_u.req3);
+		else
+			len = sizeof(req_u.req);
+		if (optlen < len)
 			return -EINVAL;
-		if (copy_from_user(&req,optval,sizeof(req)))
+		if (copy_from_user(&req_u, optval, len))
 			return -EFAULT;
-		return packet_set_ring(sk, &req, 0);
+		return packet_set_ring(sk, &req_u, 0,
+				       optname == PACKET_TX_RING);
 	}
 	case PACKET_COPY_THRESH:
 	{
@@ -1442,13 +1896,14 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 
 		if (optlen != sizeof(val))
 			return -EINVAL;
-		if (po->pg_vec)
+		if (po->rx_ring.pg_vec || po->tx_ring.pg_vec)
 			return -EBUSY;
 		if (copy_from_user(&val, optval, sizeof(val)))
 			return -EFAULT;
 		switch (val) {
 		case TPACKET_V1:
 		case TPACKET_V2:
+		case TPACKET_V3:
 			po->tp_version = val;
 			return 0;
 		default:
@@ -1461,13 +1916,26 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 
 		if (optlen != sizeof(val))
 			return -EINVAL;
-		if (po->pg_vec)
+		if (po->rx_ring.pg_vec || po->tx_ring.pg_vec)
 			return -EBUSY;
 		if (copy_from_user(&val, optval, sizeof(val)))
 			return -EFAULT;
 		po->tp_reserve = val;
 		return 0;
 	}
+	case PACKET_LOSS:
+	{
+		unsigned int val;
+
+		if (optlen != sizeof(val))
+			return -EINVAL;
+		if (po->rx_ring.pg_vec || po->tx_ring.pg_vec)
+			return -EBUSY;
+		if (copy_from_user(&val, optval, sizeof(val)))
+			return -EFAULT;
+		po->tp_loss = !!val;
+		return 0;
+	}
 #endif
 	case PACKET_AUXDATA:
 	{
@@ -1506,7 +1974,7 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 	struct sock *sk = sock->sk;
 	struct packet_sock *po = pkt_sk(sk);
 	void *data;
-	struct tpacket_stats st;
+	union tpacket_stats_u st;
 
 	if (level != SOL_PACKET)
 		return -ENOPROTOOPT;
@@ -1519,13 +1987,22 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 
 	switch(optname)	{
 	case PACKET_STATISTICS:
+#ifdef CONFIG_PACKET_MMAP
+		if (po->tp_version == TPACKET_V3) {
+			if (len > sizeof(struct tpacket_stats_v3))
+				len = sizeof(struct tpacket_stats_v3);
+		} else
+#endif
 		if (len > sizeof(struct tpacket_stats))
 			len = sizeof(struct tpacket_stats);
 		spin_lock_bh(&sk->sk_receive_queue.lock);
-		st = po->stats;
-		memset(&po->stats, 0, sizeof(st));
+		st.stats3.tp_packets = po->stats.tp_packets;
+		st.stats3.tp_drops = po->stats.tp_drops;
+		st.stats3.tp_freeze_q_cnt = po->freeze_q_cnt;
+		memset(&po->stats, 0, sizeof(po->stats));
+		po->freeze_q_cnt = 0;
 		spin_unlock_bh(&sk->sk_receive_queue.lock);
-		st.tp_packets += st.tp_drops;
+		st.stats3.tp_packets += st.stats3.tp_drops;
 
 		data = &st;
 		break;
@@ -1562,6 +2039,9 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 		case TPACKET_V2:
 			val = sizeof(struct tpacket2_hdr);
 			break;
+		case TPACKET_V3:
+			val = sizeof(struct tpacket3_hdr);
+			break;
 		default:
 			return -EINVAL;
 		}
@@ -1705,13 +2185,21 @@ static unsigned int packet_poll(struct file * file, struct socket *sock,
 	unsigned int mask = datagram_poll(file, sock, wait);
 
 	spin_lock_bh(&sk->sk_receive_queue.lock);
-	if (po->pg_vec) {
-		unsigned last = po->head ? po->head-1 : po->frame_max;
-
-		if (packet_lookup_frame(po, last, TP_STATUS_USER))
+	if (po->rx_ring.pg_vec) {
+		if (po->tp_version == TPACKET_V3) {
+			if (prb_previous_blk_status(po) != TP_STATUS_KERNEL)
+				mask |= POLLIN | POLLRDNORM;
+		} else if (!packet_previous_frame(po, &po->rx_ring,
+						  TP_STATUS_KERNEL))
 			mask |= POLLIN | POLLRDNORM;
 	}
 	spin_unlock_bh(&sk->sk_receive_queue.lock);
+	spin_lock_bh(&sk->sk_write_queue.lock);
+	if (po->tx_ring.pg_vec) {
+		if (packet_current_frame(po, &po->tx_ring, TP_STATUS_AVAILABLE))
+			mask |= POLLOUT | POLLWRNORM;
+	}
+	spin_unlock_bh(&sk->sk_write_queue.lock);
 	return mask;
 }
 
@@ -1788,20 +2276,28 @@ out_free_pgvec:
 	goto out;
 }
 
-static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing)
+static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
+			   int closing, int tx_ring)
 {
 	char **pg_vec = NULL;
 	struct packet_sock *po = pkt_sk(sk);
+	struct tpacket_req *req = &req_u->req;
+	struct packet_ring_buffer *rb;
+	struct sk_buff_head *rb_queue;
 	int was_running, order = 0;
+	int del_blk_timer = 0;
 	__be16 num;
 	int err = 0;
 
+	rb = tx_ring ? &po->tx_ring : &po->rx_ring;
+	rb_queue = tx_ring ? &sk->sk_write_queue : &sk->sk_receive_queue;
+
 	if (req->tp_block_nr) {
 		int i;
 
 		/* Sanity tests and some calculations */
 
-		if (unlikely(po->pg_vec))
+		if (unlikely(rb->pg_vec))
 			return -EBUSY;
 
 		switch (po->tp_version) {
@@ -1811,6 +2307,12 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 		case TPACKET_V2:
 			po->tp_hdrlen = TPACKET2_HDRLEN;
 			break;
+		case TPACKET_V3:
+			/* Block-based rings are receive only */
+			if (tx_ring)
+				return -EINVAL;
+			po->tp_hdrlen = TPACKET3_HDRLEN;
+			break;
 		}
 
 		if (unlikely((int)req->tp_block_size <= 0))
@@ -1822,11 +2324,15 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 			return -EINVAL;
 		if (unlikely(req->tp_frame_size & (TPACKET_ALIGNMENT - 1)))
 			return -EINVAL;
+		if (po->tp_version == TPACKET_V3 &&
+		    unlikely(BLK_PLUS_PRIV((u64)req_u->req3.tp_sizeof_priv) +
+			     req->tp_frame_size > req->tp_block_size))
+			return -EINVAL;
 
-		po->frames_per_block = req->tp_block_size/req->tp_frame_size;
-		if (unlikely(po->frames_per_block <= 0))
+		rb->frames_per_block = req->tp_block_size/req->tp_frame_size;
+		if (unlikely(rb->frames_per_block <= 0))
 			return -EINVAL;
-		if (unlikely((po->frames_per_block * req->tp_block_nr) !=
+		if (unlikely((rb->frames_per_block * req->tp_block_nr) !=
 			     req->tp_frame_nr))
 			return -EINVAL;
 
@@ -1836,13 +2342,16 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 		if (unlikely(!pg_vec))
 			goto out;
 
-		for (i = 0; i < req->tp_block_nr; i++) {
-			void *ptr = pg_vec[i];
-			int k;
+		if (po->tp_version != TPACKET_V3) {
+			for (i = 0; i < req->tp_block_nr; i++) {
+				void *ptr = pg_vec[i];
+				int k;
 
-			for (k = 0; k < po->frames_per_block; k++) {
-				__packet_set_status(po, ptr, TP_STATUS_KERNEL);
-				ptr += req->tp_frame_size;
+				for (k = 0; k < rb->frames_per_block; k++) {
+					__packet_set_status(po, ptr,
+							    TP_STATUS_KERNEL);
+					ptr += req->tp_frame_size;
+				}
 			}
 		}
 		/* Done */
@@ -1873,25 +2382,37 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req, int closing
 		err = 0;
 #define XC(a, b) ({ __typeof__ ((a)) __t; __t = (a); (a) = (b); __t; })
 
-		spin_lock_bh(&sk->sk_receive_queue.lock);
-		pg_vec = XC(po->pg_vec, pg_vec);
-		po->frame_max = (req->tp_frame_nr - 1);
-		po->head = 0;
-		po->frame_size = req->tp_frame_size;
-		spin_unlock_bh(&sk->sk_receive_queue.lock);
-
-		order = XC(po->pg_vec_order, order);
-		req->tp_block_nr = XC(po->pg_vec_len, req->tp_block_nr);
-
-		po->pg_vec_pages = req->tp_block_size/PAGE_SIZE;
-		po->prot_hook.func = po->pg_vec ? tpacket_rcv : packet_rcv;
-		skb_queue_purge(&sk->sk_receive_queue);
+		spin_lock_bh(&rb_queue->lock);
+		if (po->tp_version == TPACKET_V3 && !tx_ring) {
+			if (pg_vec) {
+				prb_init_blk_timer(po, rb, &req_u->req3);
+			} else if (rb->pg_vec) {
+				rb->prb_bdqc.delete_blk_timer = 1;
+				del_blk_timer = 1;
+			}
+		}
+		pg_vec = XC(rb->pg_vec, pg_vec);
+		rb->frame_max = (req->tp_frame_nr - 1);
+		rb->head = 0;
+		rb->frame_size = req->tp_frame_size;
+		spin_unlock_bh(&rb_queue->lock);
+
+		order = XC(rb->pg_vec_order, order);
+		req->tp_block_nr = XC(rb->pg_vec_len, req->tp_block_nr);
+
+		rb->pg_vec_pages = req->tp_block_size/PAGE_SIZE;
+		po->prot_hook.func = (po->rx_ring.pg_vec) ?
+						tpacket_rcv : packet_rcv;
+		skb_queue_purge(rb_queue);
 #undef XC
 		if (atomic_read(&po->mapped))
 			printk(KERN_DEBUG "packet_mmap: vma is busy: %d\n", atomic_read(&po->mapped));
 	}
 	mutex_unlock(&po->pg_vec_lock);
 
+	if (del_blk_timer)
+		del_timer_sync(&rb->prb_bdqc.retire_blk_timer);
+
 	spin_lock(&po->bind_lock);
 	if (was_running && !po->running) {
 		sock_hold(sk);
@@ -1909,11 +2430,15 @@ out:
 	return err;
 }
 
+/*
+ * The RX ring, if any, is mapped first and the TX ring right after it.
+ */
 static int packet_mmap(struct file *file, struct socket *sock, struct vm_area_struct *vma)
 {
 	struct sock *sk = sock->sk;
 	struct packet_sock *po = pkt_sk(sk);
-	unsigned long size;
+	unsigned long size, expected_size;
+	struct packet_ring_buffer *rb;
 	unsigned long start;
 	int err = -EINVAL;
 	int i;
@@ -1921,24 +2446,38 @@ static int packet_mmap(struct file *file, struct socket *sock, struct vm_area_st
 	if (vma->vm_pgoff)
 		return -EINVAL;
 
-	size = vma->vm_end - vma->vm_start;
-
 	mutex_lock(&po->pg_vec_lock);
-	if (po->pg_vec == NULL)
+
+	expected_size = 0;
+	for (rb = &po->rx_ring; rb <= &po->tx_ring; rb++) {
+		if (rb->pg_vec)
+			expected_size += rb->pg_vec_len * rb->pg_vec_pages *
+					 PAGE_SIZE;
+	}
+
+	if (expected_size == 0)
 		goto out;
-	if (size != po->pg_vec_len*po->pg_vec_pages*PAGE_SIZE)
+
+	size = vma->vm_end - vma->vm_start;
+	if (size != expected_size)
 		goto out;
 
 	start = vma->vm_start;
-	for (i = 0; i < po->pg_vec_len; i++) {
-		struct page *page = virt_to_page(po->pg_vec[i]);
-		int pg_num;
-
-		for (pg_num = 0; pg_num < po->pg_vec_pages; pg_num++, page++) {
-			err = vm_insert_page(vma, start, page);
-			if (unlikely(err))
-				goto out;
-			start += PAGE_SIZE;
+	for (rb = &po->rx_ring; rb <= &po->tx_ring; rb++) {
+		if (rb->pg_vec == NULL)
+			continue;
+
+		for (i = 0; i < rb->pg_vec_len; i++) {
+			struct page *page = virt_to_page(rb->pg_vec[i]);
+			int pg_num;
+
+			for (pg_num = 0; pg_num < rb->pg_vec_pages;
+			     pg_num++, page++) {
+				err = vm_insert_page(vma, start, page);
+				if (unlikely(err))
+					goto out;
+				start += PAGE_SIZE;
+			}
 		}
 	}
 	atomic_inc(&po->mapped);
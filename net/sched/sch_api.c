@@ -889,6 +889,10 @@ static int qdisc_change(struct Qdisc *sch, struct nlattr **tca)
 	qdisc_put_stab(sch->stab);
 	sch->stab = stab;
 
+	/* Size tables and estimators only apply to enqueued skbs. */
+	if (stab || tca[TCA_RATE])
+		sch->flags &= ~TCQ_F_CAN_BYPASS;
+
 	if (tca[TCA_RATE])
 		/* NB: ignores errors from replace_estimator
 		   because change can't be undone. */
@@ -1153,6 +1157,7 @@ static int tc_fill_qdisc(struct sk_buff *skb, struct Qdisc *q, u32 clid,
 	struct tcmsg *tcm;
 	struct nlmsghdr  *nlh;
 	unsigned char *b = skb_tail_pointer(skb);
+	struct gnet_stats_basic bstats;
 	struct gnet_dump d;
 
 	nlh = NLMSG_NEW(skb, pid, seq, event, sizeof(*tcm), flags);
@@ -1179,7 +1184,9 @@ static int tc_fill_qdisc(struct sk_buff *skb, struct Qdisc *q, u32 clid,
 	if (q->ops->dump_stats && q->ops->dump_stats(q, &d) < 0)
 		goto nla_put_failure;
 
-	if (gnet_stats_copy_basic(&d, &q->bstats) < 0 ||
+	qdisc_read_bstats(q, &bstats);
+
+	if (gnet_stats_copy_basic(&d, &bstats) < 0 ||
 	    gnet_stats_copy_rate_est(&d, &q->rate_est) < 0 ||
 	    gnet_stats_copy_queue(&d, &q->qstats) < 0)
 		goto nla_put_failure;
@@ -24,6 +24,7 @@
 #include <linux/init.h>
 #include <linux/rcupdate.h>
 #include <linux/list.h>
+#include <linux/percpu.h>
 #include <net/pkt_sched.h>
 
 /* Main transmission queue. */
@@ -102,6 +103,59 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 	return ret;
 }
 
+/*
+ * Hand one skb to the driver under the tx queue lock.  Called with
+ * __QDISC_STATE_RUNNING held and qdisc_lock(q) released.
+ */
+static inline int qdisc_xmit_one(struct sk_buff *skb, struct net_device *dev,
+				 struct netdev_queue *txq)
+{
+	int ret = NETDEV_TX_BUSY;
+
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+	if (!netif_tx_queue_stopped(txq) &&
+	    !netif_tx_queue_frozen(txq))
+		ret = dev_hard_start_xmit(skb, dev, txq);
+	HARD_TX_UNLOCK(dev, txq);
+
+	return ret;
+}
+
+/*
+ * Act on the driver's verdict for skb.  Called under qdisc_lock(q).
+ * Returns >0 if the queue should be run again, 0 otherwise.
+ */
+static inline int qdisc_xmit_status(struct sk_buff *skb, struct Qdisc *q,
+				    struct netdev_queue *txq, int ret)
+{
+	switch (ret) {
+	case NETDEV_TX_OK:
+		/* Driver sent out skb successfully */
+		ret = qdisc_qlen(q);
+		break;
+
+	case NETDEV_TX_LOCKED:
+		/* Driver try lock failed */
+		ret = handle_dev_cpu_collision(skb, txq, q);
+		break;
+
+	default:
+		/* Driver returned NETDEV_TX_BUSY - requeue skb */
+		if (unlikely (ret != NETDEV_TX_BUSY && net_ratelimit()))
+			printk(KERN_WARNING "BUG %s code %d qlen %d\n",
+			       qdisc_dev(q)->name, ret, q->q.qlen);
+
+		ret = dev_requeue_skb(skb, q);
+		break;
+	}
+
+	if (ret && (netif_tx_queue_stopped(txq) ||
+		    netif_tx_queue_frozen(txq)))
+		ret = 0;
+
+	return ret;
+}
+
 /*
  * NOTE: Called under qdisc_lock(q) with locally disabled BH.
  *
@@ -124,10 +178,10 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 static inline int qdisc_restart(struct Qdisc *q)
 {
 	struct netdev_queue *txq;
-	int ret = NETDEV_TX_BUSY;
 	struct net_device *dev;
 	spinlock_t *root_lock;
 	struct sk_buff *skb;
+	int ret;
 
 	/* Dequeue packet */
 	if (unlikely((skb = dequeue_skb(q)) == NULL))
@@ -141,40 +195,11 @@ static inline int qdisc_restart(struct Qdisc *q)
 	dev = qdisc_dev(q);
 	txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
 
-	HARD_TX_LOCK(dev, txq, smp_processor_id());
-	if (!netif_tx_queue_stopped(txq) &&
-	    !netif_tx_queue_frozen(txq))
-		ret = dev_hard_start_xmit(skb, dev, txq);
-	HARD_TX_UNLOCK(dev, txq);
+	ret = qdisc_xmit_one(skb, dev, txq);
 
 	spin_lock(root_lock);
 
-	switch (ret) {
-	case NETDEV_TX_OK:
-		/* Driver sent out skb successfully */
-		ret = qdisc_qlen(q);
-		break;
-
-	case NETDEV_TX_LOCKED:
-		/* Driver try lock failed */
-		ret = handle_dev_cpu_collision(skb, txq, q);
-		break;
-
-	default:
-		/* Driver returned NETDEV_TX_BUSY - requeue skb */
-		if (unlikely (ret != NETDEV_TX_BUSY && net_ratelimit()))
-			printk(KERN_WARNING "BUG %s code %d qlen %d\n",
-			       dev->name, ret, q->q.qlen);
-
-		ret = dev_requeue_skb(skb, q);
-		break;
-	}
-
-	if (ret && (netif_tx_queue_stopped(txq) ||
-		    netif_tx_queue_frozen(txq)))
-		ret = 0;
-
-	return ret;
+	return qdisc_xmit_status(skb, q, txq, ret);
 }
 
 void __qdisc_run(struct Qdisc *q)
@@ -196,6 +221,61 @@ void __qdisc_run(struct Qdisc *q)
 	clear_bit(__QDISC_STATE_RUNNING, &q->state);
 }
 
+/*
+ * Fast path for an idle qdisc: send skb straight to the driver without
+ * taking qdisc_lock(q).  Winning __QDISC_STATE_RUNNING makes this CPU the
+ * only one allowed to dequeue, so nothing queued can be overtaken; CPUs
+ * that enqueue meanwhile see the bit set and leave their skbs for us to
+ * flush once we drop it.  Only qdiscs with TCQ_F_CAN_BYPASS get here; their
+ * byte/packet counts go to per-cpu counters folded by qdisc_read_bstats().
+ *
+ * Called with BH disabled.  Returns true if skb was consumed, false if the
+ * caller must enqueue it as usual.
+ */
+bool qdisc_bypass_xmit(struct sk_buff *skb, struct Qdisc *q,
+		       struct netdev_queue *txq)
+{
+	spinlock_t *root_lock = qdisc_lock(q);
+	struct gnet_stats_basic *bstats;
+	int ret;
+
+	if (qdisc_qlen(q) ||
+	    test_and_set_bit(__QDISC_STATE_RUNNING, &q->state))
+		return false;
+
+	if (unlikely(qdisc_qlen(q) || q->gso_skb ||
+		     test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
+		/* Caller enqueues and runs the queue under the lock. */
+		clear_bit(__QDISC_STATE_RUNNING, &q->state);
+		return false;
+	}
+
+	bstats = per_cpu_ptr(q->cpu_bstats, smp_processor_id());
+	bstats->bytes += skb->len;
+	bstats->packets++;
+
+	ret = qdisc_xmit_one(skb, qdisc_dev(q), txq);
+	if (likely(ret == NETDEV_TX_OK)) {
+		clear_bit(__QDISC_STATE_RUNNING, &q->state);
+		smp_mb__after_clear_bit();
+		if (unlikely(qdisc_qlen(q))) {
+			spin_lock(root_lock);
+			qdisc_run(q);
+			spin_unlock(root_lock);
+		}
+		return true;
+	}
+
+	spin_lock(root_lock);
+	if (qdisc_xmit_status(skb, q, txq, ret))
+		__qdisc_run(q);
+	else
+		clear_bit(__QDISC_STATE_RUNNING, &q->state);
+	spin_unlock(root_lock);
+
+	return true;
+}
+
 static void dev_watchdog(unsigned long arg)
 {
 	struct net_device *dev = (struct net_device *)arg;
@@ -555,10 +635,31 @@ void qdisc_destroy(struct Qdisc *qdisc)
 	dev_put(qdisc_dev(qdisc));
 
 	kfree_skb(qdisc->gso_skb);
+	free_percpu(qdisc->cpu_bstats);
 	kfree((char *) qdisc - qdisc->padded);
 }
 EXPORT_SYMBOL(qdisc_destroy);
 
+/* Fold the per-cpu bypass counters of qdisc into bstats. */
+void qdisc_read_bstats(const struct Qdisc *qdisc,
+		       struct gnet_stats_basic *bstats)
+{
+	int cpu;
+
+	*bstats = qdisc->bstats;
+	if (!qdisc->cpu_bstats)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		const struct gnet_stats_basic *b;
+
+		b = per_cpu_ptr(qdisc->cpu_bstats, cpu);
+		bstats->bytes += b->bytes;
+		bstats->packets += b->packets;
+	}
+}
+EXPORT_SYMBOL(qdisc_read_bstats);
+
 static bool dev_all_qdisc_sleeping_noop(struct net_device *dev)
 {
 	unsigned int i;
@@ -585,6 +686,10 @@ static void attach_one_default_qdisc(struct net_device *dev,
 			printk(KERN_INFO "%s: activation failed\n", dev->name);
 			return;
 		}
+		/* Without per-cpu counters the queue is always used. */
+		qdisc->cpu_bstats = alloc_percpu(struct gnet_stats_basic);
+		if (qdisc->cpu_bstats)
+			qdisc->flags |= TCQ_F_CAN_BYPASS;
 	} else {
 		qdisc =  &noqueue_qdisc;
 	}
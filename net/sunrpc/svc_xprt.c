@@ -157,6 +157,7 @@ void svc_xprt_init(struct svc_xprt_class *xcl, struct svc_xprt *xprt,
 	INIT_LIST_HEAD(&xprt->xpt_deferred);
 	mutex_init(&xprt->xpt_mutex);
 	spin_lock_init(&xprt->xpt_lock);
+	xprt->xpt_rx_cpu = -1;
 	set_bit(XPT_BUSY, &xprt->xpt_flags);
 }
 EXPORT_SYMBOL_GPL(svc_xprt_init);
@@ -292,6 +293,29 @@ static void svc_thread_dequeue(struct svc_pool *pool, struct svc_rqst *rqstp)
 	list_del(&rqstp->rq_list);
 }
 
+/*
+ * Pick the pool a transport is queued to: the one local to the cpu
+ * that last received data for it, so that the thread handling the
+ * request runs on the node where the packet and socket state are
+ * cache hot.  Enqueues from elsewhere (svc_xprt_received() on the
+ * nfsd thread, write space callbacks) then no longer drag the
+ * transport over to another node.  Fall back to the local pool if the
+ * home pool has no threads at all.
+ */
+static struct svc_pool *svc_xprt_pool(struct svc_xprt *xprt, int cpu)
+{
+	struct svc_serv	*serv = xprt->xpt_server;
+	struct svc_pool *pool;
+	int rx_cpu = xprt->xpt_rx_cpu;
+
+	if (rx_cpu >= 0 && rx_cpu != cpu && cpu_online(rx_cpu)) {
+		pool = svc_pool_for_cpu(serv, rx_cpu);
+		if (pool->sp_nrthreads)
+			return pool;
+	}
+	return svc_pool_for_cpu(serv, cpu);
+}
+
 /*
  * Queue up a transport with data pending. If there are idle nfsd
  * processes, wake 'em up.
@@ -310,7 +334,7 @@ void svc_xprt_enqueue(struct svc_xprt *xprt)
 		return;
 
 	cpu = get_cpu();
-	pool = svc_pool_for_cpu(xprt->xpt_server, cpu);
+	pool = svc_xprt_pool(xprt, cpu);
 	put_cpu();
 
 	spin_lock_bh(&pool->sp_lock);
@@ -335,6 +359,7 @@ void svc_xprt_enqueue(struct svc_xprt *xprt)
 	}
 	BUG_ON(xprt->xpt_pool != NULL);
 	xprt->xpt_pool = pool;
+	xprt->xpt_qtime = ktime_get();
 
 	/* Handle pending connection */
 	if (test_bit(XPT_CONN, &xprt->xpt_flags))
@@ -395,6 +420,29 @@ out_unlock:
 }
 EXPORT_SYMBOL_GPL(svc_xprt_enqueue);
 
+/*
+ * Account for a thread of @pool picking up @xprt: how long the
+ * transport waited, and whether its data arrived on a cpu belonging to
+ * another pool.  Must be called with the pool->sp_lock held.
+ */
+static void svc_xprt_account(struct svc_pool *pool, struct svc_xprt *xprt)
+{
+	struct svc_serv	*serv = xprt->xpt_server;
+	int rx_cpu = xprt->xpt_rx_cpu;
+	s64 wait;
+
+	pool->sp_stats.xprts_handled++;
+	if (rx_cpu >= 0 && svc_pool_for_cpu(serv, rx_cpu) != pool)
+		pool->sp_stats.handoffs++;
+
+	wait = ktime_us_delta(ktime_get(), xprt->xpt_qtime);
+	if (wait < 0)
+		return;
+	pool->sp_stats.wait_usecs += wait;
+	if (wait > pool->sp_stats.wait_usecs_max)
+		pool->sp_stats.wait_usecs_max = wait;
+}
+
 /*
  * Dequeue the first transport.  Must be called with the pool->sp_lock held.
  */
@@ -655,6 +703,7 @@ int svc_recv(struct svc_rqst *rqstp, long timeout)
 	}
 	xprt = svc_xprt_dequeue(pool);
 	if (xprt) {
+		svc_xprt_account(pool, xprt);
 		rqstp->rq_xprt = xprt;
 		svc_xprt_get(xprt);
 		rqstp->rq_reserved = serv->sv_max_mesg;
@@ -704,6 +753,7 @@ int svc_recv(struct svc_rqst *rqstp, long timeout)
 			else
 				return -EAGAIN;
 		}
+		svc_xprt_account(pool, xprt);
 	}
 	spin_unlock_bh(&pool->sp_lock);
 
@@ -1187,17 +1237,21 @@ static int svc_pool_stats_show(struct seq_file *m, void *p)
 	struct svc_pool *pool = p;
 
 	if (p == SEQ_START_TOKEN) {
-		seq_puts(m, "# pool packets-arrived sockets-enqueued threads-woken overloads-avoided threads-timedout\n");
+		seq_puts(m, "# pool packets-arrived sockets-enqueued threads-woken overloads-avoided threads-timedout xprts-handled cross-pool-handoffs wait-usecs wait-usecs-max\n");
 		return 0;
 	}
 
-	seq_printf(m, "%u %lu %lu %lu %lu %lu\n",
+	seq_printf(m, "%u %lu %lu %lu %lu %lu %lu %lu %lu %lu\n",
 		pool->sp_id,
 		pool->sp_stats.packets,
 		pool->sp_stats.sockets_queued,
 		pool->sp_stats.threads_woken,
 		pool->sp_stats.overloads_avoided,
-		pool->sp_stats.threads_timedout);
+		pool->sp_stats.threads_timedout,
+		pool->sp_stats.xprts_handled,
+		pool->sp_stats.handoffs,
+		pool->sp_stats.wait_usecs,
+		pool->sp_stats.wait_usecs_max);
 
 	return 0;
 }
@@ -42,6 +42,7 @@
 #include <linux/interrupt.h>
 #include <linux/workqueue.h>
 #include <linux/net.h>
+#include <linux/slab.h>
 
 #include <linux/sunrpc/clnt.h>
 #include <linux/sunrpc/metrics.h>
@@ -915,20 +916,51 @@ void xprt_transmit(struct rpc_task *task)
 	spin_unlock_bh(&xprt->transport_lock);
 }
 
+static inline int xprt_dynamic_slot(struct rpc_xprt *xprt, struct rpc_rqst *req)
+{
+	return req < &xprt->slot[0] || req >= &xprt->slot[xprt->min_reqs];
+}
+
+/*
+ * Grow the slot table beyond the preallocated slots.  We are called
+ * under the reserve_lock, so this must not sleep; if memory is tight
+ * the caller simply waits on the backlog for a slot to be released.
+ */
+static struct rpc_rqst *xprt_alloc_slot(struct rpc_xprt *xprt)
+{
+	struct rpc_rqst *req;
+
+	if (xprt->num_reqs >= xprt->max_reqs)
+		return NULL;
+	req = kzalloc(sizeof(*req), GFP_NOWAIT | __GFP_NOWARN);
+	if (req == NULL)
+		return NULL;
+	INIT_LIST_HEAD(&req->rq_list);
+	xprt->num_reqs++;
+	return req;
+}
+
 static inline void do_xprt_reserve(struct rpc_task *task)
 {
 	struct rpc_xprt	*xprt = task->tk_xprt;
+	struct rpc_rqst	*req;
 
 	task->tk_status = 0;
 	if (task->tk_rqstp)
 		return;
 	if (!list_empty(&xprt->free)) {
-		struct rpc_rqst	*req = list_entry(xprt->free.next, struct rpc_rqst, rq_list);
+		req = list_entry(xprt->free.next, struct rpc_rqst, rq_list);
 		list_del_init(&req->rq_list);
 		task->tk_rqstp = req;
 		xprt_request_init(task, xprt);
 		return;
 	}
+	req = xprt_alloc_slot(xprt);
+	if (req != NULL) {
+		task->tk_rqstp = req;
+		xprt_request_init(task, xprt);
+		return;
+	}
 	dprintk("RPC:       waiting for request slot\n");
 	task->tk_status = -EAGAIN;
 	task->tk_timeout = 0;
@@ -1010,6 +1042,13 @@ void xprt_release(struct rpc_task *task)
 	dprintk("RPC: %5u release request %p\n", task->tk_pid, req);
 
 	spin_lock(&xprt->reserve_lock);
+	if (xprt_dynamic_slot(xprt, req) && xprt->backlog.qlen == 0) {
+		/* Nobody is waiting: shrink back towards min_reqs */
+		xprt->num_reqs--;
+		spin_unlock(&xprt->reserve_lock);
+		kfree(req);
+		return;
+	}
 	list_add(&req->rq_list, &xprt->free);
 	rpc_wake_up_next(&xprt->backlog);
 	spin_unlock(&xprt->reserve_lock);
@@ -1064,14 +1103,20 @@ found:
 	rpc_init_wait_queue(&xprt->resend, "xprt_resend");
 	rpc_init_priority_wait_queue(&xprt->backlog, "xprt_backlog");
 
-	/* initialize free list */
-	for (req = &xprt->slot[xprt->max_reqs-1]; req >= &xprt->slot[0]; req--)
+	/*
+	 * initialize free list.  Transports that don't set min_reqs get
+	 * a fixed size slot table of max_reqs entries.
+	 */
+	if (xprt->min_reqs == 0 || xprt->min_reqs > xprt->max_reqs)
+		xprt->min_reqs = xprt->max_reqs;
+	xprt->num_reqs = xprt->min_reqs;
+	for (req = &xprt->slot[xprt->min_reqs-1]; req >= &xprt->slot[0]; req--)
 		list_add(&req->rq_list, &xprt->free);
 
 	xprt_init_xid(xprt);
 
-	dprintk("RPC:       created transport %p with %u slots\n", xprt,
-			xprt->max_reqs);
+	dprintk("RPC:       created transport %p with %u slots (max %u)\n",
+			xprt, xprt->min_reqs, xprt->max_reqs);
 
 	return xprt;
 }
@@ -1081,6 +1126,18 @@ found:
  * @kref: kref for the transport to destroy
  *
  */
+static void xprt_free_dynamic_slots(struct rpc_xprt *xprt)
+{
+	struct rpc_rqst *req, *next;
+
+	list_for_each_entry_safe(req, next, &xprt->free, rq_list) {
+		if (!xprt_dynamic_slot(xprt, req))
+			continue;
+		list_del(&req->rq_list);
+		kfree(req);
+	}
+}
+
 static void xprt_destroy(struct kref *kref)
 {
 	struct rpc_xprt *xprt = container_of(kref, struct rpc_xprt, kref);
@@ -1094,6 +1151,7 @@ static void xprt_destroy(struct kref *kref)
 	rpc_destroy_wait_queue(&xprt->sending);
 	rpc_destroy_wait_queue(&xprt->resend);
 	rpc_destroy_wait_queue(&xprt->backlog);
+	xprt_free_dynamic_slots(xprt);
 	/*
 	 * Tear down transport state and free the rpc_xprt
 	 */
@@ -315,6 +315,7 @@ static void rq_cq_reap(struct svcxprt_rdma *xprt)
 	if (ctxt)
 		atomic_inc(&rdma_stat_rq_prod);
 
+	svc_xprt_note_rx(&xprt->sc_xprt);
 	set_bit(XPT_DATA, &xprt->sc_xprt.xpt_flags);
 	/*
 	 * If data arrived before established event,
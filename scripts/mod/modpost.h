@@ -123,17 +123,42 @@ struct elf_info {
 	Elf_Shdr     *sechdrs;
 	Elf_Sym      *symtab_start;
 	Elf_Sym      *symtab_stop;
-	Elf_Section  export_sec;
-	Elf_Section  export_unused_sec;
-	Elf_Section  export_gpl_sec;
-	Elf_Section  export_unused_gpl_sec;
-	Elf_Section  export_gpl_future_sec;
-	Elf_Section  markers_strings_sec;
+	unsigned int export_sec;
+	unsigned int export_unused_sec;
+	unsigned int export_gpl_sec;
+	unsigned int export_unused_gpl_sec;
+	unsigned int export_gpl_future_sec;
+	unsigned int markers_strings_sec;
 	const char   *strtab;
 	char	     *modinfo;
 	unsigned int modinfo_len;
+
+	/* Objects with SHN_LORESERVE or more sections keep the real
+	 * counts in section header 0 (see parse_elf()). */
+	unsigned int num_sections;
+	unsigned int secindex_strings;
+	/* Index of the Nth symbol's section when its st_shndx is
+	 * SHN_XINDEX, from the SHT_SYMTAB_SHNDX section. */
+	Elf32_Word   *symtab_shndx_start;
+	Elf32_Word   *symtab_shndx_stop;
 };
 
+/* Is st_shndx one of the reserved values such as SHN_ABS or SHN_COMMON,
+ * rather than (a reference to) a real section index? */
+static inline int is_shndx_special(unsigned int i)
+{
+	return i != SHN_XINDEX && i >= SHN_LORESERVE && i <= SHN_HIRESERVE;
+}
+
+/* Section index of a symbol that is not is_shndx_special(). */
+static inline unsigned int get_secindex(const struct elf_info *info,
+					const Elf_Sym *sym)
+{
+	if (sym->st_shndx != SHN_XINDEX)
+		return sym->st_shndx;
+	return info->symtab_shndx_start[sym - info->symtab_start];
+}
+
 /* file2alias.c */
 extern unsigned int cross_build;
 void handle_moddevtable(struct module *mod, struct elf_info *info,